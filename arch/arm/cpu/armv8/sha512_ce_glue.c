@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha512_ce_glue.c - SHA-384/SHA-512 secure hash using ARMv8.2 Crypto
+ * Extensions
+ */
+
+#include <asm/system.h>
+#include <u-boot/sha512.h>
+
+extern void sha512_armv8_ce_process(uint64_t state[8], uint8_t const *src,
+				    uint32_t blocks);
+
+/* -1 until checked; in .data as this may run before BSS is usable */
+static int sha512_armv8_ce __section(".data") = -1;
+
+static bool sha512_armv8_ce_present(void)
+{
+	u64 reg;
+
+	if (sha512_armv8_ce >= 0)
+		return sha512_armv8_ce;
+
+	/* the SHA512 instructions are optional, even in ARMv8.2 */
+	asm volatile("mrs %0, ID_AA64ISAR0_EL1\n" : "=r" (reg));
+	sha512_armv8_ce = (reg & ID_AA64ISAR0_EL1_SHA2) >=
+		ID_AA64ISAR0_EL1_SHA2_512;
+
+	return sha512_armv8_ce;
+}
+
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	if (sha512_armv8_ce_present())
+		sha512_armv8_ce_process(ctx->state, data, blocks);
+	else
+		sha512_process_generic(ctx, data, blocks);
+}
@@ -82,6 +82,11 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
  * recv_packets - number of packets returned
+ * recv_batches - number of times recv_batch() returned packets
+ * recv_frees - number of times received packets were given back, each of
+ *	which would refill the receive ring of a real driver
+ * recv_copies - number of packets moved up the queue when others were given
+ *	back
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
  */
@@ -94,6 +99,9 @@ struct eth_sandbox_priv {
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
 	int recv_packets;
+	int recv_batches;
+	int recv_frees;
+	int recv_copies;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
 };
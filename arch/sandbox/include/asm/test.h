@@ -361,4 +361,65 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+/**
+ * struct sandbox_mmc_stats - Data commands seen by a sandbox MMC device
+ *
+ * @transfers: Number of multiple-block reads and writes
+ * @set_counts: Number of SET_BLOCK_COUNT commands
+ * @stops: Number of STOP_TRANSMISSION commands
+ * @max_blocks: Largest number of blocks in one transfer
+ * @tasks: Number of tasks carried out by the command queue engine
+ * @max_tasks: Most tasks queued in the engine at once
+ * @discards: Number of times the card's task queue was discarded
+ */
+struct sandbox_mmc_stats {
+	uint transfers;
+	uint set_counts;
+	uint stops;
+	uint max_blocks;
+	uint tasks;
+	uint max_tasks;
+	uint discards;
+};
+
+/**
+ * sandbox_mmc_set_host() - Set the limits of a sandbox MMC host
+ *
+ * @dev: MMC device
+ * @b_max: Most blocks in one transfer
+ * @cmd23: true if the host can send SET_BLOCK_COUNT, false if not
+ */
+void sandbox_mmc_set_host(struct udevice *dev, uint b_max, bool cmd23);
+
+/**
+ * sandbox_mmc_set_cqe() - Make the card of a sandbox MMC device report a queue
+ *
+ * With CONFIG_MMC_CQHCI the host has a command queue engine, which is used
+ * once the card has a queue. It is switched on by the next block request.
+ *
+ * @dev: MMC device
+ * @depth: Number of tasks the card can queue, 0 for none
+ */
+void sandbox_mmc_set_cqe(struct udevice *dev, uint depth);
+
+/**
+ * sandbox_mmc_fail_tasks() - Make tasks of the command queue engine fail
+ *
+ * Each slot in @tags reports an error the next time a task in it is carried
+ * out.
+ *
+ * @dev: MMC device
+ * @tags: Bitmask of the slots whose next task fails
+ */
+void sandbox_mmc_fail_tasks(struct udevice *dev, u32 tags);
+
+/**
+ * sandbox_mmc_get_stats() - Get the data commands seen, then clear the counts
+ *
+ * @dev: MMC device
+ * @stats: Returns the data commands seen since the last call
+ */
+void sandbox_mmc_get_stats(struct udevice *dev,
+			   struct sandbox_mmc_stats *stats);
+
 #endif
@@ -1306,8 +1306,32 @@ int calculate_hash(const void *data, int data_len, const char *name,
 	return 0;
 }
 
+/**
+ * fit_image_find_digest() - Find a precomputed digest for a hash node
+ * @digests: Array of precomputed digests, may be NULL
+ * @count: Number of entries in @digests
+ * @noffset: Offset of the hash node to look for
+ *
+ * Return: matching entry, or NULL if the caller did not precompute the digest
+ * for @noffset
+ */
+static const struct fit_image_digest *
+fit_image_find_digest(const struct fit_image_digest *digests, int count,
+		      int noffset)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (digests[i].noffset == noffset)
+			return &digests[i];
+	}
+
+	return NULL;
+}
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size, const struct fit_image_digest *digest,
+				char **err_msgp)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
 	int value_len;
@@ -1338,7 +1362,10 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	if (digest) {
+		memcpy(value, digest->value, digest->value_len);
+		value_len = digest->value_len;
+	} else if (calculate_hash(data, size, algo, value, &value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -1354,9 +1381,11 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	return 0;
 }
 
-int fit_image_verify_with_data(const void *fit, int image_noffset,
-			       const void *key_blob, const void *data,
-			       size_t size)
+int fit_image_verify_with_digests(const void *fit, int image_noffset,
+				  const void *key_blob, const void *data,
+				  size_t size,
+				  const struct fit_image_digest *digests,
+				  int digest_count)
 {
 	int		noffset = 0;
 	char		*err_msg = "";
@@ -1382,8 +1411,12 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 		 */
 		if (!strncmp(name, FIT_HASH_NODENAME,
 			     strlen(FIT_HASH_NODENAME))) {
+			const struct fit_image_digest *digest;
+
+			digest = fit_image_find_digest(digests, digest_count,
+						       noffset);
 			if (fit_image_check_hash(fit, noffset, data, size,
-						 &err_msg))
+						 digest, &err_msg))
 				goto error;
 			puts("+ ");
 		} else if (FIT_IMAGE_ENABLE_VERIFY && verify_all &&
@@ -1419,6 +1452,14 @@ error:
 	return 0;
 }
 
+int fit_image_verify_with_data(const void *fit, int image_noffset,
+			       const void *key_blob, const void *data,
+			       size_t size)
+{
+	return fit_image_verify_with_digests(fit, image_noffset, key_blob,
+					     data, size, NULL, 0);
+}
+
 /**
  * fit_image_verify - verify data integrity
  * @fit: pointer to the FIT format image header
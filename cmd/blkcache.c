@@ -4,6 +4,7 @@
  * Author: Eric Nelson<eric@nelint.com>
  *
  */
+#include <blk.h>
 #include <command.h>
 #include <config.h>
 #include <malloc.h>
@@ -13,31 +14,47 @@
 static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
+	struct block_cache_dev_stats dev_stats;
 	struct block_cache_stats stats;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
 	       "misses: %u\n"
+	       "evictions: %u\n"
 	       "entries: %u\n"
+	       "size: %lu\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache size: %lu\n",
+	       stats.hits, stats.misses, stats.evictions, stats.entries,
+	       stats.size, stats.max_blocks_per_entry, stats.max_size);
+
+	for (i = 0; !blkcache_dev_stats(i, &dev_stats); i++)
+		printf("%s %d: hits %u, misses %u, blocks %u, size %lu\n",
+		       blk_get_uclass_name(dev_stats.iftype), dev_stats.devnum,
+		       dev_stats.hits, dev_stats.misses, dev_stats.blocks,
+		       dev_stats.size);
 	return 0;
 }
 
 static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 			  int argc, char *const argv[])
 {
-	unsigned blocks_per_entry, max_entries;
+	unsigned blocks_per_entry;
+	unsigned long max_size;
 	if (argc != 3)
 		return CMD_RET_USAGE;
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
-	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
-	printf("changed to max of %u entries of %u blocks each\n",
-	       max_entries, blocks_per_entry);
+	max_size = simple_strtoul(argv[2], 0, 0);
+	if (blkcache_configure(blocks_per_entry, max_size)) {
+		printf("size is too small for reads of %u blocks\n",
+		       blocks_per_entry);
+		return CMD_RET_USAGE;
+	}
+	printf("changed to max of %lu bytes, caching reads of up to %u blocks\n",
+	       max_size, blocks_per_entry);
 	return 0;
 }
 
@@ -70,6 +87,6 @@ U_BOOT_CMD(
 	blkcache, 4, 0, do_blkcache,
 	"block cache diagnostics and control",
 	"show - show and reset statistics\n"
-	"blkcache configure <blocks> <entries> "
-	"- set max blocks per entry and max cache entries\n"
+	"blkcache configure <blocks> <size> "
+	"- set max blocks per cached read and max cache size in bytes\n"
 );
@@ -164,15 +164,43 @@ U_BOOT_CMD(
 #if defined(CONFIG_CMD_WGET)
 static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc, char * const argv[])
 {
+	char *args[3] = { argv[0] };
+	int nargs = 1;
+	int i, ret;
+
 	wget_info = &default_wget_info;
 
-	return netboot_common(WGET, cmdtp, argc, argv);
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			wget_info->jobs = dectoul(argv[++i], NULL);
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			if (!CONFIG_IS_ENABLED(HASH)) {
+				printf("wget: hash support is not enabled\n");
+				return CMD_RET_FAILURE;
+			}
+			wget_info->hash = argv[++i];
+		} else if (nargs < ARRAY_SIZE(args)) {
+			args[nargs++] = argv[i];
+		} else {
+			return CMD_RET_USAGE;
+		}
+	}
+
+	ret = netboot_common(WGET, cmdtp, nargs, args);
+
+	/* the options only apply to this command */
+	wget_info->jobs = 0;
+	wget_info->hash = NULL;
+
+	return ret;
 }
 
 U_BOOT_CMD(
-	wget,   3,      1,      do_wget,
+	wget,   7,      1,      do_wget,
 	"boot image via network using HTTP protocol",
-	"[loadAddress] [[hostIPaddr:]path and image name]"
+	"[-j jobs] [-c algo:digest] [loadAddress] [[hostIPaddr:]path and image name]\n"
+	"    -j: fetch the file as this many ranges in parallel\n"
+	"    -c: check the download against this hash, e.g. sha256:<hex>"
 );
 #endif
 
@@ -12,16 +12,19 @@
 static int do_pcap_init(struct cmd_tbl *cmdtp, int flag, int argc,
 			char *const argv[])
 {
+	unsigned int size, snaplen = 0;
 	phys_addr_t addr;
-	unsigned int size;
 
-	if (argc != 3)
+	if (argc < 3)
 		return CMD_RET_USAGE;
 
 	addr = hextoul(argv[1], NULL);
 	size = dectoul(argv[2], NULL);
+	if (argc > 3)
+		snaplen = dectoul(argv[3], NULL);
 
-	return pcap_init(addr, size) ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+	return pcap_init(addr, size, snaplen) ? CMD_RET_FAILURE :
+						CMD_RET_SUCCESS;
 }
 
 static int do_pcap_start(struct cmd_tbl *cmdtp, int flag, int argc,
@@ -42,6 +45,22 @@ static int do_pcap_status(struct cmd_tbl *cmdtp, int flag, int argc,
 	return pcap_print_status() ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
 }
 
+static int do_pcap_filter(struct cmd_tbl *cmdtp, int flag, int argc,
+			  char *const argv[])
+{
+	int i;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	for (i = 1; i < argc; i++) {
+		if (pcap_set_filter(argv[i]))
+			return CMD_RET_FAILURE;
+	}
+
+	return CMD_RET_SUCCESS;
+}
+
 static int do_pcap_clear(struct cmd_tbl *cmdtp, int flag, int argc,
 			 char *const argv[])
 {
@@ -51,21 +70,27 @@ static int do_pcap_clear(struct cmd_tbl *cmdtp, int flag, int argc,
 U_BOOT_LONGHELP(pcap,
 	"- network packet capture\n\n"
 	"pcap\n"
-	"pcap init\t\t\t<addr> <max_size>\n"
+	"pcap init\t\t\t<addr> <max_size> [<snaplen>]\n"
 	"pcap start\t\t\tstart capture\n"
 	"pcap stop\t\t\tstop capture\n"
 	"pcap status\t\t\tprint status\n"
+	"pcap filter\t\t\t<proto>...\n"
 	"pcap clear\t\t\tclear capture buffer\n"
 	"\n"
 	"With:\n"
 	"\t<addr>: user address to which pcap will be stored (hexedcimal)\n"
 	"\t<max_size>: Maximum size of pcap file (decimal)\n"
+	"\t<snaplen>: Maximum bytes kept from each packet (decimal)\n"
+	"\t<proto>: arp, ip, ip6, icmp, udp or tcp to capture only these,\n"
+	"\t\tor all\n"
 	"\n");
 
 U_BOOT_CMD_WITH_SUBCMDS(pcap, "pcap", pcap_help_text,
-			U_BOOT_SUBCMD_MKENT(init, 3, 0, do_pcap_init),
+			U_BOOT_SUBCMD_MKENT(init, 4, 0, do_pcap_init),
 			U_BOOT_SUBCMD_MKENT(start, 1, 0, do_pcap_start),
 			U_BOOT_SUBCMD_MKENT(stop, 1, 0, do_pcap_stop),
 			U_BOOT_SUBCMD_MKENT(status, 1, 0, do_pcap_status),
+			U_BOOT_SUBCMD_MKENT(filter, CONFIG_SYS_MAXARGS, 0,
+					    do_pcap_filter),
 			U_BOOT_SUBCMD_MKENT(clear, 1, 0, do_pcap_clear),
 );
@@ -689,6 +689,9 @@ static void initcall_run_r(void)
 	INITCALL(arch_early_init_r);
 #endif
 	INITCALL(power_init_board);
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	INITCALL(dm_probe_async_start);
+#endif
 #if CONFIG_IS_ENABLED(MTD_NOR_FLASH)
 	INITCALL(initr_flash);
 #endif
@@ -731,6 +734,10 @@ static void initcall_run_r(void)
 	 * Do pci configuration
 	 */
 	INITCALL(pci_init);
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	/* PCI devices such as NVMe controllers have only just been bound */
+	INITCALL(dm_probe_async_start);
+#endif
 #endif
 	INITCALL(stdio_add_devices);
 	INITCALL(jumptable_init);
@@ -773,6 +780,9 @@ static void initcall_run_r(void)
 #endif
 #if CONFIG_IS_ENABLED(POST)
 	INITCALL(initr_post);
+#endif
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	INITCALL(dm_probe_async_wait);
 #endif
 	WATCHDOG_RESET();
 	INITCALL_EVT(EVT_LAST_STAGE_INIT);
@@ -4,9 +4,11 @@
  * Written by Simon Glass <sjg@chromium.org>
  */
 
+#include <bootstage.h>
 #include <errno.h>
 #include <fpga.h>
 #include <gzip.h>
+#include <hash.h>
 #include <image.h>
 #include <log.h>
 #include <memalign.h>
@@ -193,6 +195,153 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return ALIGN(data_size, spl_get_bl_len(info));
 }
 
+/* Maximum number of hash nodes per image which are hashed while streaming */
+#define SPL_FIT_STREAM_MAX_HASHES	2
+
+/**
+ * struct spl_fit_stream - Results of reading an image in chunks
+ *
+ * @digest:	Digests of the hash nodes which were hashed while reading
+ * @digest_count: Number of valid entries in @digest
+ * @decompressed: true if the image was decompressed while reading
+ * @length:	Size of the decompressed image, if @decompressed is true
+ */
+struct spl_fit_stream {
+	struct fit_image_digest digest[SPL_FIT_STREAM_MAX_HASHES];
+	int digest_count;
+	bool decompressed;
+	ulong length;
+};
+
+#if CONFIG_IS_ENABLED(LOAD_FIT_STREAM)
+/**
+ * spl_fit_stream_read(): read an image, hashing and decompressing as we go
+ * @info:	points to information about the device to load data from
+ * @fit:	Pointer to the FIT blob
+ * @node:	offset of the DT node describing the image to load
+ * @read_offset: block-aligned offset on the device to start reading at
+ * @src:	buffer to read into; the image data starts @overhead bytes in
+ * @overhead:	number of bytes before the image data in the first block
+ * @length:	size of the image data
+ * @dst:	destination for gunzip'ed data, or NULL to leave the image as
+ *		it is; must be NULL if the image is still to be verified
+ * @stream:	returns the digests which were calculated and, if @dst is
+ *		not NULL, the size of the decompressed image
+ *
+ * The image is read CONFIG_SPL_LOAD_FIT_STREAM_CHUNK_SIZE bytes at a time.
+ * Each chunk is passed to the hash algorithm of every hash node which has
+ * progressive-hash support and to the decompressor straight after it has
+ * been read. Hash nodes which cannot be handled this way are left for
+ * fit_image_verify_with_digests() to hash in one go.
+ *
+ * Return:	0 on success, -EIO on a read error, or another negative error
+ *		number if decompression failed
+ */
+static int spl_fit_stream_read(struct spl_load_info *info, const void *fit,
+			       int node, ulong read_offset, void *src,
+			       ulong overhead, size_t length, void *dst,
+			       struct spl_fit_stream *stream)
+{
+	struct hash_algo *algo[SPL_FIT_STREAM_MAX_HASHES];
+	void *hash_ctx[SPL_FIT_STREAM_MAX_HASHES];
+	struct gunzip_stream *gz = NULL;
+	ulong bl_len = spl_get_bl_len(info);
+	ulong chunk, pos, end, total;
+	int i, noffset, ret = 0;
+
+	stream->digest_count = 0;
+	stream->decompressed = false;
+	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
+		fdt_for_each_subnode(noffset, fit, node) {
+			const char *name = fit_get_name(fit, noffset, NULL);
+			const char *algo_name;
+
+			i = stream->digest_count;
+			if (i == SPL_FIT_STREAM_MAX_HASHES)
+				break;
+			if (strncmp(name, FIT_HASH_NODENAME,
+				    strlen(FIT_HASH_NODENAME)))
+				continue;
+			if (fit_image_hash_get_algo(fit, noffset, &algo_name) ||
+			    hash_progressive_lookup_algo(algo_name, &algo[i]) ||
+			    algo[i]->hash_init(algo[i], &hash_ctx[i]))
+				continue;
+			stream->digest[i].noffset = noffset;
+			stream->digest_count++;
+		}
+	}
+
+	if (dst) {
+		ret = gunzip_stream_init(&gz, dst, CONFIG_SYS_BOOTM_LEN);
+		if (ret)
+			goto out;
+	}
+
+	chunk = ALIGN(CONFIG_VAL(LOAD_FIT_STREAM_CHUNK_SIZE), bl_len);
+	end = overhead + length;
+	total = ALIGN(end, bl_len);
+	for (pos = 0; pos < total; pos += chunk) {
+		ulong size = min(chunk, total - pos);
+		ulong start = max(pos, overhead);
+		ulong stop = min(pos + size, end);
+
+		if (info->read(info, read_offset + pos, size, src + pos) <
+		    stop - pos) {
+			ret = -EIO;
+			goto out;
+		}
+
+		for (i = 0; i < stream->digest_count; i++) {
+			if (!hash_ctx[i])
+				continue;
+			if (algo[i]->hash_update(algo[i], hash_ctx[i],
+						 src + start, stop - start,
+						 stop == end)) {
+				/* the context has been freed already */
+				hash_ctx[i] = NULL;
+				ret = -EIO;
+				goto out;
+			}
+		}
+
+		if (gz) {
+			ret = gunzip_stream_feed(gz, src + start, stop - start);
+			if (ret < 0)
+				goto out;
+			ret = 0;
+		}
+	}
+
+out:
+	for (i = 0; i < stream->digest_count; i++) {
+		struct fit_image_digest *digest = &stream->digest[i];
+
+		if (!hash_ctx[i])
+			continue;
+		if (algo[i]->hash_finish(algo[i], hash_ctx[i], digest->value,
+					 sizeof(digest->value)) && !ret)
+			ret = -EIO;
+		digest->value_len = algo[i]->digest_size;
+	}
+	if (gz) {
+		if (!gunzip_stream_finish(gz, &stream->length))
+			stream->decompressed = true;
+		else if (!ret)
+			ret = -EIO;
+	}
+
+	return ret;
+}
+#else
+static int spl_fit_stream_read(struct spl_load_info *info, const void *fit,
+			       int node, ulong read_offset, void *src,
+			       ulong overhead, size_t length, void *dst,
+			       struct spl_fit_stream *stream)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * load_simple_fit(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -225,12 +374,13 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	struct spl_fit_stream stream = { };
+	int ret;
 
 	log_debug("starting\n");
 	if (CONFIG_IS_ENABLED(BOOTMETH_VBE) &&
 	    xpl_get_phase(info) != IH_PHASE_NONE) {
 		enum image_phase_t phase;
-		int ret;
 
 		ret = fit_image_get_phase(fit, node, &phase);
 		/* if the image is for any phase, let's use it */
@@ -276,19 +426,23 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		external_data = true;
 	}
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SPL_FIT_LOAD, "spl_fit_load");
 	if (external_data) {
 		ulong read_offset;
 		void *src_ptr;
 
 		/* External data */
-		if (fit_image_get_data_size(fit, node, &len))
-			return -ENOENT;
+		if (fit_image_get_data_size(fit, node, &len)) {
+			ret = -ENOENT;
+			goto out;
+		}
 
 		/* Dont bother to copy 0 byte data, but warn, though */
 		if (!len) {
 			log_warning("%s: Skip load '%s': image size is 0!\n",
 				    __func__, fit_get_name(fit, node, NULL));
-			return 0;
+			ret = 0;
+			goto out;
 		}
 
 		if (spl_decompression_enabled() &&
@@ -305,8 +459,31 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		log_debug("reading from offset %x / %lx size %lx to %p: ",
 			  offset, read_offset, size, src_ptr);
 
-		if (info->read(info, read_offset, size, src_ptr) < length)
-			return -EIO;
+		if (CONFIG_IS_ENABLED(LOAD_FIT_STREAM)) {
+			void *dst = NULL;
+
+			/*
+			 * Nothing may be decompressed before the image has been
+			 * verified, and post-processing may change the data, so
+			 * in those cases it is only decompressed once it has
+			 * all been read
+			 */
+			if (IS_ENABLED(CONFIG_SPL_GZIP) &&
+			    image_comp == IH_COMP_GZIP &&
+			    !CONFIG_IS_ENABLED(FIT_SIGNATURE) &&
+			    !CONFIG_IS_ENABLED(FIT_IMAGE_POST_PROCESS))
+				dst = map_sysmem(load_addr, 0);
+
+			ret = spl_fit_stream_read(info, fit, node, read_offset,
+						  src_ptr, overhead, length,
+						  dst, &stream);
+			if (ret)
+				goto out;
+		} else if (info->read(info, read_offset, size, src_ptr) <
+			   length) {
+			ret = -EIO;
+			goto out;
+		}
 
 		debug("External data: dst=%p, offset=%x, size=%lx\n",
 		      src_ptr, offset, (unsigned long)length);
@@ -315,7 +492,8 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		/* Embedded data */
 		if (fit_image_get_emb_data(fit, node, &data, &length)) {
 			puts("Cannot get image data/size\n");
-			return -ENOENT;
+			ret = -ENOENT;
+			goto out;
 		}
 		debug("Embedded data: dst=%lx, size=%lx\n", load_addr,
 		      (unsigned long)length);
@@ -325,9 +503,12 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
-		if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(), src,
-						length))
-			return -EPERM;
+		if (!fit_image_verify_with_digests(fit, node, gd_fdt_blob(),
+						   src, length, stream.digest,
+						   stream.digest_count)) {
+			ret = -EPERM;
+			goto out;
+		}
 		puts("OK\n");
 	}
 
@@ -335,11 +516,14 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		board_fit_image_post_process(fit, node, &src, &length);
 
 	load_ptr = map_sysmem(load_addr, length);
-	if (IS_ENABLED(CONFIG_SPL_GZIP) && image_comp == IH_COMP_GZIP) {
+	if (stream.decompressed) {
+		length = stream.length;
+	} else if (IS_ENABLED(CONFIG_SPL_GZIP) && image_comp == IH_COMP_GZIP) {
 		size = length;
 		if (gunzip(load_ptr, CONFIG_SYS_BOOTM_LEN, src, &size)) {
 			puts("Uncompressing error\n");
-			return -EIO;
+			ret = -EIO;
+			goto out;
 		}
 		length = size;
 	} else if (IS_ENABLED(CONFIG_SPL_LZMA) && image_comp == IH_COMP_LZMA) {
@@ -349,12 +533,14 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 		if (image_decomp(IH_COMP_LZMA, CONFIG_SYS_LOAD_ADDR, 0, 0,
 				 load_ptr, src, length, size, &loadEnd)) {
 			puts("Uncompressing error\n");
-			return -EIO;
+			ret = -EIO;
+			goto out;
 		}
 		length = loadEnd - CONFIG_SYS_LOAD_ADDR;
 	} else {
 		memmove(load_ptr, src, length);
 	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_LOAD);
 
 	if (image_info) {
 		ulong entry_point;
@@ -372,6 +558,11 @@ static int load_simple_fit(struct spl_load_info *info, ulong fit_offset,
 	upl_add_image(fit, node, load_addr, length);
 
 	return 0;
+
+out:
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SPL_FIT_LOAD);
+
+	return ret;
 }
 
 static bool os_takes_devicetree(uint8_t os)
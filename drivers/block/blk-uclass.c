@@ -10,6 +10,7 @@
 #include <dm.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -429,19 +430,13 @@ static int blk_buffer_aligned(struct bounce_buffer *state)
 	return 1;	/* Default, any buffer is OK */
 }
 
-long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+static long blk_read_dev(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+			 void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 	ulong blks_read;
 
-	if (!ops->read)
-		return -ENOSYS;
-
-	if (blkcache_read(desc->uclass_id, desc->devnum,
-			  start, blkcnt, desc->blksz, buf))
-		return blkcnt;
-
 	if (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb) {
 		struct blk_bounce_buffer bbstate = { .dev = dev };
 		int ret;
@@ -460,6 +455,67 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 		blks_read = ops->read(dev, start, blkcnt, buf);
 	}
 
+	return blks_read;
+}
+
+/**
+ * blk_read_ahead() - Read more blocks than requested, to fill the cache
+ *
+ * @dev: Block device to read from
+ * @start: Start block for the read
+ * @blkcnt: Number of blocks requested
+ * @buf: Place to put the requested blocks
+ * Return: true if the requested blocks were read, false if the caller should
+ * read them itself
+ */
+static bool blk_read_ahead(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	lbaint_t count;
+	void *ra_buf;
+	bool ok;
+
+	count = blkcache_readahead(desc->uclass_id, desc->devnum, start, blkcnt);
+	/* don't read past the end of the device */
+	if (desc->lba && start + count > desc->lba)
+		count = start + blkcnt < desc->lba ? desc->lba - start : blkcnt;
+	if (count == blkcnt)
+		return false;
+
+	ra_buf = malloc_cache_aligned(count * desc->blksz);
+	if (!ra_buf)
+		return false;
+
+	ok = blk_read_dev(dev, start, count, ra_buf) == count;
+	if (ok) {
+		blkcache_fill(desc->uclass_id, desc->devnum, start, count,
+			      desc->blksz, ra_buf);
+		memcpy(buf, ra_buf, blkcnt * desc->blksz);
+	}
+	free(ra_buf);
+
+	return ok;
+}
+
+long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	ulong blks_read;
+
+	if (!ops->read)
+		return -ENOSYS;
+
+	if (blkcache_read(desc->uclass_id, desc->devnum,
+			  start, blkcnt, desc->blksz, buf))
+		return blkcnt;
+
+	if (CONFIG_IS_ENABLED(BLOCK_CACHE) &&
+	    blk_read_ahead(dev, start, blkcnt, buf))
+		return blkcnt;
+
+	blks_read = blk_read_dev(dev, start, blkcnt, buf);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
 			      desc->blksz, buf);
@@ -531,6 +587,99 @@ ulong blk_derase(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt)
 	return blk_erase(desc->bdev, start, blkcnt);
 }
 
+/* Record the result of a request and tell the caller that it has finished */
+static void blk_req_finish(struct blk_request *req, long result)
+{
+	req->result = result;
+	req->done = true;
+	if (req->complete)
+		req->complete(req);
+}
+
+void blk_req_complete(struct blk_request *req, long result)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(req->dev);
+
+	if (req->op == BLK_REQ_READ && result == req->blkcnt)
+		blkcache_fill(desc->uclass_id, desc->devnum, req->start,
+			      req->blkcnt, desc->blksz, req->buffer);
+	blk_req_finish(req, result);
+}
+
+int blk_submit(struct blk_request *req)
+{
+	struct udevice *dev = req->dev;
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	long ret;
+
+	req->done = false;
+	req->result = 0;
+
+	if (req->op == BLK_REQ_WRITE) {
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+	} else if (blkcache_read(desc->uclass_id, desc->devnum, req->start,
+				 req->blkcnt, desc->blksz, req->buffer)) {
+		blk_req_finish(req, req->blkcnt);
+		return 0;
+	}
+
+	/* the bounce buffer would have to be kept until the request finishes */
+	if (!ops->submit || (IS_ENABLED(CONFIG_BOUNCE_BUFFER) && desc->bb)) {
+		if (req->op == BLK_REQ_WRITE)
+			ret = blk_write(dev, req->start, req->blkcnt,
+					req->buffer);
+		else
+			ret = blk_read(dev, req->start, req->blkcnt,
+				       req->buffer);
+		blk_req_finish(req, ret);
+		return 0;
+	}
+
+	while ((ret = ops->submit(dev, req)) == -EBUSY) {
+		ret = ops->poll(dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return ret;
+}
+
+int blk_poll(struct udevice *dev)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (!ops->poll)
+		return 0;
+
+	return ops->poll(dev);
+}
+
+long blk_wait(struct blk_request *req)
+{
+	int ret;
+
+	while (!req->done) {
+		ret = blk_poll(req->dev);
+		if (ret < 0)
+			return ret;
+	}
+
+	return req->result;
+}
+
+int blk_dread_async(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		    void *buffer, struct blk_request *req)
+{
+	req->dev = desc->bdev;
+	req->op = BLK_REQ_READ;
+	req->start = start;
+	req->blkcnt = blkcnt;
+	req->buffer = buffer;
+
+	return blk_submit(req);
+}
+
 int blk_find_from_parent(struct udevice *parent, struct udevice **devp)
 {
 	struct udevice *dev;
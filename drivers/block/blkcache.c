@@ -5,6 +5,7 @@
  *
  */
 #include <blk.h>
+#include <errno.h>
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
@@ -12,149 +13,320 @@
 #include <linux/ctype.h>
 #include <linux/list.h>
 
+/* Number of hash buckets for each device, must be a power of two */
+#define BLKCACHE_HASH_BITS	8
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+
+/**
+ * struct block_cache_node - A single cached block
+ *
+ * @hash: Node in the hash bucket of the device
+ * @lru: Node in the LRU list of the device, most recently used first
+ * @lba: Block number
+ * @data: Block contents, of the block size of the device
+ */
 struct block_cache_node {
-	struct list_head lh;
+	struct hlist_node hash;
+	struct list_head lru;
+	lbaint_t lba;
+	char data[];
+};
+
+/**
+ * struct block_cache_dev - Cached blocks of one block device
+ *
+ * Each device has its own hash table and LRU list, so that a lookup or an
+ * invalidation only deals with the blocks of that device.
+ *
+ * @sibling: Node in the list of devices
+ * @iftype: uclass ID of the device
+ * @devnum: Device number
+ * @blksz: Block size in bytes
+ * @blocks: Number of blocks in the cache
+ * @next: Block after the last read, to spot sequential access
+ * @sequential: true if the last read followed on from the one before
+ * @hits: Number of reads from the cache
+ * @misses: Number of reads which went to the device
+ * @lru: Cached blocks, most recently used first
+ * @hash: Cached blocks, by block number
+ */
+struct block_cache_dev {
+	struct list_head sibling;
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	unsigned int blocks;
+	lbaint_t next;
+	bool sequential;
+	unsigned int hits;
+	unsigned int misses;
+	struct list_head lru;
+	struct hlist_head hash[BLKCACHE_HASH_SIZE];
 };
 
 static LIST_HEAD(block_cache);
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = 32,
+	.max_size = CONFIG_BLOCK_CACHE_SIZE,
 };
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static unsigned int cache_hash(lbaint_t lba)
+{
+	return ((u32)lba * 0x9e3779b9) >> (32 - BLKCACHE_HASH_BITS);
+}
+
+static size_t cache_node_size(struct block_cache_dev *cdev)
+{
+	return sizeof(struct block_cache_node) + cdev->blksz;
+}
+
+static struct block_cache_dev *cache_find_dev(int iftype, int devnum)
+{
+	struct block_cache_dev *cdev;
+
+	list_for_each_entry(cdev, &block_cache, sibling) {
+		if (cdev->iftype == iftype && cdev->devnum == devnum)
+			return cdev;
+	}
+
+	return NULL;
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *cdev,
+					   lbaint_t lba)
 {
 	struct block_cache_node *node;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+	hlist_for_each_entry(node, &cdev->hash[cache_hash(lba)], hash) {
+		if (node->lba == lba)
 			return node;
+	}
+
+	return NULL;
+}
+
+static void cache_drop(struct block_cache_dev *cdev,
+		       struct block_cache_node *node)
+{
+	hlist_del(&node->hash);
+	list_del(&node->lru);
+	cdev->blocks--;
+	_stats.entries--;
+	_stats.size -= cache_node_size(cdev);
+	free(node);
+}
+
+static void cache_drop_dev(struct block_cache_dev *cdev)
+{
+	struct block_cache_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &cdev->lru, lru)
+		cache_drop(cdev, node);
+	list_del(&cdev->sibling);
+	free(cdev);
+}
+
+/**
+ * cache_evict() - Drop the least recently used block of the largest device
+ *
+ * Taking the block from the device which uses the most memory stops a long
+ * read from one device pushing all the blocks of the others out of the cache.
+ *
+ * Return: true if a block was dropped, false if the cache is empty
+ */
+static bool cache_evict(void)
+{
+	struct block_cache_dev *cdev, *largest = NULL;
+	size_t size, largest_size = 0;
+
+	list_for_each_entry(cdev, &block_cache, sibling) {
+		size = cdev->blocks * cache_node_size(cdev);
+		if (size > largest_size) {
+			largest = cdev;
+			largest_size = size;
 		}
-	return 0;
+	}
+	if (!largest)
+		return false;
+
+	debug("drop: dev %d:%d, block " LBAF "\n", largest->iftype,
+	      largest->devnum,
+	      list_last_entry(&largest->lru, struct block_cache_node, lru)->lba);
+	cache_drop(largest, list_last_entry(&largest->lru,
+					    struct block_cache_node, lru));
+	_stats.evictions++;
+
+	return true;
+}
+
+static struct block_cache_dev *cache_get_dev(int iftype, int devnum,
+					     unsigned long blksz)
+{
+	struct block_cache_dev *cdev;
+	int i;
+
+	cdev = cache_find_dev(iftype, devnum);
+	if (cdev) {
+		if (cdev->blksz == blksz)
+			return cdev;
+		/* the device was reinitialised with another block size */
+		cache_drop_dev(cdev);
+	}
+
+	cdev = calloc(1, sizeof(*cdev));
+	if (!cdev)
+		return NULL;
+	cdev->iftype = iftype;
+	cdev->devnum = devnum;
+	cdev->blksz = blksz;
+	INIT_LIST_HEAD(&cdev->lru);
+	for (i = 0; i < BLKCACHE_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&cdev->hash[i]);
+	list_add(&cdev->sibling, &block_cache);
+
+	return cdev;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
+	struct block_cache_node *node;
+	struct block_cache_dev *cdev;
+	lbaint_t i;
+
+	/* big reads are never cached, so don't track them */
+	if (blkcnt > _stats.max_blocks_per_entry || !_stats.max_size)
+		return 0;
+
+	cdev = cache_get_dev(iftype, devnum, blksz);
+	if (!cdev)
+		return 0;
+	cdev->sequential = start == cdev->next;
+	cdev->next = start + blkcnt;
+
+	for (i = 0; i < blkcnt; i++) {
+		if (!cache_find(cdev, start + i))
+			break;
+	}
+	if (i < blkcnt) {
+		debug("miss: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+		++cdev->misses;
+		++_stats.misses;
+		return 0;
 	}
 
-	debug("miss: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-	++_stats.misses;
-	return 0;
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(cdev, start + i);
+		memcpy(buffer + i * blksz, node->data, blksz);
+		/* maintain MRU ordering */
+		list_move(&node->lru, &cdev->lru);
+	}
+	debug("hit: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+	++cdev->hits;
+	++_stats.hits;
+
+	return 1;
+}
+
+lbaint_t blkcache_readahead(int iftype, int devnum, lbaint_t start,
+			    lbaint_t blkcnt)
+{
+	struct block_cache_dev *cdev;
+	lbaint_t count;
+
+	count = min_t(lbaint_t, CONFIG_BLOCK_CACHE_READAHEAD,
+		      _stats.max_blocks_per_entry);
+	if (blkcnt >= count)
+		return blkcnt;
+
+	cdev = cache_find_dev(iftype, devnum);
+	if (!cdev || !cdev->sequential || start + blkcnt != cdev->next)
+		return blkcnt;
+
+	/* read ahead at most a quarter of the cache, so it cannot thrash */
+	count = min_t(lbaint_t, count,
+		      _stats.max_size / cache_node_size(cdev) / 4);
+
+	return max(count, blkcnt);
 }
 
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
 	struct block_cache_node *node;
+	struct block_cache_dev *cdev;
+	lbaint_t i;
 
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (blkcnt > _stats.max_blocks_per_entry || !_stats.max_size)
 		return;
 
-	if (_stats.max_entries == 0)
+	cdev = cache_get_dev(iftype, devnum, blksz);
+	if (!cdev)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
-
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	for (i = 0; i < blkcnt; i++) {
+		node = cache_find(cdev, start + i);
+		if (node) {
+			list_move(&node->lru, &cdev->lru);
+		} else {
+			while (_stats.size + cache_node_size(cdev) >
+			       _stats.max_size) {
+				if (!cache_evict())
+					return;
+			}
+			node = malloc(cache_node_size(cdev));
+			if (!node)
+				return;
+			node->lba = start + i;
+			hlist_add_head(&node->hash,
+				       &cdev->hash[cache_hash(node->lba)]);
+			list_add(&node->lru, &cdev->lru);
+			cdev->blocks++;
+			_stats.entries++;
+			_stats.size += cache_node_size(cdev);
+		}
+		memcpy(node->data, buffer + i * blksz, blksz);
+	}
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev *cdev, *tmp;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	list_for_each_entry_safe(cdev, tmp, &block_cache, sibling) {
 		if (iftype == -1 ||
-		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
+		    (cdev->iftype == iftype && cdev->devnum == devnum))
+			cache_drop_dev(cdev);
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+int blkcache_configure(unsigned blocks, unsigned long size)
 {
+	/* there must be room for a read of the largest size which is cached */
+	if (size < blocks * (sizeof(struct block_cache_node) + 512))
+		return -EINVAL;
+
 	/* invalidate cache if there is a change */
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
+	    (size != _stats.max_size))
 		blkcache_invalidate(-1, 0);
 
 	_stats.max_blocks_per_entry = blocks;
-	_stats.max_entries = entries;
+	_stats.max_size = size;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+
+	return 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -162,6 +334,29 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.evictions = 0;
+}
+
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats)
+{
+	struct block_cache_dev *cdev;
+
+	list_for_each_entry(cdev, &block_cache, sibling) {
+		if (index--)
+			continue;
+		stats->iftype = cdev->iftype;
+		stats->devnum = cdev->devnum;
+		stats->blocks = cdev->blocks;
+		stats->size = cdev->blocks * cache_node_size(cdev);
+		stats->hits = cdev->hits;
+		stats->misses = cdev->misses;
+		cdev->hits = 0;
+		cdev->misses = 0;
+
+		return 0;
+	}
+
+	return -ENOENT;
 }
 
 void blkcache_free(void)
@@ -24,11 +24,13 @@ static unsigned long host_block_read(struct udevice *dev,
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	struct udevice *host_dev = dev_get_parent(dev);
 	struct host_sb_plat *plat = dev_get_plat(host_dev);
+	struct host_blk_priv *priv = dev_get_priv(dev);
 
 	if (os_lseek(plat->fd, start * desc->blksz, OS_SEEK_SET) < 0) {
 		printf("ERROR: Invalid block " LBAF "\n", start);
 		return -1;
 	}
+	priv->reads++;
 	ssize_t len = os_read(plat->fd, buffer, blkcnt * desc->blksz);
 	if (len >= 0)
 		return len / desc->blksz;
@@ -55,13 +57,70 @@ static unsigned long host_block_write(struct udevice *dev,
 	return -EIO;
 }
 
+static int host_block_submit(struct udevice *dev, struct blk_request *req)
+{
+	struct host_blk_priv *priv = dev_get_priv(dev);
+
+	if (priv->queued == HOST_BLK_QUEUE_DEPTH)
+		return -EBUSY;
+
+	list_add_tail(&req->sibling, &priv->queue);
+	priv->queued++;
+
+	return 0;
+}
+
+static int host_block_poll(struct udevice *dev)
+{
+	struct host_blk_priv *priv = dev_get_priv(dev);
+	struct blk_request *req, *next;
+	LIST_HEAD(done);
+	long ret;
+	int count = 0;
+
+	if (!priv->queued)
+		return 0;
+
+	/* requests submitted by the completion functions wait for next time */
+	list_splice_init(&priv->queue, &done);
+	priv->queued = 0;
+	priv->polls++;
+
+	list_for_each_entry_safe(req, next, &done, sibling) {
+		list_del(&req->sibling);
+		if (req->op == BLK_REQ_WRITE)
+			ret = host_block_write(dev, req->start, req->blkcnt,
+					       req->buffer);
+		else
+			ret = host_block_read(dev, req->start, req->blkcnt,
+					      req->buffer);
+		blk_req_complete(req, ret);
+		count++;
+	}
+
+	return count;
+}
+
+static int host_block_probe(struct udevice *dev)
+{
+	struct host_blk_priv *priv = dev_get_priv(dev);
+
+	INIT_LIST_HEAD(&priv->queue);
+
+	return 0;
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
 	.name		= "sandbox_host_blk",
 	.id		= UCLASS_BLK,
 	.ops		= &sandbox_host_blk_ops,
+	.probe		= host_block_probe,
+	.priv_auto	= sizeof(struct host_blk_priv),
 };
@@ -480,6 +480,7 @@ static int device_get_dma_constraints(struct udevice *dev)
 
 int device_probe(struct udevice *dev)
 {
+	struct device_probe_track track = { };
 	const struct driver *drv;
 	int ret;
 
@@ -487,7 +488,7 @@ int device_probe(struct udevice *dev)
 		return -EINVAL;
 
 	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-		return 0;
+		return device_probe_wait(dev);
 
 	ret = device_notify(dev, EVT_DM_PRE_PROBE);
 	if (ret)
@@ -513,9 +514,10 @@ int device_probe(struct udevice *dev)
 		 * so that we don't mess up the device.
 		 */
 		if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-			return 0;
+			return device_probe_wait(dev);
 	}
 
+	device_probe_track_start(&track, dev);
 	dev_or_flags(dev, DM_FLAG_ACTIVATED);
 
 	if (CONFIG_IS_ENABLED(POWER_DOMAIN) && dev->parent &&
@@ -600,6 +602,7 @@ int device_probe(struct udevice *dev)
 	ret = device_notify(dev, EVT_DM_POST_PROBE);
 	if (ret)
 		goto fail_event;
+	device_probe_track_end(&track);
 
 	return 0;
 fail_event:
@@ -610,6 +613,7 @@ fail_uclass:
 	}
 fail:
 	dev_bic_flags(dev, DM_FLAG_ACTIVATED);
+	device_probe_track_end(&track);
 
 	device_free(dev);
 
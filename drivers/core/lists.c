@@ -18,8 +18,13 @@
 #include <dm/uclass.h>
 #include <dm/util.h>
 #include <fdtdec.h>
+#include <malloc.h>
+#include <sort.h>
+#include <asm/global_data.h>
 #include <linux/compiler.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 struct driver *lists_driver_lookup_name(const char *name)
 {
 	struct driver *drv =
@@ -196,14 +201,214 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
+/**
+ * struct driver_compat - A compatible string of a driver
+ *
+ * @hash: Hash of the compatible string
+ * @drv: Index of the driver in the driver linker list
+ * @id: Index of the string in the of_match table of the driver
+ */
+struct driver_compat {
+	u32 hash;
+	u16 drv;
+	u16 id;
+};
+
+/**
+ * struct driver_compat_index - Compatible strings of all drivers
+ *
+ * The entries are sorted by hash and then by driver, so the drivers which
+ * match a string are found in the same order as in the driver linker list.
+ *
+ * @count: Number of entries
+ * @ent: Entries
+ */
+struct driver_compat_index {
+	int count;
+	struct driver_compat ent[];
+};
+
+static u32 driver_compat_hash(const char *compat)
+{
+	u32 hash = 2166136261U;
+
+	/* FNV-1a */
+	while (*compat) {
+		hash ^= (u8)*compat++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static int driver_compat_cmp(const void *a, const void *b)
+{
+	const struct driver_compat *ca = a, *cb = b;
+
+	if (ca->hash != cb->hash)
+		return ca->hash < cb->hash ? -1 : 1;
+	if (ca->drv != cb->drv)
+		return ca->drv - cb->drv;
+
+	return ca->id - cb->id;
+}
+
+/**
+ * lists_compat_index() - Get the index of driver compatible strings
+ *
+ * This builds the index the first time it is needed.
+ *
+ * Return: index, or NULL if it is not available (so every driver must be
+ * checked)
+ */
+static struct driver_compat_index *lists_compat_index(void)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver_compat_index *index;
+	const struct udevice_id *of_match;
+	struct driver_compat *ent;
+	int count = 0, i;
+
+	if (!CONFIG_IS_ENABLED(DM_COMPAT_INDEX))
+		return NULL;
+	if (gd_dm_compat_index())
+		return gd_dm_compat_index();
+
+	/* drivers move on relocation, so don't waste the pre-relocation heap */
+	if (!IS_ENABLED(CONFIG_XPL_BUILD) && !(gd->flags & GD_FLG_RELOC))
+		return NULL;
+
+	for (i = 0; i < n_ents; i++) {
+		for (of_match = driver[i].of_match; of_match &&
+		     of_match->compatible; of_match++)
+			count++;
+	}
+
+	index = malloc(sizeof(*index) + count * sizeof(*ent));
+	if (!index)
+		return NULL;
+
+	index->count = count;
+	ent = index->ent;
+	for (i = 0; i < n_ents; i++) {
+		for (of_match = driver[i].of_match; of_match &&
+		     of_match->compatible; of_match++) {
+			ent->hash = driver_compat_hash(of_match->compatible);
+			ent->drv = i;
+			ent->id = of_match - driver[i].of_match;
+			ent++;
+		}
+	}
+	qsort(index->ent, count, sizeof(*ent), driver_compat_cmp);
+	log_debug("Indexed %d compatible strings\n", count);
+	gd_set_dm_compat_index(index);
+
+	return index;
+}
+
+/**
+ * lists_bind_entry() - Bind a driver to a device-tree node
+ *
+ * @parent: Parent device
+ * @node: Node to bind
+ * @entry: Driver to bind
+ * @id: Compatible string which matched, or NULL if none
+ * @drv: Driver requested by the caller, or NULL if any
+ * @pre_reloc_only: Only bind drivers which are needed before relocation
+ * @devp: If non-NULL, returns the new device, or NULL if nothing was bound
+ * Return: 0 if OK (including if the node was skipped before relocation),
+ *	-ENODEV if @drv is NULL and the driver refused to bind, so the next one
+ *	should be tried, other -ve on error
+ */
+static int lists_bind_entry(struct udevice *parent, ofnode node,
+			    struct driver *entry, const struct udevice_id *id,
+			    struct driver *drv, bool pre_reloc_only,
+			    struct udevice **devp)
+{
+	struct udevice *dev;
+	int ret;
+
+	if (pre_reloc_only) {
+		if (!ofnode_pre_reloc(node) &&
+		    !(entry->flags & DM_FLAG_PRE_RELOC)) {
+			log_debug("Skipping device pre-relocation\n");
+			return 0;
+		}
+	}
+
+	ret = device_bind_with_driver_data(parent, entry, ofnode_get_name(node),
+					   id ? id->data : 0, node, &dev);
+	if (!drv && ret == -ENODEV) {
+		log_debug("   - Driver '%s' refuses to bind\n", entry->name);
+		return -ENODEV;
+	}
+	if (ret) {
+		dm_warn("Error binding driver '%s': %d\n", entry->name, ret);
+		return log_msg_ret("bind", ret);
+	}
+
+	if (devp)
+		*devp = dev;
+
+	return 0;
+}
+
+/**
+ * lists_bind_compat() - Bind the first driver for a compatible string
+ *
+ * @index: Index of driver compatible strings
+ * @compat: Compatible string to look up
+ * Other parameters are as for lists_bind_entry()
+ * Return: 0 if OK, -ENOENT if no driver matches, -ENODEV if they all refused
+ *	to bind, other -ve on error
+ */
+static int lists_bind_compat(struct driver_compat_index *index,
+			     const char *compat, struct udevice *parent,
+			     ofnode node, bool pre_reloc_only,
+			     struct udevice **devp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const struct udevice_id *id;
+	struct driver_compat *ent;
+	int lo = 0, hi = index->count, mid, last = -1, ret = -ENOENT;
+	u32 hash = driver_compat_hash(compat);
+
+	/* find the first entry with this hash */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (index->ent[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (ent = &index->ent[lo];
+	     ent != index->ent + index->count && ent->hash == hash; ent++) {
+		id = &driver[ent->drv].of_match[ent->id];
+		if (ent->drv == last || strcmp(id->compatible, compat))
+			continue;
+		last = ent->drv;
+		log_debug("   - found match at driver '%s' for '%s'\n",
+			  driver[ent->drv].name, id->compatible);
+
+		ret = lists_bind_entry(parent, node, &driver[ent->drv], id,
+				       NULL, pre_reloc_only, devp);
+		if (ret != -ENODEV)
+			return ret;
+	}
+
+	return ret;
+}
+
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver_compat_index *index;
 	const struct udevice_id *id;
 	struct driver *entry;
-	struct udevice *dev;
 	const char *name, *compat_list, *compat;
 	int compat_length, i;
 	int ret = 0;
@@ -225,6 +430,8 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		return compat_length;
 	}
 
+	index = drv ? NULL : lists_compat_index();
+
 	/*
 	 * Walk through the compatible string list, attempting to match each
 	 * compatible string in order such that we match in order of priority
@@ -235,6 +442,14 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		log_debug("   - attempt to match compatible string '%s'\n",
 			  compat);
 
+		if (index) {
+			ret = lists_bind_compat(index, compat, parent, node,
+						pre_reloc_only, devp);
+			if (ret != -ENOENT && ret != -ENODEV)
+				return ret;
+			continue;
+		}
+
 		for (entry = driver; entry != driver + n_ents; entry++) {
 			/* Search for drivers with matching drv or existing of_match */
 			if (drv) {
@@ -254,31 +469,13 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 					  entry->name, id->compatible);
 			}
 
-			if (pre_reloc_only) {
-				if (!ofnode_pre_reloc(node) &&
-				    !(entry->flags & DM_FLAG_PRE_RELOC)) {
-					log_debug("Skipping device pre-relocation\n");
-					return 0;
-				}
-			}
-
-			ret = device_bind_with_driver_data(parent, entry, name,
-							   id ? id->data : 0, node,
-							   &dev);
-			if (!drv && ret == -ENODEV) {
-				log_debug("   - Driver '%s' refuses to bind\n", entry->name);
+			ret = lists_bind_entry(parent, node, entry, id, drv,
+					       pre_reloc_only, devp);
+			/* only a driver found by compatible string can refuse */
+			if (!drv && ret == -ENODEV)
 				continue;
-			}
-			if (ret) {
-				dm_warn("Error binding driver '%s': %d\n", entry->name,
-					ret);
-				return log_msg_ret("bind", ret);
-			}
 
-			if (devp)
-				*devp = dev;
-
-			return 0;
+			return ret;
 		}
 	}
 
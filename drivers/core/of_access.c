@@ -29,6 +29,7 @@
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
+#include <linux/log2.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -67,6 +68,124 @@ struct alias_prop {
 	char stem[0];
 };
 
+/**
+ * struct of_index - Hashed lookup of the nodes in the control tree
+ *
+ * Finding a node by phandle or by path otherwise walks the tree, which adds
+ * up on SoCs with thousands of nodes. The tables are built once when the live
+ * tree is created and use open addressing, with at least half of the slots
+ * empty. Nodes added later are not in the index, so a miss falls back to
+ * walking the tree.
+ *
+ * @root:	Root node of the indexed tree, or NULL if there is no index
+ * @mask:	Number of slots in each table, minus one
+ * @phandle:	Nodes which have a phandle, hashed by phandle
+ * @path:	All nodes, hashed by their full path
+ */
+static struct of_index {
+	struct device_node *root;
+	uint mask;
+	struct device_node **phandle;
+	struct device_node **path;
+} of_index;
+
+static uint of_index_hash_path(const char *path, int len)
+{
+	uint hash = 2166136261U;
+
+	/* FNV-1a */
+	while (len--) {
+		hash ^= (u8)*path++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void of_index_insert(struct device_node **table, uint hash,
+			    struct device_node *np)
+{
+	while (table[hash & of_index.mask])
+		hash++;
+	table[hash & of_index.mask] = np;
+}
+
+void of_index_drop(struct device_node *root)
+{
+	if (root && root != of_index.root)
+		return;
+	free(of_index.phandle);
+	free(of_index.path);
+	memset(&of_index, '\0', sizeof(of_index));
+}
+
+int of_index_build(struct device_node *root)
+{
+	struct device_node *np;
+	uint count = 0;
+
+	of_index_drop(NULL);
+	for (np = root; np; np = of_find_all_nodes(np))
+		count++;
+
+	of_index.mask = roundup_pow_of_two(count * 2) - 1;
+	of_index.phandle = calloc(of_index.mask + 1, sizeof(np));
+	of_index.path = calloc(of_index.mask + 1, sizeof(np));
+	if (!of_index.phandle || !of_index.path) {
+		of_index_drop(NULL);
+		return -ENOMEM;
+	}
+
+	for (np = root; np; np = of_find_all_nodes(np)) {
+		if (np->phandle)
+			of_index_insert(of_index.phandle, np->phandle, np);
+		of_index_insert(of_index.path,
+				of_index_hash_path(np->full_name,
+						   strlen(np->full_name)), np);
+	}
+	of_index.root = root;
+	log_debug("Indexed %u nodes\n", count);
+
+	return 0;
+}
+
+static struct device_node *of_index_find_phandle(struct device_node *root,
+						 phandle handle)
+{
+	struct device_node *np;
+	uint hash;
+
+	if (!of_index.root || root != of_index.root)
+		return NULL;
+
+	for (hash = handle; (np = of_index.phandle[hash & of_index.mask]);
+	     hash++) {
+		if (np->phandle == handle)
+			return np;
+	}
+
+	return NULL;
+}
+
+static struct device_node *of_index_find_path(struct device_node *root,
+					      const char *path, int len)
+{
+	struct device_node *np;
+	uint hash;
+
+	if (!of_index.root || root != of_index.root)
+		return NULL;
+
+	for (hash = of_index_hash_path(path, len);
+	     (np = of_index.path[hash & of_index.mask]); hash++) {
+		if (!strncmp(np->full_name, path, len) &&
+		    !np->full_name[len])
+			return np;
+	}
+
+	return NULL;
+}
+
 int of_n_addr_cells(const struct device_node *np)
 {
 	const __be32 *ip;
@@ -387,6 +506,15 @@ struct device_node *of_find_node_opts_by_path(struct device_node *root,
 		path = p;
 	}
 
+	/* Try the index before stepping down the tree */
+	if (!np) {
+		np = of_index_find_path(root, path,
+					separator ? separator - path :
+					strlen(path));
+		if (np)
+			return of_node_get(np);
+	}
+
 	/* Step down the tree matching path components */
 	if (!np)
 		np = of_node_get(root);
@@ -453,6 +581,10 @@ struct device_node *of_find_node_by_phandle(struct device_node *root,
 	if (!handle)
 		return NULL;
 
+	np = of_index_find_phandle(root ? root : gd->of_root, handle);
+	if (np)
+		return of_node_get(np);
+
 	for_each_of_allnodes_from(root, np)
 		if (np->phandle == handle)
 			break;
@@ -1120,6 +1252,10 @@ int of_remove_node(struct device_node *to_remove)
 	else
 		parent->child = np->sibling;
 
+	/* the index must not find the node, or its children, any more */
+	if (of_index.root)
+		of_index_build(of_index.root);
+
 	/*
 	 * don't free it, since if this is an unflattened tree, all the memory
 	 * was alloced in one block; this pointer will be somewhere in the
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Probing devices in cooperative threads
+ *
+ * Drivers which spend a long time waiting for hardware in their probe()
+ * method (PHY link training, controller reset, card power-up) can set
+ * DM_FLAG_PROBE_ASYNC so that they are probed in a uthread. Their waits then
+ * let other probes, and the rest of board_init_r(), make progress.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <errno.h>
+#include <log.h>
+#include <uthread.h>
+#include <asm/global_data.h>
+#include <dm/device.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
+#include <linux/list.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Probes in progress, so that device_probe() can wait for them */
+static LIST_HEAD(probe_track_list);
+
+/* Thread group for probes started by dm_probe_async_start() */
+static unsigned int probe_grp_id;
+
+void device_probe_track_start(struct device_probe_track *track,
+			      struct udevice *dev)
+{
+	/* Threads are not used before relocation, when BSS is not writable */
+	if (!(gd->flags & GD_FLG_RELOC))
+		return;
+
+	track->dev = dev;
+	track->owner = uthread_self();
+	list_add(&track->sibling, &probe_track_list);
+}
+
+void device_probe_track_end(struct device_probe_track *track)
+{
+	if (!track->dev)
+		return;
+
+	list_del(&track->sibling);
+	track->dev = NULL;
+}
+
+static struct device_probe_track *device_probe_find(struct udevice *dev)
+{
+	struct device_probe_track *track;
+
+	list_for_each_entry(track, &probe_track_list, sibling) {
+		if (track->dev == dev)
+			return track;
+	}
+
+	return NULL;
+}
+
+int device_probe_wait(struct udevice *dev)
+{
+	struct device_probe_track *track;
+
+	while ((track = device_probe_find(dev))) {
+		/* A parent's probe() may use its children, as before */
+		if (track->owner == uthread_self())
+			return 0;
+		if (!uthread_schedule())
+			break;
+	}
+
+	return device_active(dev) ? 0 : -ENODEV;
+}
+
+static void device_probe_thread(void *arg)
+{
+	struct udevice *dev = arg;
+	int ret;
+
+	ret = device_probe(dev);
+	if (ret)
+		log_debug("Async probe of '%s' failed: %d\n", dev->name, ret);
+}
+
+int device_probe_async(struct udevice *dev)
+{
+	if (device_active(dev))
+		return 0;
+
+	if (!probe_grp_id)
+		probe_grp_id = uthread_grp_new_id();
+	if (!uthread_create(NULL, device_probe_thread, dev, 0, probe_grp_id))
+		return 0;
+
+	log_debug("No thread for '%s', probing now\n", dev->name);
+
+	return device_probe(dev);
+}
+
+static void dm_probe_async_devices(struct udevice *dev)
+{
+	struct udevice *child;
+
+	if ((dev->driver->flags | dev_get_flags(dev)) & DM_FLAG_PROBE_ASYNC)
+		device_probe_async(dev);
+
+	list_for_each_entry(child, &dev->child_head, sibling_node)
+		dm_probe_async_devices(child);
+}
+
+int dm_probe_async_start(void)
+{
+	if (gd->dm_root)
+		dm_probe_async_devices(gd->dm_root);
+
+	return 0;
+}
+
+int dm_probe_async_wait(void)
+{
+	if (!probe_grp_id)
+		return 0;
+
+	while (!uthread_grp_done(probe_grp_id))
+		uthread_schedule();
+	probe_grp_id = 0;
+
+	return 0;
+}
@@ -14,6 +14,7 @@
 #include <fat.h>
 #include <dfu.h>
 #include <hash.h>
+#include <uthread.h>
 #include <linux/list.h>
 #include <linux/compiler.h>
 #include <linux/printk.h>
@@ -199,8 +200,58 @@ static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 static enum dfu_device_type dfu_buf_device_type;
 
+/* Buffer filled while dfu_buf is written, and the other way round */
+static unsigned char *dfu_buf2;
+
+/**
+ * struct dfu_write_job - A buffer being written to the medium in a thread
+ *
+ * @dfu: Entity written to, NULL when no write is in progress
+ * @buf: Data to write
+ * @size: Number of bytes to write
+ * @ret: Result of the last write which failed, 0 if none did
+ */
+static struct dfu_write_job {
+	struct dfu_entity *dfu;
+	u8 *buf;
+	long size;
+	int ret;
+} dfu_write_job;
+
+static void dfu_write_thread(void *arg)
+{
+	struct dfu_write_job *job = arg;
+	struct dfu_entity *dfu = job->dfu;
+	long w_size = job->size;
+	int ret;
+
+	ret = dfu->write_medium(dfu, dfu->offset, job->buf, &w_size);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		job->ret = ret;
+	}
+	dfu->offset += w_size;
+	job->dfu = NULL;
+}
+
+/* Wait for the buffer being written, returning the result of the write */
+static int dfu_write_wait(void)
+{
+	int ret;
+
+	while (dfu_write_job.dfu)
+		uthread_schedule();
+	ret = dfu_write_job.ret;
+	dfu_write_job.ret = 0;
+
+	return ret;
+}
+
 unsigned char *dfu_free_buf(void)
 {
+	dfu_write_wait();
+	free(dfu_buf2);
+	dfu_buf2 = NULL;
 	free(dfu_buf);
 	dfu_buf = NULL;
 	return dfu_buf;
@@ -237,6 +288,10 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 		printf("%s: Could not memalign 0x%lx bytes\n",
 		       __func__, dfu_buf_size);
 
+	/* without it, each buffer is written before more is received */
+	if (CONFIG_IS_ENABLED(DFU_WRITE_ASYNC) && dfu_buf)
+		dfu_buf2 = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
+
 	dfu_buf_device_type = dfu->dev_type;
 	return dfu_buf;
 }
@@ -258,7 +313,12 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+/*
+ * Write the buffer to the medium. With @async and a second buffer, it is
+ * written in a thread and the other buffer is filled meanwhile; an error is
+ * then returned by the next call, or by dfu_flush().
+ */
+static int dfu_write_buffer_drain(struct dfu_entity *dfu, bool async)
 {
 	long w_size;
 	int ret;
@@ -272,6 +332,26 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
 					   dfu->i_buf_start, w_size, 0);
 
+	ret = dfu_write_wait();
+	if (ret)
+		return ret;
+
+	if (async && dfu_buf2) {
+		dfu_write_job.dfu = dfu;
+		dfu_write_job.buf = dfu->i_buf_start;
+		dfu_write_job.size = w_size;
+		if (uthread_create(NULL, dfu_write_thread, &dfu_write_job, 0, 0))
+			dfu_write_thread(&dfu_write_job);
+
+		dfu->i_buf_start = dfu->i_buf_start == dfu_buf ? dfu_buf2 :
+								 dfu_buf;
+		dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size;
+		dfu->i_buf = dfu->i_buf_start;
+		puts("#");
+
+		return 0;
+	}
+
 	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
 	if (ret)
 		debug("%s: Write error!\n", __func__);
@@ -289,6 +369,9 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 
 void dfu_transaction_cleanup(struct dfu_entity *dfu)
 {
+	/* the buffers and the offset must not be in use */
+	dfu_write_wait();
+
 	/* clear everything */
 	dfu->crc = 0;
 	dfu->offset = 0;
@@ -334,7 +417,9 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
-	ret = dfu_write_buffer_drain(dfu);
+	ret = dfu_write_buffer_drain(dfu, false);
+	if (!ret)
+		ret = dfu_write_wait();
 	if (ret)
 		return ret;
 
@@ -354,6 +439,7 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
+	bool async;
 	int ret;
 
 	debug("%s: name: %s buf: 0x%p size: 0x%x p_num: 0x%x offset: 0x%llx bufoffset: 0x%lx\n",
@@ -388,9 +474,15 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	/* handle rollover */
 	dfu->i_blk_seq_num = (dfu->i_blk_seq_num + 1) & 0xffff;
 
+	/*
+	 * Callers which receive into the DFU buffer itself, like thor, reuse
+	 * it once this returns, so it must have been written by then
+	 */
+	async = (u8 *)buf < dfu_buf || (u8 *)buf >= dfu_buf + dfu_buf_size;
+
 	/* flush buffer if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, async);
 		if (ret) {
 			dfu_transaction_cleanup(dfu);
 			dfu_error_callback(dfu, "DFU write error");
@@ -412,7 +504,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* if end or if buffer full flush */
 	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, async);
 		if (ret) {
 			dfu_transaction_cleanup(dfu);
 			dfu_error_callback(dfu, "DFU write error");
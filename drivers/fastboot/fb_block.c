@@ -10,7 +10,10 @@
 #include <fb_block.h>
 #include <image-sparse.h>
 #include <malloc.h>
+#include <memalign.h>
+#include <mmc.h>
 #include <part.h>
+#include <linux/string.h>
 
 /**
  * FASTBOOT_MAX_BLOCKS_ERASE - maximum blocks to erase per derase call
@@ -28,10 +31,37 @@
  */
 #define FASTBOOT_MAX_BLOCKS_WRITE 65536
 
+/**
+ * struct fb_block_sparse - Device a sparse image is written to
+ *
+ * @dev_desc: Block device
+ * @erase_zeroes: true once erased blocks have been seen to read as zeroes
+ * @erase_failed: true if erasing failed or did not leave zeroes, so that
+ *	zeroes are written instead
+ */
 struct fb_block_sparse {
 	struct blk_desc	*dev_desc;
+	bool erase_zeroes;
+	bool erase_failed;
+};
+
+/**
+ * struct fb_block_stream - An image being flashed while it is downloaded
+ *
+ * @sparse_priv: Device written to
+ * @sparse: Partition written to
+ * @ss: State of the stream
+ * @part_name: Name of the partition, for messages
+ */
+struct fb_block_stream {
+	struct fb_block_sparse sparse_priv;
+	struct sparse_storage sparse;
+	struct sparse_stream ss;
+	char part_name[PART_NAME_LEN];
 };
 
+static struct fb_block_stream fb_stream;
+
 /* Write 0s instead of using erase operation, inefficient but functional */
 static lbaint_t fb_block_soft_erase(struct blk_desc *block_dev, lbaint_t blk,
 				    lbaint_t cur_blkcnt, lbaint_t erase_buf_blks,
@@ -113,12 +143,108 @@ static lbaint_t fb_block_sparse_write(struct sparse_storage *info,
 	return fb_block_write(dev_desc, blk, blkcnt, buffer);
 }
 
+/*
+ * Write a buffer of a streamed image. This runs while the download is still
+ * going on, so it must not send any progress messages to the host.
+ */
+static lbaint_t fb_block_stream_write(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt,
+				      const void *buffer)
+{
+	struct fb_block_sparse *sparse = info->priv;
+	struct blk_desc *dev_desc = sparse->dev_desc;
+	lbaint_t blks = 0;
+	lbaint_t written;
+
+	while (blks < blkcnt) {
+		written = blk_dwrite(dev_desc, blk + blks,
+				     min_t(lbaint_t, blkcnt - blks,
+					   FASTBOOT_MAX_BLOCKS_WRITE),
+				     buffer + blks * dev_desc->blksz);
+		if (!written)
+			break;
+		blks += written;
+	}
+
+	return blks;
+}
+
 static lbaint_t fb_block_sparse_reserve(struct sparse_storage *info,
 					lbaint_t blk, lbaint_t blkcnt)
 {
 	return blkcnt;
 }
 
+/*
+ * Erase blocks which are to read as zeroes. Some devices read erased blocks
+ * as ones, so check the first time, and have zeroes written from then on if
+ * they do.
+ */
+static lbaint_t fb_block_sparse_erase(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_block_sparse *sparse = info->priv;
+	struct blk_desc *dev_desc = sparse->dev_desc;
+	ALLOC_CACHE_ALIGN_BUFFER(u8, buf, dev_desc->blksz);
+
+	if (sparse->erase_failed)
+		return 0;
+
+	if (blk_derase(dev_desc, blk, blkcnt) != blkcnt) {
+		sparse->erase_failed = true;
+		return 0;
+	}
+	if (!sparse->erase_zeroes) {
+		if (blk_dread(dev_desc, blk, 1, buf) != 1 ||
+		    memchr_inv(buf, 0, dev_desc->blksz)) {
+			printf("Erased blocks are not zero, writing zeroes\n");
+			sparse->erase_failed = true;
+			return 0;
+		}
+		sparse->erase_zeroes = true;
+	}
+
+	return blkcnt;
+}
+
+/*
+ * Number of blocks which can be erased without touching those around them.
+ * An eMMC without TRIM only erases whole erase groups.
+ */
+static u32 fb_block_erase_blks(struct blk_desc *dev_desc)
+{
+	struct mmc *mmc;
+
+	if (!IS_ENABLED(CONFIG_MMC) || dev_desc->uclass_id != UCLASS_MMC)
+		return 1;
+
+	mmc = find_mmc_device(dev_desc->devnum);
+	if (!mmc)
+		return 0;
+
+	return mmc->can_trim ? 1 : mmc->erase_grp_size;
+}
+
+static void fb_block_sparse_init(struct sparse_storage *sparse,
+				 struct fb_block_sparse *sparse_priv,
+				 struct blk_desc *dev_desc,
+				 struct disk_partition *info)
+{
+	sparse_priv->dev_desc = dev_desc;
+	sparse_priv->erase_zeroes = false;
+	sparse_priv->erase_failed = false;
+
+	sparse->blksz = info->blksz;
+	sparse->start = info->start;
+	sparse->size = info->size;
+	sparse->write = fb_block_sparse_write;
+	sparse->reserve = fb_block_sparse_reserve;
+	sparse->erase_blks = fb_block_erase_blks(dev_desc);
+	sparse->erase = sparse->erase_blks ? fb_block_sparse_erase : NULL;
+	sparse->mssg = fastboot_fail;
+	sparse->priv = sparse_priv;
+}
+
 int fastboot_block_get_part_info(const char *part_name,
 				 struct blk_desc **dev_desc,
 				 struct disk_partition *part_info,
@@ -284,19 +410,11 @@ void fastboot_block_write_sparse_image(struct blk_desc *dev_desc, struct disk_pa
 	struct sparse_storage sparse;
 	int err;
 
-	sparse_priv.dev_desc = dev_desc;
-
-	sparse.blksz = info->blksz;
-	sparse.start = info->start;
-	sparse.size = info->size;
-	sparse.write = fb_block_sparse_write;
-	sparse.reserve = fb_block_sparse_reserve;
-	sparse.mssg = fastboot_fail;
+	fb_block_sparse_init(&sparse, &sparse_priv, dev_desc, info);
 
 	printf("Flashing sparse image at offset " LBAFU "\n",
 	       sparse.start);
 
-	sparse.priv = &sparse_priv;
 	err = write_sparse_image(&sparse, part_name, buffer,
 				 response);
 	if (!err)
@@ -320,3 +438,42 @@ void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 					       download_buffer, download_bytes, response);
 	}
 }
+
+int fastboot_block_stream_start(struct blk_desc *dev_desc,
+				struct disk_partition *info,
+				const char *part_name, void *buffer,
+				u32 buffer_size, char *response)
+{
+	struct fb_block_stream *stream = &fb_stream;
+	struct sparse_storage *sparse = &stream->sparse;
+
+	strlcpy(stream->part_name, part_name, sizeof(stream->part_name));
+	fb_block_sparse_init(sparse, &stream->sparse_priv, dev_desc, info);
+	sparse->write = fb_block_stream_write;
+
+	if (sparse_stream_start(&stream->ss, sparse, buffer, buffer_size)) {
+		fastboot_fail("download buffer too small", response);
+		return -ENOSPC;
+	}
+	printf("Flashing image at offset " LBAFU " while downloading\n",
+	       sparse->start);
+
+	return 0;
+}
+
+int fastboot_block_stream_write(const void *data, u32 len, char *response)
+{
+	return sparse_stream_write(&fb_stream.ss, data, len, response);
+}
+
+int fastboot_block_stream_finish(char *response)
+{
+	int ret;
+
+	ret = sparse_stream_finish(&fb_stream.ss, fb_stream.part_name,
+				   response);
+	if (!ret)
+		fastboot_okay(NULL, response);
+
+	return ret;
+}
@@ -32,6 +32,31 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * fastboot_stream_part - partition to write the next download to as it
+ * arrives, set by "oem stream"
+ */
+static char fastboot_stream_part[PART_NAME_LEN];
+
+/**
+ * fastboot_streaming - true while the current download is written to
+ * fastboot_stream_part
+ */
+static bool fastboot_streaming;
+
+/**
+ * fastboot_stream_error - response to send once the current download has
+ * all arrived, if writing it to fastboot_stream_part failed; the rest of the
+ * data is dropped until then
+ */
+static char fastboot_stream_error[FASTBOOT_RESPONSE_LEN];
+
+/**
+ * fastboot_streamed_part - partition the last download was written to, so
+ * that there is nothing left to do to flash it
+ */
+static char fastboot_streamed_part[PART_NAME_LEN];
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -45,6 +70,7 @@ static void oem_partconf(char *, char *);
 static void oem_bootbus(char *, char *);
 static void oem_console(char *, char *);
 static void oem_board(char *, char *);
+static void oem_stream(char *, char *);
 static void run_ucmd(char *, char *);
 static void run_acmd(char *, char *);
 
@@ -120,6 +146,10 @@ static const struct {
 		.command = "oem board",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_OEM_BOARD, (oem_board), (NULL))
 	},
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM, (oem_stream), (NULL))
+	},
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
 		.dispatch = CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT, (run_ucmd), (NULL))
@@ -221,6 +251,33 @@ static void getvar(char *cmd_parameter, char *response)
 	fastboot_getvar(cmd_parameter, response);
 }
 
+/**
+ * fastboot_stream_start() - Start writing a download to fastboot_stream_part
+ *
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 on success, -ve on error
+ */
+static int fastboot_stream_start(char *response)
+{
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+	int ret = -ENOSYS;
+
+	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_BLOCK))
+		ret = fastboot_block_get_part_info(fastboot_stream_part,
+						   &dev_desc, &info, response);
+	else if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_MMC))
+		ret = fastboot_mmc_get_part_info(fastboot_stream_part,
+						 &dev_desc, &info, response);
+	if (ret < 0)
+		return ret;
+
+	return fastboot_block_stream_start(dev_desc, &info,
+					   fastboot_stream_part,
+					   fastboot_buf_addr,
+					   fastboot_buf_size, response);
+}
+
 /**
  * fastboot_download() - Start a download transfer from the client
  *
@@ -241,6 +298,25 @@ static void download(char *cmd_parameter, char *response)
 		fastboot_fail("Expected nonzero image size", response);
 		return;
 	}
+	fastboot_streamed_part[0] = '\0';
+	fastboot_stream_error[0] = '\0';
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) && fastboot_streaming) {
+		/* The last download was abandoned part way through */
+		fastboot_block_stream_finish(response);
+		fastboot_streaming = false;
+	}
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+	    fastboot_stream_part[0]) {
+		if (fastboot_stream_start(response)) {
+			fastboot_stream_part[0] = '\0';
+			return;
+		}
+		fastboot_streaming = true;
+		printf("Starting download of %d bytes to '%s'\n",
+		       fastboot_bytes_expected, fastboot_stream_part);
+		fastboot_response("DATA", response, "%s", cmd_parameter);
+		return;
+	}
 	/*
 	 * Nothing to download yet. Response is of the form:
 	 * [DATA|FAIL]$cmd_parameter
@@ -294,9 +370,26 @@ void fastboot_data_download(const void *fastboot_data,
 			      response);
 		return;
 	}
-	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+	    fastboot_stream_error[0]) {
+		/* Writing failed, so drop the rest of the download */
+	} else if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+		   fastboot_streaming) {
+		/* Write data to fastboot_stream_part */
+		if (fastboot_block_stream_write(fastboot_data,
+						fastboot_data_len, response)) {
+			fastboot_block_stream_finish(response);
+			fastboot_streaming = false;
+			fastboot_stream_part[0] = '\0';
+			/* the client only reads a response once it is done */
+			strlcpy(fastboot_stream_error, response,
+				sizeof(fastboot_stream_error));
+		}
+	} else {
+		/* Download data to fastboot_buf_addr */
+		memcpy(fastboot_buf_addr + fastboot_bytes_received,
+		       fastboot_data, fastboot_data_len);
+	}
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -322,6 +415,18 @@ void fastboot_data_complete(char *response)
 	/* Download complete. Respond with "OKAY" */
 	fastboot_okay(NULL, response);
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+	    fastboot_stream_error[0]) {
+		strcpy(response, fastboot_stream_error);
+		fastboot_stream_error[0] = '\0';
+	} else if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+		   fastboot_streaming) {
+		/* Respond with the result of writing it instead */
+		if (!fastboot_block_stream_finish(response))
+			strcpy(fastboot_streamed_part, fastboot_stream_part);
+		fastboot_streaming = false;
+		fastboot_stream_part[0] = '\0';
+	}
 	image_size = fastboot_bytes_received;
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
@@ -339,6 +444,25 @@ void fastboot_data_complete(char *response)
  */
 static void __maybe_unused flash(char *cmd_parameter, char *response)
 {
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+	    fastboot_streamed_part[0]) {
+		/* The download was written while it arrived */
+		if (cmd_parameter &&
+		    !strcmp(cmd_parameter, fastboot_streamed_part))
+			fastboot_okay(NULL, response);
+		else
+			fastboot_fail("image was streamed to another partition",
+				      response);
+		fastboot_streamed_part[0] = '\0';
+		return;
+	}
+	if (CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM) &&
+	    image_size > fastboot_buf_size) {
+		/* A streamed download which failed is not in the buffer */
+		fastboot_fail("image was not downloaded", response);
+		return;
+	}
+
 	if (IS_ENABLED(CONFIG_FASTBOOT_FLASH_BLOCK))
 		fastboot_block_flash_write(cmd_parameter, fastboot_buf_addr,
 					   image_size, response);
@@ -589,3 +713,27 @@ static void __maybe_unused oem_board(char *cmd_parameter, char *response)
 {
 	fastboot_oem_board(cmd_parameter, (void *)fastboot_buf_addr, image_size, response);
 }
+
+/**
+ * oem_stream() - Execute the OEM stream command
+ *
+ * @cmd_parameter: Pointer to partition name
+ * @response: Pointer to fastboot response buffer
+ *
+ * Makes the next download be written to the partition indicated by
+ * cmd_parameter as it arrives, so that it need not fit in the download buffer.
+ */
+static void __maybe_unused oem_stream(char *cmd_parameter, char *response)
+{
+	if (!cmd_parameter || !*cmd_parameter) {
+		fastboot_fail("Expected command parameter", response);
+		return;
+	}
+	if (strlen(cmd_parameter) >= sizeof(fastboot_stream_part)) {
+		fastboot_fail("partition name too long", response);
+		return;
+	}
+
+	strcpy(fastboot_stream_part, cmd_parameter);
+	fastboot_okay(NULL, response);
+}
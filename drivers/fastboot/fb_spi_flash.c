@@ -185,6 +185,7 @@ void fastboot_spi_flash_write(const char *cmd, void *download_buffer,
 		sparse.size = part_info.size / sparse.blksz;
 		sparse.write = fb_spi_flash_sparse_write;
 		sparse.reserve = fb_spi_flash_sparse_reserve;
+		sparse.erase = NULL;
 		sparse.mssg = fastboot_fail;
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
@@ -6,6 +6,7 @@
  */
 
 #include <clk.h>
+#include <cqhci.h>
 #include <dm.h>
 #include <malloc.h>
 #include <mmc.h>
@@ -33,6 +34,8 @@
 #define PHY_STAT1	0x130
 #define PHY_STAT2	0x134
 
+#define SDHCI_AM654_CQE_BASE_ADDR	0x200
+
 #define IOMUX_ENABLE_SHIFT	31
 #define IOMUX_ENABLE_MASK	BIT(IOMUX_ENABLE_SHIFT)
 #define OTAPDLYENA_SHIFT	20
@@ -107,6 +110,9 @@ struct am654_sdhci_plat {
 #define DLL_CALIB	BIT(4)
 	u32 quirks;
 #define SDHCI_AM654_QUIRK_FORCE_CDTEST BIT(0)
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	struct cqhci_host cq_host;
+#endif
 };
 
 struct timing_data {
@@ -723,6 +729,41 @@ static int am654_sdhci_probe(struct udevice *dev)
 	if (plat->quirks & SDHCI_AM654_QUIRK_FORCE_CDTEST)
 		am654_sdhci_deferred_probe(host);
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	/*
+	 * Not yet validated on AM6x/J7 silicon, so it is only used when both
+	 * MMC_CQHCI (off by default) and the "supports-cqe" property are set.
+	 * This is the last step of probing, so nothing after it can fail and
+	 * leave the descriptor tables allocated.
+	 */
+	if (dev_read_bool(dev, "supports-cqe")) {
+		struct cqhci_host *cq_host = &plat->cq_host;
+
+		cq_host->mmio = host->ioaddr + SDHCI_AM654_CQE_BASE_ADDR;
+		cq_host->caps = CQHCI_TASK_DESC_SZ_128;
+		cq_host->quirks = CQHCI_QUIRK_SHORT_TXFR_DESC_SZ;
+		cq_host->ops = &sdhci_cqhci_ops;
+		/* the card is still usable one command at a time */
+		ret = cqhci_init(cq_host, host->mmc, host->flags & USE_ADMA64);
+		if (ret)
+			dev_warn(dev, "no command queue engine (err=%d)\n",
+				 ret);
+	}
+#endif
+
+	return 0;
+}
+
+static int am654_sdhci_remove(struct udevice *dev)
+{
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	struct am654_sdhci_plat *plat = dev_get_plat(dev);
+
+	/* the uclass has already taken the card out of command queue mode */
+	if (plat->mmc.cqe == &plat->cq_host)
+		cqhci_deinit(&plat->cq_host);
+#endif
+
 	return 0;
 }
 
@@ -838,6 +879,7 @@ U_BOOT_DRIVER(am654_sdhci_drv) = {
 	.ops		= &sdhci_ops,
 	.bind		= am654_sdhci_bind,
 	.probe		= am654_sdhci_probe,
+	.remove		= am654_sdhci_remove,
 	.priv_auto	= sizeof(struct sdhci_host),
 	.plat_auto	= sizeof(struct am654_sdhci_plat),
 };
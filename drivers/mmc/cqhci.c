@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * eMMC Command Queue Host Controller Interface (CQHCI)
+ *
+ * The engine takes read and write tasks from a list of descriptors in memory
+ * and queues them in the card, which can then work on several at once. Tasks
+ * are rung in with one doorbell write and their completion is polled, since
+ * U-Boot does not use interrupts.
+ *
+ * Based on the Linux driver
+ */
+
+#define LOG_CATEGORY UCLASS_MMC
+
+#include <blk.h>
+#include <cpu_func.h>
+#include <cqhci.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <mmc.h>
+#include <phys2bus.h>
+#include <time.h>
+#include <asm/byteorder.h>
+#include <asm/cache.h>
+#include <asm/io.h>
+#include <linux/delay.h>
+#include <linux/kernel.h>
+
+/* Time for a task to make progress, and for the engine to halt */
+#define CQHCI_TIMEOUT_MS	10000
+#define CQHCI_HALT_TIMEOUT_MS	1000
+
+static u8 *cqhci_trans_desc(struct cqhci_host *cq_host, int tag)
+{
+	return cq_host->trans_desc_base +
+		tag * CQHCI_MAX_SEGS * cq_host->trans_desc_len;
+}
+
+static __le32 *cqhci_task_desc(struct cqhci_host *cq_host, int tag)
+{
+	return (__le32 *)(cq_host->desc_base + tag * cq_host->slot_sz);
+}
+
+/* Address at which the engine reads the descriptors at @desc */
+static dma_addr_t cqhci_desc_addr(struct cqhci_host *cq_host, void *desc)
+{
+	return dev_phys_to_bus(mmc_to_dev(cq_host->mmc), virt_to_phys(desc));
+}
+
+/* Number of blocks one task may transfer */
+static lbaint_t cqhci_max_blks(struct cqhci_host *cq_host)
+{
+	struct mmc *mmc = cq_host->mmc;
+
+	/* the Block Count field of the task descriptor is 16 bits */
+	return min3((lbaint_t)U16_MAX,
+		    (lbaint_t)(CQHCI_MAX_SEGS * CQHCI_SEG_SIZE /
+			       mmc->read_bl_len),
+		    (lbaint_t)mmc->cfg->b_max);
+}
+
+static int cqhci_wait(struct cqhci_host *cq_host, int reg, u32 mask, u32 val)
+{
+	ulong start = get_timer(0);
+
+	while ((cqhci_readl(cq_host, reg) & mask) != val) {
+		if (get_timer(start) > CQHCI_HALT_TIMEOUT_MS)
+			return -ETIMEDOUT;
+		udelay(10);
+	}
+
+	return 0;
+}
+
+/**
+ * cqhci_end() - Finish a request if none of its tasks is outstanding
+ *
+ * @cq_host:	Command queue engine
+ * @req:	Request to check
+ * Return: 1 if the request was finished, 0 if not
+ */
+static int cqhci_end(struct cqhci_host *cq_host, struct blk_request *req)
+{
+	struct mmc *mmc = cq_host->mmc;
+	int i;
+
+	if (!list_empty(&req->sibling))
+		return 0;
+	for (i = 0; i < cq_host->depth; i++) {
+		if (cq_host->slots[i].req == req)
+			return 0;
+	}
+
+	if (req->op == BLK_REQ_READ)
+		invalidate_dcache_range((ulong)req->buffer,
+					(ulong)req->buffer +
+					req->blkcnt * mmc->read_bl_len);
+	blk_req_complete(req, req->result);
+
+	return 1;
+}
+
+/**
+ * cqhci_prep() - Fill in the descriptors of a task
+ *
+ * The buffer is contiguous, so it is split into transfer descriptors of
+ * CQHCI_SEG_SIZE, only the last of which may be shorter. The link descriptor
+ * after the task descriptor already points to the transfer descriptors of
+ * the slot.
+ *
+ * @cq_host:	Command queue engine
+ * @tag:	Slot of the task
+ * @op:		Operation to carry out
+ * @start:	First block of the task
+ * @blkcnt:	Number of blocks of the task
+ * @buf:	Buffer for the data
+ */
+static void cqhci_prep(struct cqhci_host *cq_host, int tag,
+		       enum blk_req_op op, lbaint_t start, lbaint_t blkcnt,
+		       void *buf)
+{
+	struct mmc *mmc = cq_host->mmc;
+	ulong len = blkcnt * mmc->read_bl_len;
+	u8 *trans = cqhci_trans_desc(cq_host, tag);
+	__le32 *desc;
+	dma_addr_t addr;
+	uint size, seg;
+	u32 attr;
+
+	for (seg = 0; len; seg++) {
+		desc = (__le32 *)(trans + seg * cq_host->trans_desc_len);
+		size = min_t(ulong, len, CQHCI_SEG_SIZE);
+		len -= size;
+
+		attr = CQHCI_VALID | CQHCI_ACT_TRAN | CQHCI_DAT_LENGTH(size);
+		if (!len)
+			attr |= CQHCI_END;
+		/* unlike virt_to_phys(), this copes with any buffer on sandbox */
+		addr = dev_phys_to_bus(mmc_to_dev(mmc), map_to_sysmem(buf));
+		desc[0] = cpu_to_le32(attr);
+		desc[1] = cpu_to_le32(lower_32_bits(addr));
+		if (cq_host->dma64)
+			desc[2] = cpu_to_le32(upper_32_bits(addr));
+		buf += size;
+	}
+	flush_dcache_range((ulong)trans,
+			   (ulong)trans + ALIGN(seg * cq_host->trans_desc_len,
+						ARCH_DMA_MINALIGN));
+
+	attr = CQHCI_VALID | CQHCI_END | CQHCI_INT | CQHCI_ACT_TASK |
+		CQHCI_BLK_COUNT(blkcnt);
+	if (op == BLK_REQ_READ)
+		attr |= CQHCI_DATA_DIR;
+	desc = cqhci_task_desc(cq_host, tag);
+	desc[0] = cpu_to_le32(attr);
+	desc[1] = cpu_to_le32(mmc->high_capacity ? start :
+			      start * mmc->read_bl_len);
+}
+
+/**
+ * cqhci_issue() - Queue tasks for the pending requests
+ *
+ * Each request is split into tasks of at most cqhci_max_blks() blocks, which
+ * are queued while there are free slots. The doorbell is rung once for all
+ * the tasks added.
+ *
+ * @cq_host:	Command queue engine
+ */
+static void cqhci_issue(struct cqhci_host *cq_host)
+{
+	struct mmc *mmc = cq_host->mmc;
+	struct blk_request *req;
+	lbaint_t blkcnt;
+	u32 tags = 0;
+	int tag;
+
+	while (!list_empty(&cq_host->pending) &&
+	       cq_host->inflight < cq_host->depth) {
+		req = list_first_entry(&cq_host->pending, struct blk_request,
+				       sibling);
+		blkcnt = min(req->blkcnt - cq_host->issued,
+			     cqhci_max_blks(cq_host));
+
+		for (tag = 0; cq_host->slots[tag].req; tag++)
+			;
+		cqhci_prep(cq_host, tag, req->op, req->start + cq_host->issued,
+			   blkcnt, (u8 *)req->buffer +
+			   cq_host->issued * mmc->read_bl_len);
+
+		cq_host->slots[tag].req = req;
+		cq_host->slots[tag].blkcnt = blkcnt;
+		cq_host->inflight++;
+		cq_host->issued += blkcnt;
+		if (cq_host->issued == req->blkcnt) {
+			list_del_init(&req->sibling);
+			cq_host->issued = 0;
+		}
+		tags |= BIT(tag);
+	}
+
+	if (tags) {
+		flush_dcache_range((ulong)cq_host->desc_base,
+				   (ulong)cq_host->desc_base +
+				   ALIGN(CQHCI_NUM_SLOTS * cq_host->slot_sz,
+					 ARCH_DMA_MINALIGN));
+		cqhci_writel(cq_host, tags, CQHCI_TDBR);
+		cq_host->time = get_timer(0);
+	}
+}
+
+/* Stop the engine fetching tasks, so that the queue can be changed */
+static int cqhci_halt(struct cqhci_host *cq_host)
+{
+	cqhci_writel(cq_host, CQHCI_HALT, CQHCI_CTL);
+
+	return cqhci_wait(cq_host, CQHCI_CTL, CQHCI_HALT, CQHCI_HALT);
+}
+
+/* Turn the engine off, leaving the host controller for single commands */
+static void cqhci_off(struct cqhci_host *cq_host)
+{
+	u32 cfg;
+
+	cfg = cqhci_readl(cq_host, CQHCI_CFG);
+	cqhci_writel(cq_host, cfg & ~CQHCI_ENABLE, CQHCI_CFG);
+	if (cq_host->ops && cq_host->ops->disable)
+		cq_host->ops->disable(cq_host->mmc);
+	cq_host->enabled = false;
+}
+
+/**
+ * cqhci_abort() - Give up on all the requests and disable the engine
+ *
+ * The tasks are cleared from the engine. Those queued in the card are left
+ * for the MMC core to discard, before it takes the card out of command queue
+ * mode.
+ *
+ * @cq_host:	Command queue engine
+ * @err:	Error to finish the requests with
+ * Return: number of requests finished
+ */
+static int cqhci_abort(struct cqhci_host *cq_host, int err)
+{
+	struct blk_request *req, *next;
+	LIST_HEAD(pending);
+	int i, done = 0;
+
+	if (cqhci_halt(cq_host))
+		log_err("%s: Command queue did not halt\n",
+			cq_host->mmc->cfg->name);
+	cqhci_writel(cq_host, CQHCI_HALT | CQHCI_CLEAR_ALL_TASKS, CQHCI_CTL);
+	if (cqhci_wait(cq_host, CQHCI_TDBR, ~0, 0))
+		log_err("%s: Tasks were not cleared\n",
+			cq_host->mmc->cfg->name);
+	cqhci_writel(cq_host, cqhci_readl(cq_host, CQHCI_TCN), CQHCI_TCN);
+	cqhci_off(cq_host);
+
+	list_splice_init(&cq_host->pending, &pending);
+	cq_host->issued = 0;
+	list_for_each_entry_safe(req, next, &pending, sibling) {
+		list_del_init(&req->sibling);
+		req->result = err;
+		done += cqhci_end(cq_host, req);
+	}
+
+	for (i = 0; i < cq_host->depth; i++) {
+		req = cq_host->slots[i].req;
+		if (!req)
+			continue;
+		req->result = err;
+		cq_host->slots[i].req = NULL;
+		cq_host->inflight--;
+		done += cqhci_end(cq_host, req);
+	}
+
+	return done;
+}
+
+int cqhci_submit(struct cqhci_host *cq_host, struct blk_request *req)
+{
+	struct mmc *mmc = cq_host->mmc;
+
+	if (!cq_host->enabled)
+		return -EPERM;
+	if (!req->blkcnt) {
+		blk_req_complete(req, 0);
+		return 0;
+	}
+
+	flush_dcache_range((ulong)req->buffer,
+			   (ulong)req->buffer + req->blkcnt * mmc->read_bl_len);
+	list_add_tail(&req->sibling, &cq_host->pending);
+	cqhci_issue(cq_host);
+
+	return 0;
+}
+
+/*
+ * All the tasks completed so far are handled together, and the slots freed
+ * are then given to the tasks still pending.
+ */
+int cqhci_poll(struct cqhci_host *cq_host)
+{
+	const char *name = cq_host->mmc->cfg->name;
+	struct cqhci_slot *slot;
+	struct blk_request *req;
+	u32 status, comp;
+	int tag, done = 0;
+
+	if (!cq_host->enabled)
+		return 0;
+	if (!cq_host->inflight) {
+		cqhci_issue(cq_host);
+		return 0;
+	}
+
+	status = cqhci_readl(cq_host, CQHCI_IS);
+	cqhci_writel(cq_host, status, CQHCI_IS);
+
+	comp = 0;
+	if (status & CQHCI_IS_TCC) {
+		comp = cqhci_readl(cq_host, CQHCI_TCN);
+		cqhci_writel(cq_host, comp, CQHCI_TCN);
+	}
+	for (tag = 0; tag < cq_host->depth; tag++) {
+		slot = &cq_host->slots[tag];
+		if (!(comp & BIT(tag)) || !slot->req)
+			continue;
+		req = slot->req;
+		slot->req = NULL;
+		cq_host->inflight--;
+		if (req->result >= 0)
+			req->result += slot->blkcnt;
+		done += cqhci_end(cq_host, req);
+	}
+
+	/* tasks which completed before an error are still good */
+	if (status & CQHCI_IS_ERR_MASK) {
+		log_err("%s: Command queue error, status %x, task error %x\n",
+			name, status, cqhci_readl(cq_host, CQHCI_TERRI));
+		return done + cqhci_abort(cq_host, -EIO);
+	}
+	if (!comp) {
+		if (get_timer(cq_host->time) < CQHCI_TIMEOUT_MS)
+			return 0;
+		log_err("%s: Command queue timed out\n", name);
+		return cqhci_abort(cq_host, -ETIMEDOUT);
+	}
+	cq_host->time = get_timer(0);
+	cqhci_issue(cq_host);
+
+	return done;
+}
+
+int cqhci_enable(struct cqhci_host *cq_host, uint depth)
+{
+	struct mmc *mmc = cq_host->mmc;
+	dma_addr_t addr;
+	u32 cfg;
+
+	if (cq_host->enabled)
+		return 0;
+
+	/* the configuration must not be changed while the engine is on */
+	cfg = cqhci_readl(cq_host, CQHCI_CFG);
+	if (cfg & CQHCI_ENABLE) {
+		cfg &= ~CQHCI_ENABLE;
+		cqhci_writel(cq_host, cfg, CQHCI_CFG);
+	}
+
+	cfg &= ~(CQHCI_DCMD | CQHCI_TASK_DESC_SZ);
+	if (cq_host->caps & CQHCI_TASK_DESC_SZ_128)
+		cfg |= CQHCI_TASK_DESC_SZ;
+	cqhci_writel(cq_host, cfg, CQHCI_CFG);
+
+	addr = cqhci_desc_addr(cq_host, cq_host->desc_base);
+	cqhci_writel(cq_host, lower_32_bits(addr), CQHCI_TDLBA);
+	cqhci_writel(cq_host, upper_32_bits(addr), CQHCI_TDLBAU);
+	cqhci_writel(cq_host, mmc->rca, CQHCI_SSC2);
+
+	/* completions are polled, so no interrupt is signalled */
+	cqhci_writel(cq_host, CQHCI_IS_MASK, CQHCI_ISTE);
+	cqhci_writel(cq_host, 0, CQHCI_ISGE);
+	cqhci_writel(cq_host, cqhci_readl(cq_host, CQHCI_IS), CQHCI_IS);
+
+	cqhci_writel(cq_host, cfg | CQHCI_ENABLE, CQHCI_CFG);
+	if (cqhci_readl(cq_host, CQHCI_CTL) & CQHCI_HALT)
+		cqhci_writel(cq_host, 0, CQHCI_CTL);
+	if (cq_host->ops && cq_host->ops->enable)
+		cq_host->ops->enable(mmc);
+
+	cq_host->depth = min_t(uint, depth, CQHCI_NUM_SLOTS);
+	cq_host->inflight = 0;
+	cq_host->enabled = true;
+
+	return 0;
+}
+
+int cqhci_disable(struct cqhci_host *cq_host)
+{
+	int ret;
+
+	/* an engine which gave up has abandoned the tasks in the card */
+	if (!cq_host->enabled)
+		return -ECANCELED;
+
+	while (cq_host->inflight || !list_empty(&cq_host->pending)) {
+		cqhci_poll(cq_host);
+		if (!cq_host->enabled)
+			return -ECANCELED;
+	}
+
+	ret = cqhci_halt(cq_host);
+	cqhci_off(cq_host);
+
+	return ret;
+}
+
+int cqhci_init(struct cqhci_host *cq_host, struct mmc *mmc, bool dma64)
+{
+	dma_addr_t addr;
+	__le32 *link;
+	int i;
+
+	cq_host->mmc = mmc;
+	cq_host->dma64 = dma64;
+	cq_host->task_desc_len = cq_host->caps & CQHCI_TASK_DESC_SZ_128 ?
+		16 : 8;
+	if (dma64) {
+		cq_host->trans_desc_len =
+			cq_host->quirks & CQHCI_QUIRK_SHORT_TXFR_DESC_SZ ?
+			12 : 16;
+		cq_host->link_desc_len = 16;
+	} else {
+		cq_host->trans_desc_len = 8;
+		cq_host->link_desc_len = 8;
+	}
+	cq_host->slot_sz = cq_host->task_desc_len + cq_host->link_desc_len;
+
+	/* the task list must be aligned to 1KiB */
+	cq_host->desc_base = memalign(SZ_1K,
+				      CQHCI_NUM_SLOTS * cq_host->slot_sz);
+	cq_host->trans_desc_base = memalign(ARCH_DMA_MINALIGN,
+					    CQHCI_NUM_SLOTS * CQHCI_MAX_SEGS *
+					    cq_host->trans_desc_len);
+	if (!cq_host->desc_base || !cq_host->trans_desc_base) {
+		free(cq_host->desc_base);
+		free(cq_host->trans_desc_base);
+		return -ENOMEM;
+	}
+	memset(cq_host->desc_base, '\0', CQHCI_NUM_SLOTS * cq_host->slot_sz);
+
+	/* each slot always links to its own transfer descriptors */
+	for (i = 0; i < CQHCI_NUM_SLOTS; i++) {
+		link = (__le32 *)((u8 *)cqhci_task_desc(cq_host, i) +
+				  cq_host->task_desc_len);
+		addr = cqhci_desc_addr(cq_host, cqhci_trans_desc(cq_host, i));
+		link[0] = cpu_to_le32(CQHCI_VALID | CQHCI_ACT_LINK);
+		link[1] = cpu_to_le32(lower_32_bits(addr));
+		if (dma64)
+			link[2] = cpu_to_le32(upper_32_bits(addr));
+	}
+
+	memset(cq_host->slots, '\0', sizeof(cq_host->slots));
+	INIT_LIST_HEAD(&cq_host->pending);
+	cq_host->issued = 0;
+	cq_host->enabled = false;
+	mmc->cqe = cq_host;
+
+	return 0;
+}
+
+void cqhci_deinit(struct cqhci_host *cq_host)
+{
+	if (cq_host->mmc->cqe == cq_host)
+		cq_host->mmc->cqe = NULL;
+	free(cq_host->desc_base);
+	free(cq_host->trans_desc_base);
+	cq_host->desc_base = NULL;
+	cq_host->trans_desc_base = NULL;
+}
@@ -836,6 +836,8 @@ static void fsl_esdhc_get_cfg_common(struct fsl_esdhc_priv *priv,
 	cfg->f_min = 400000;
 	cfg->f_max = min(priv->sdhc_clk, (u32)200000000);
 	cfg->b_max = CONFIG_SYS_MMC_MAX_BLK_COUNT;
+	if (IS_ENABLED(CONFIG_FSL_ESDHC_SUPPORT_ADMA2))
+		cfg->b_max = min_t(uint, cfg->b_max, ADMA_MAX_BLK_COUNT);
 }
 
 #ifdef CONFIG_OF_LIBFDT
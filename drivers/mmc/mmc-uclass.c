@@ -8,6 +8,7 @@
 #define LOG_CATEGORY UCLASS_MMC
 
 #include <bootdev.h>
+#include <cqhci.h>
 #include <log.h>
 #include <mmc.h>
 #include <dm.h>
@@ -52,6 +53,13 @@ static int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 
 int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 {
+	int ret;
+
+	/* a card in command queue mode only takes queued tasks */
+	ret = mmc_cqe_off(mmc);
+	if (ret)
+		return ret;
+
 	return dm_mmc_send_cmd(mmc->dev, cmd, data);
 }
 
@@ -502,6 +510,55 @@ static int mmc_select_hwpart(struct udevice *bdev, int hwpart)
 	return ret;
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+/*
+ * Requests go to the command queue engine if the card has a queue, so that
+ * several are worked on at once. Otherwise they are carried out at once.
+ */
+static int mmc_blk_submit(struct udevice *dev, struct blk_request *req)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev_get_parent(dev));
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	ulong ret;
+
+	/* RPMB cannot be accessed in command queue mode */
+	if (blk_dselect_hwpart(desc, desc->hwpart) < 0) {
+		blk_req_complete(req, -EIO);
+		return 0;
+	}
+	if (mmc->cqe && mmc->cmdq_depth && req->blkcnt &&
+	    desc->hwpart != MMC_PART_RPMB &&
+	    req->start + req->blkcnt <= desc->lba &&
+	    (req->op == BLK_REQ_READ || CONFIG_IS_ENABLED(MMC_WRITE)) &&
+	    !mmc_cqe_on(mmc))
+		return cqhci_submit(mmc->cqe, req);
+
+	if (req->op == BLK_REQ_WRITE)
+		ret = mmc_bwrite(dev, req->start, req->blkcnt, req->buffer);
+	else
+		ret = mmc_bread(dev, req->start, req->blkcnt, req->buffer);
+	blk_req_complete(req, ret);
+
+	return 0;
+}
+
+static int mmc_blk_poll(struct udevice *dev)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev_get_parent(dev));
+	int ret;
+
+	if (!mmc->cmdq_en)
+		return 0;
+
+	ret = cqhci_poll(mmc->cqe);
+	/* the engine gives up on an error, leaving the card to be reset */
+	if (!mmc->cqe->enabled)
+		mmc_cqe_off(mmc);
+
+	return ret;
+}
+#endif
+
 static int mmc_blk_probe(struct udevice *dev)
 {
 	struct udevice *mmc_dev = dev_get_parent(dev);
@@ -523,6 +580,9 @@ static int mmc_remove(struct udevice *dev)
 	struct mmc_uclass_priv *upriv = dev_get_uclass_priv(dev);
 	struct mmc *mmc = upriv->mmc;
 
+	/* leave the card ready for single commands, e.g. for the OS */
+	mmc_cqe_off(mmc);
+
 	return mmc_deinit(mmc);
 }
 
@@ -533,6 +593,10 @@ static const struct blk_ops mmc_blk_ops = {
 	.erase	= mmc_berase,
 #endif
 	.select_hwpart	= mmc_select_hwpart,
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	.submit		= mmc_blk_submit,
+	.poll		= mmc_blk_poll,
+#endif
 };
 
 U_BOOT_DRIVER(mmc_blk) = {
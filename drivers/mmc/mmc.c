@@ -10,6 +10,7 @@
 #include <config.h>
 #include <blk.h>
 #include <command.h>
+#include <cqhci.h>
 #include <dm.h>
 #include <log.h>
 #include <dm/device-internal.h>
@@ -30,6 +31,7 @@
 #include "mmc_private.h"
 
 #define DEFAULT_CMD6_TIMEOUT_MS  500
+#define CMDQ_DISCARD_TIMEOUT_MS  1000
 
 /**
  * names of emmc BOOT_PARTITION_ENABLE values
@@ -455,11 +457,38 @@ int mmc_send_stop_transmission(struct mmc *mmc, bool write)
 	return mmc_send_cmd(mmc, &cmd, NULL);
 }
 
+bool mmc_use_cmd23(struct mmc *mmc, lbaint_t blkcnt)
+{
+	if (blkcnt < 2 || blkcnt > U16_MAX || mmc_host_is_spi(mmc) ||
+	    !(mmc->cfg->host_caps & MMC_CAP_CMD23))
+		return false;
+
+	if (IS_SD(mmc))
+		return mmc->scr[0] & SD_SCR_CMD23_SUPPORT;
+
+	return mmc->version >= MMC_VERSION_3;
+}
+
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blkcnt;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool sbc = mmc_use_cmd23(mmc, blkcnt);
+
+	if (sbc && mmc_set_block_count(mmc, blkcnt))
+		return 0;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -481,7 +510,8 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	/* the card stops by itself after the number of blocks it was given */
+	if (blkcnt > 1 && !sbc) {
 		if (mmc_send_stop_transmission(mmc, false)) {
 #if !defined(CONFIG_XPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 			log_err("mmc fail to send stop cmd\n");
@@ -928,6 +958,76 @@ int mmc_switch(struct mmc *mmc, u8 set, u8 index, u8 value)
 	return __mmc_switch(mmc, set, index, value, true);
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+/* Drop the tasks queued in the card, which the engine gave up on */
+static int mmc_cmdq_discard(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int ret;
+
+	cmd.cmdidx = MMC_CMD_CMDQ_TASK_MGMT;
+	cmd.cmdarg = MMC_CMDQ_DISCARD_QUEUE;
+	cmd.resp_type = MMC_RSP_R1b;
+
+	ret = mmc_send_cmd(mmc, &cmd, NULL);
+	if (ret)
+		return ret;
+
+	return mmc_poll_for_busy(mmc, CMDQ_DISCARD_TIMEOUT_MS);
+}
+
+int mmc_cqe_on(struct mmc *mmc)
+{
+	int ret;
+
+	if (mmc->cmdq_en && mmc->cqe->enabled)
+		return 0;
+	ret = mmc_cqe_off(mmc);
+	if (ret)
+		return ret;
+
+	/* tasks are always in blocks of 512 bytes */
+	ret = mmc_set_blocklen(mmc, mmc->read_bl_len);
+	if (ret)
+		return ret;
+	ret = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 1);
+	if (ret)
+		return ret;
+	mmc->cmdq_en = true;
+
+	ret = cqhci_enable(mmc->cqe, mmc->cmdq_depth);
+	if (ret) {
+		mmc_cqe_off(mmc);
+		return ret;
+	}
+
+	return 0;
+}
+
+int mmc_cqe_off(struct mmc *mmc)
+{
+	int ret;
+
+	if (!mmc->cmdq_en)
+		return 0;
+
+	/*
+	 * The requests queued are finished first. Their completion may queue
+	 * more, so the card is only marked as out of command queue mode once
+	 * the engine is off and the commands below can be sent.
+	 */
+	ret = cqhci_disable(mmc->cqe);
+	mmc->cmdq_en = false;
+	if (ret) {
+		ret = mmc_cmdq_discard(mmc);
+		if (ret)
+			return ret;
+	}
+
+	return mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_CMDQ_MODE_EN, 0);
+}
+#endif
+
 int mmc_boot_wp(struct mmc *mmc)
 {
 	return mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BOOT_WP, 1);
@@ -2528,6 +2628,12 @@ static int mmc_startup_v4(struct mmc *mmc)
 	mmc->can_trim =
 		!!(ext_csd[EXT_CSD_SEC_FEATURE] & EXT_CSD_SEC_FEATURE_TRIM_EN);
 
+	mmc->cmdq_depth = 0;
+	if (mmc->version >= MMC_VERSION_5_0 &&
+	    (ext_csd[EXT_CSD_CMDQ_SUPPORT] & EXT_CSD_CMDQ_SUPPORTED))
+		mmc->cmdq_depth =
+			(ext_csd[EXT_CSD_CMDQ_DEPTH] & EXT_CSD_CMDQ_DEPTH_MASK) + 1;
+
 	return 0;
 error:
 	if (mmc->ext_csd) {
@@ -17,6 +17,28 @@ int mmc_poll_for_busy(struct mmc *mmc, int timeout);
 
 int mmc_set_blocklen(struct mmc *mmc, int len);
 
+/**
+ * mmc_use_cmd23() - Check whether a transfer is sized by SET_BLOCK_COUNT
+ *
+ * Sending SET_BLOCK_COUNT (CMD23) ahead of a multiple-block transfer saves
+ * the STOP_TRANSMISSION (CMD12) after it. Both the host and the card must
+ * support it.
+ *
+ * @mmc:	MMC device
+ * @blkcnt:	Number of blocks to transfer
+ * Return: true to send SET_BLOCK_COUNT, false to stop the transfer instead
+ */
+bool mmc_use_cmd23(struct mmc *mmc, lbaint_t blkcnt);
+
+/**
+ * mmc_set_block_count() - Send SET_BLOCK_COUNT for the next transfer
+ *
+ * @mmc:	MMC device
+ * @blkcnt:	Number of blocks of the next read or write
+ * Return: 0 if OK, -ve on error
+ */
+int mmc_set_block_count(struct mmc *mmc, lbaint_t blkcnt);
+
 #if CONFIG_IS_ENABLED(BLK)
 ulong mmc_bread(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 		void *dst);
@@ -132,4 +154,31 @@ int mmc_switch_part(struct mmc *mmc, unsigned int part_num);
  */
 int mmc_switch(struct mmc *mmc, u8 set, u8 index, u8 value);
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+/**
+ * mmc_cqe_on() - Put the card in command queue mode and enable the engine
+ *
+ * @mmc:	MMC device, with a command queue engine and a card which has a
+ *		command queue
+ * Return: 0 if OK, -ve on error
+ */
+int mmc_cqe_on(struct mmc *mmc);
+
+/**
+ * mmc_cqe_off() - Disable the command queue engine and leave queue mode
+ *
+ * This must be done before any other command is sent to the card. The
+ * requests queued are finished first.
+ *
+ * @mmc:	MMC device
+ * Return: 0 if OK, -ve on error
+ */
+int mmc_cqe_off(struct mmc *mmc);
+#else
+static inline int mmc_cqe_off(struct mmc *mmc)
+{
+	return 0;
+}
+#endif
+
 #endif /* _MMC_PRIVATE_H_ */
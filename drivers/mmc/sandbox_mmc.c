@@ -4,11 +4,13 @@
  * Written by Simon Glass <sjg@chromium.org>
  */
 
+#include <cqhci.h>
 #include <dm.h>
 #include <errno.h>
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <mmc.h>
 #include <os.h>
 #include <asm/test.h>
@@ -30,8 +32,59 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	uint set_count;	/* blocks given by SET_BLOCK_COUNT, 0 if none */
+	bool open;	/* an open-ended transfer is waiting to be stopped */
+	bool cmdq;	/* the card is in command queue mode */
+	struct sandbox_mmc_stats stats;
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	struct cqhci_host cq_host;
+	u32 cqe_regs[CQHCI_REG_SIZE / sizeof(u32)];
+	u32 cqe_fail;	/* tags of tasks which fail next time */
+#endif
 };
 
+/*
+ * Check that a data command follows on properly from the ones before: an
+ * open-ended transfer must have been stopped, and one sized by SET_BLOCK_COUNT
+ * must have the number of blocks it was given.
+ */
+static int sandbox_mmc_check_data(struct udevice *dev, struct mmc_cmd *cmd,
+				  struct mmc_data *data)
+{
+	struct sandbox_mmc_plat *plat = dev_get_plat(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	uint set_count = priv->set_count;
+
+	priv->set_count = 0;
+	if (priv->cmdq) {
+		log_err("%s: Transfer in command queue mode\n", dev->name);
+		return -EIO;
+	}
+	if (priv->open) {
+		log_err("%s: Transfer was not stopped\n", dev->name);
+		return -EIO;
+	}
+	if (data->blocks > plat->cfg.b_max) {
+		log_err("%s: Too many blocks (%u)\n", dev->name, data->blocks);
+		return -EIO;
+	}
+	if (cmd->cmdidx != MMC_CMD_READ_MULTIPLE_BLOCK &&
+	    cmd->cmdidx != MMC_CMD_WRITE_MULTIPLE_BLOCK)
+		return 0;
+
+	priv->stats.transfers++;
+	priv->stats.max_blocks = max(priv->stats.max_blocks, data->blocks);
+	if (!set_count) {
+		priv->open = true;
+	} else if (set_count != data->blocks) {
+		log_err("%s: %u blocks given, %u transferred\n", dev->name,
+			set_count, data->blocks);
+		return -EIO;
+	}
+
+	return 0;
+}
+
 /**
  * sandbox_mmc_send_cmd() - Emulate SD commands
  *
@@ -43,6 +96,7 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 {
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 	static ulong erase_start, erase_end;
+	int ret;
 
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
@@ -56,7 +110,7 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[0] = 0xaa;
 		break;
 	case MMC_CMD_SEND_STATUS:
-		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA | MMC_STATE_TRANS;
 		break;
 	case MMC_CMD_SELECT_CARD:
 		break;
@@ -68,8 +122,12 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[3] = 0;
 		break;
 	case SD_CMD_SWITCH_FUNC: {
-		if (!data)
+		/* without data this is an eMMC SWITCH, of which only one is known */
+		if (!data) {
+			if (((cmd->cmdarg >> 16) & 0xff) == EXT_CSD_CMDQ_MODE_EN)
+				priv->cmdq = (cmd->cmdarg >> 8) & 1;
 			break;
+		}
 		u32 *resp = (u32 *)data->dest;
 		resp[3] = 0;
 		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
@@ -79,15 +137,32 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	}
 	case MMC_CMD_READ_SINGLE_BLOCK:
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		ret = sandbox_mmc_check_data(dev, cmd, data);
+		if (ret)
+			return ret;
 		memcpy(data->dest, &priv->buf[cmd->cmdarg * data->blocksize],
 		       data->blocks * data->blocksize);
 		break;
 	case MMC_CMD_WRITE_SINGLE_BLOCK:
 	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		ret = sandbox_mmc_check_data(dev, cmd, data);
+		if (ret)
+			return ret;
 		memcpy(&priv->buf[cmd->cmdarg * data->blocksize], data->src,
 		       data->blocks * data->blocksize);
 		break;
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->set_count = cmd->cmdarg;
+		priv->stats.set_counts++;
+		break;
 	case MMC_CMD_STOP_TRANSMISSION:
+		priv->open = false;
+		priv->stats.stops++;
+		break;
+	case MMC_CMD_CMDQ_TASK_MGMT:
+		if (!priv->cmdq)
+			return -EIO;
+		priv->stats.discards++;
 		break;
 	case SD_CMD_ERASE_WR_BLK_START:
 		erase_start = cmd->cmdarg;
@@ -117,7 +192,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with SET_BLOCK_COUNT */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_SCR_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -128,6 +204,150 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+/*
+ * A command queue engine, whose registers are kept in priv->cqe_regs. The
+ * card carries out the tasks rung in at once, but they are only seen to
+ * complete when the interrupt status is next read.
+ */
+
+/* Carry out the task in slot @tag, with 64-bit descriptors */
+static int sandbox_cqe_task(struct sandbox_mmc_priv *priv, int tag)
+{
+	u32 *regs = priv->cqe_regs;
+	ulong offset, len, size;
+	__le32 *desc, *link;
+	int task_len, seg;
+	u32 attr, blkcnt;
+	bool read;
+	u8 *trans;
+	void *buf;
+
+	task_len = regs[CQHCI_CFG / 4] & CQHCI_TASK_DESC_SZ ? 16 : 8;
+	desc = map_sysmem(regs[CQHCI_TDLBA / 4] |
+			  (u64)regs[CQHCI_TDLBAU / 4] << 32, 0);
+	desc = (void *)desc + tag * (task_len + 16);
+	attr = le32_to_cpu(desc[0]);
+	if ((attr & (CQHCI_VALID | CQHCI_ACT_MASK)) !=
+	    (CQHCI_VALID | CQHCI_ACT_TASK))
+		return -EINVAL;
+	read = attr & CQHCI_DATA_DIR;
+	blkcnt = CQHCI_GET_BLK_COUNT(attr);
+	offset = (ulong)le32_to_cpu(desc[1]) * MMC_MAX_BLOCK_LEN;
+	len = blkcnt * MMC_MAX_BLOCK_LEN;
+	if (!blkcnt || offset + len > priv->size)
+		return -EINVAL;
+
+	link = (void *)desc + task_len;
+	if ((le32_to_cpu(link[0]) & (CQHCI_VALID | CQHCI_ACT_MASK)) !=
+	    (CQHCI_VALID | CQHCI_ACT_LINK))
+		return -EINVAL;
+	trans = map_sysmem(le32_to_cpu(link[1]) |
+			   (u64)le32_to_cpu(link[2]) << 32, 0);
+
+	for (seg = 0; len; seg++) {
+		if (seg == CQHCI_MAX_SEGS)
+			return -EINVAL;
+		desc = (__le32 *)(trans + seg * 16);
+		attr = le32_to_cpu(desc[0]);
+		size = CQHCI_GET_DAT_LENGTH(attr);
+		if ((attr & (CQHCI_VALID | CQHCI_ACT_MASK)) !=
+		    (CQHCI_VALID | CQHCI_ACT_TRAN) || !size || size > len)
+			return -EINVAL;
+		len -= size;
+		if (!(attr & CQHCI_END) != !!len)
+			return -EINVAL;
+
+		buf = map_sysmem(le32_to_cpu(desc[1]) |
+				 (u64)le32_to_cpu(desc[2]) << 32, size);
+		if (read)
+			memcpy(buf, &priv->buf[offset], size);
+		else
+			memcpy(&priv->buf[offset], buf, size);
+		offset += size;
+	}
+
+	return 0;
+}
+
+/* Carry out the tasks rung in, stopping at the first which fails */
+static void sandbox_cqe_run(struct sandbox_mmc_priv *priv)
+{
+	u32 *regs = priv->cqe_regs;
+	int tag;
+
+	if (!(regs[CQHCI_CFG / 4] & CQHCI_ENABLE) ||
+	    (regs[CQHCI_CTL / 4] & CQHCI_HALT) || !priv->cmdq)
+		return;
+
+	for (tag = 0; tag < CQHCI_NUM_SLOTS; tag++) {
+		if (!(regs[CQHCI_TDBR / 4] & BIT(tag)))
+			continue;
+		if ((priv->cqe_fail & BIT(tag)) ||
+		    sandbox_cqe_task(priv, tag)) {
+			priv->cqe_fail &= ~BIT(tag);
+			regs[CQHCI_TERRI / 4] = CQHCI_TERRI_D_VALID | tag << 24;
+			regs[CQHCI_IS / 4] |= CQHCI_IS_RED;
+			return;
+		}
+		regs[CQHCI_TDBR / 4] &= ~BIT(tag);
+		regs[CQHCI_TCN / 4] |= BIT(tag);
+		regs[CQHCI_IS / 4] |= CQHCI_IS_TCC;
+		priv->stats.tasks++;
+	}
+}
+
+static u32 sandbox_cqe_read_l(struct cqhci_host *cq_host, int reg)
+{
+	struct sandbox_mmc_priv *priv = container_of(cq_host,
+						     struct sandbox_mmc_priv,
+						     cq_host);
+
+	if (reg == CQHCI_IS)
+		sandbox_cqe_run(priv);
+
+	return priv->cqe_regs[reg / 4];
+}
+
+static void sandbox_cqe_write_l(struct cqhci_host *cq_host, u32 val, int reg)
+{
+	struct sandbox_mmc_priv *priv = container_of(cq_host,
+						     struct sandbox_mmc_priv,
+						     cq_host);
+	u32 *regs = priv->cqe_regs;
+
+	switch (reg) {
+	case CQHCI_IS:
+	case CQHCI_TCN:
+		regs[reg / 4] &= ~val;
+		break;
+	case CQHCI_TDBR:
+		regs[reg / 4] |= val;
+		priv->stats.max_tasks = max_t(uint, priv->stats.max_tasks,
+					      hweight32(regs[reg / 4]));
+		break;
+	case CQHCI_TCLR:
+		regs[CQHCI_TDBR / 4] &= ~val;
+		break;
+	case CQHCI_CTL:
+		regs[reg / 4] = val & CQHCI_HALT;
+		if (val & CQHCI_HALT)
+			regs[CQHCI_IS / 4] |= CQHCI_IS_HAC;
+		if (val & CQHCI_CLEAR_ALL_TASKS)
+			regs[CQHCI_TDBR / 4] = 0;
+		break;
+	default:
+		regs[reg / 4] = val;
+		break;
+	}
+}
+
+static const struct cqhci_host_ops sandbox_cqhci_ops = {
+	.read_l		= sandbox_cqe_read_l,
+	.write_l	= sandbox_cqe_write_l,
+};
+#endif
+
 static int sandbox_mmc_set_ios(struct udevice *dev)
 {
 	return 0;
@@ -190,6 +410,13 @@ static int sandbox_mmc_probe(struct udevice *dev)
 		}
 	}
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	priv->cq_host.ops = &sandbox_cqhci_ops;
+	ret = cqhci_init(&priv->cq_host, &plat->mmc, true);
+	if (ret)
+		return ret;
+#endif
+
 	return mmc_init(&plat->mmc);
 }
 
@@ -198,6 +425,9 @@ static int sandbox_mmc_remove(struct udevice *dev)
 	struct sandbox_mmc_plat *plat = dev_get_plat(dev);
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	cqhci_deinit(&priv->cq_host);
+#endif
 	if (plat->fname)
 		os_unmap(priv->buf, priv->size);
 	else
@@ -217,10 +447,47 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
 	cfg->b_max = U32_MAX;
+	cfg->host_caps |= MMC_CAP_CMD23;
 
 	return mmc_bind(dev, &plat->mmc, cfg);
 }
 
+void sandbox_mmc_set_host(struct udevice *dev, uint b_max, bool cmd23)
+{
+	struct sandbox_mmc_plat *plat = dev_get_plat(dev);
+
+	plat->cfg.b_max = b_max;
+	if (cmd23)
+		plat->cfg.host_caps |= MMC_CAP_CMD23;
+	else
+		plat->cfg.host_caps &= ~MMC_CAP_CMD23;
+}
+
+void sandbox_mmc_set_cqe(struct udevice *dev, uint depth)
+{
+	struct sandbox_mmc_plat *plat = dev_get_plat(dev);
+
+	plat->mmc.cmdq_depth = depth;
+}
+
+void sandbox_mmc_fail_tasks(struct udevice *dev, u32 tags)
+{
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->cqe_fail = tags;
+#endif
+}
+
+void sandbox_mmc_get_stats(struct udevice *dev,
+			   struct sandbox_mmc_stats *stats)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	*stats = priv->stats;
+	memset(&priv->stats, '\0', sizeof(priv->stats));
+}
+
 static int sandbox_mmc_unbind(struct udevice *dev)
 {
 	mmc_unbind(dev);
@@ -49,8 +49,8 @@ static inline void __sdhci_adma_write_desc(struct sdhci_host *host,
  *
  * Fill the ADMA table according to the MMC data to read from or write to the
  * given DMA address.
- * Please note, that the table size depends on CONFIG_SYS_MMC_MAX_BLK_COUNT and
- * we don't have to check for overflow.
+ * Please note, that the transfer size is limited to ADMA_MAX_BLK_COUNT blocks,
+ * which the table covers, so we don't have to check for overflow.
  */
 void sdhci_prepare_adma_table(struct sdhci_host *host,
 			      struct sdhci_adma_desc *table,
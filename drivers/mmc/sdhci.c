@@ -8,6 +8,7 @@
  */
 
 #include <cpu_func.h>
+#include <cqhci.h>
 #include <dm.h>
 #include <errno.h>
 #include <log.h>
@@ -853,6 +854,47 @@ const struct dm_mmc_ops sdhci_ops = {
 	.set_enhanced_strobe = sdhci_set_enhanced_strobe,
 #endif
 };
+
+#if CONFIG_IS_ENABLED(MMC_CQHCI)
+static void sdhci_cqe_enable(struct mmc *mmc)
+{
+	struct sdhci_host *host = mmc->priv;
+	u8 ctrl;
+
+	/* the engine moves the data of each task with ADMA2 */
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	if (host->flags & USE_ADMA64)
+		ctrl |= SDHCI_CTRL_ADMA64;
+	else
+		ctrl |= SDHCI_CTRL_ADMA32;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG, 512),
+		     SDHCI_BLOCK_SIZE);
+	sdhci_writeb(host, 0xe, SDHCI_TIMEOUT_CONTROL);
+
+	/* completions are polled in the engine, so only errors are kept */
+	sdhci_writel(host, SDHCI_INT_CQE | SDHCI_INT_ERROR_MASK,
+		     SDHCI_INT_ENABLE);
+}
+
+static void sdhci_cqe_disable(struct mmc *mmc)
+{
+	struct sdhci_host *host = mmc->priv;
+
+	sdhci_writel(host, SDHCI_INT_DATA_MASK | SDHCI_INT_CMD_MASK,
+		     SDHCI_INT_ENABLE);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+	sdhci_reset(host, SDHCI_RESET_CMD);
+	sdhci_reset(host, SDHCI_RESET_DATA);
+}
+
+const struct cqhci_host_ops sdhci_cqhci_ops = {
+	.enable		= sdhci_cqe_enable,
+	.disable	= sdhci_cqe_disable,
+};
+#endif
 #else
 static const struct mmc_ops sdhci_ops = {
 	.send_cmd	= sdhci_send_command,
@@ -1021,6 +1063,13 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		cfg->host_caps |= host->host_caps;
 
 	cfg->b_max = CONFIG_SYS_MMC_MAX_BLK_COUNT;
+	if (CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+		cfg->b_max = min_t(uint, cfg->b_max, ADMA_MAX_BLK_COUNT);
+
+	/* Transfers can then be sized up front, with no STOP_TRANSMISSION */
+	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300 &&
+	    !(host->quirks & SDHCI_QUIRK_BROKEN_CMD23))
+		cfg->host_caps |= MMC_CAP_CMD23;
 
 	return 0;
 }
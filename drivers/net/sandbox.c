@@ -424,14 +424,19 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	return priv->tx_handler(dev, packet, length);
 }
 
-static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+static void sb_eth_check_skip_timeout(void)
 {
-	struct eth_sandbox_priv *priv = dev_get_priv(dev);
-
 	if (skip_timeout) {
 		timer_test_add_offset(11000UL);
 		skip_timeout = false;
 	}
+}
+
+static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	sb_eth_check_skip_timeout();
 
 	if (priv->recv_packets) {
 		int lcl_recv_packet_length = priv->recv_packet_length[0];
@@ -453,6 +458,8 @@ static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 		return 0;
 
 	--priv->recv_packets;
+	priv->recv_frees++;
+	priv->recv_copies += priv->recv_packets;
 	for (i = 0; i < priv->recv_packets; i++) {
 		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
 		memcpy(priv->recv_packet_buffer[i],
@@ -464,6 +471,55 @@ static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	return 0;
 }
 
+static int sb_eth_recv_batch(struct udevice *dev, int flags,
+			     struct eth_rx_pkt *pkts, int count)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i;
+
+	sb_eth_check_skip_timeout();
+
+	count = min(count, priv->recv_packets);
+	for (i = 0; i < count; i++) {
+		pkts[i].packet = priv->recv_packet_buffer[i];
+		pkts[i].length = priv->recv_packet_length[i];
+	}
+	if (count) {
+		debug("eth_sandbox: received %d packets, %d waiting\n", count,
+		      priv->recv_packets - count);
+		priv->recv_batches++;
+	}
+
+	return count;
+}
+
+static int sb_eth_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts,
+			     int count)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i;
+
+	count = min(count, priv->recv_packets);
+	if (!count)
+		return 0;
+	priv->recv_packets -= count;
+	priv->recv_frees++;
+	priv->recv_copies += priv->recv_packets;
+
+	/* move up anything queued while the batch was processed */
+	for (i = 0; i < priv->recv_packets; i++) {
+		priv->recv_packet_length[i] =
+			priv->recv_packet_length[i + count];
+		memcpy(priv->recv_packet_buffer[i],
+		       priv->recv_packet_buffer[i + count],
+		       priv->recv_packet_length[i]);
+	}
+	for (; i < priv->recv_packets + count; i++)
+		priv->recv_packet_length[i] = 0;
+
+	return 0;
+}
+
 static void sb_eth_stop(struct udevice *dev)
 {
 	debug("eth_sandbox: Stop\n");
@@ -481,6 +537,18 @@ static int sb_eth_write_hwaddr(struct udevice *dev)
 }
 
 static const struct eth_ops sb_eth_ops = {
+	.start			= sb_eth_start,
+	.send			= sb_eth_send,
+	.recv			= sb_eth_recv,
+	.free_pkt		= sb_eth_free_pkt,
+	.recv_batch		= sb_eth_recv_batch,
+	.free_batch		= sb_eth_free_batch,
+	.stop			= sb_eth_stop,
+	.write_hwaddr		= sb_eth_write_hwaddr,
+};
+
+/* Without the batch methods, so that eth_rx() takes one packet at a time */
+static const struct eth_ops sb_eth_single_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
@@ -521,3 +589,19 @@ U_BOOT_DRIVER(eth_sandbox) = {
 	.priv_auto	= sizeof(struct eth_sandbox_priv),
 	.plat_auto	= sizeof(struct eth_pdata),
 };
+
+static const struct udevice_id sb_eth_single_ids[] = {
+	{ .compatible = "sandbox,eth-single" },
+	{ }
+};
+
+U_BOOT_DRIVER(eth_sandbox_single) = {
+	.name	= "eth_sandbox_single",
+	.id	= UCLASS_ETH,
+	.of_match = sb_eth_single_ids,
+	.of_to_plat = sb_eth_of_to_plat,
+	.remove	= sb_eth_remove,
+	.ops	= &sb_eth_single_ops,
+	.priv_auto	= sizeof(struct eth_sandbox_priv),
+	.plat_auto	= sizeof(struct eth_pdata),
+};
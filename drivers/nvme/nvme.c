@@ -15,9 +15,11 @@
 #include <time.h>
 #include <dm/device-internal.h>
 #include <linux/compat.h>
+#include <linux/time.h>
+#include <u-boot/schedule.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		32
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -25,7 +27,6 @@
 				      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -39,13 +40,28 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	while (get_timer(start) < timeout) {
 		if ((readl(&dev->bar->csts) & mask) == val)
 			return 0;
+		schedule();
 	}
 
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - Describe a transfer by PRP entries
+ *
+ * The first page is covered by PRP1 in the command, so a transfer of up to two
+ * pages needs no list. Longer ones use the PRP list of the slot, where the
+ * last entry of each full list page points to the next page.
+ *
+ * @dev:	NVMe device
+ * @slot:	Slot of the command
+ * @prp2:	Returns the PRP2 entry of the command
+ * @total_len:	Number of bytes to transfer, at most the maximum transfer size
+ * @dma_addr:	Start of the buffer
+ * Return: 0 if OK, -ENOMEM if the PRP list could not be allocated
+ */
+static int nvme_setup_prps(struct nvme_dev *dev, struct nvme_io_slot *slot,
+			   u64 *prp2, int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -70,40 +86,38 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 		return 0;
 	}
 
-	nprps = DIV_ROUND_UP(length, page_size);
-	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
-
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
+	if (!slot->prp_list) {
 		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
+		 * Size the list for the largest transfer, so that it is only
+		 * allocated once
 		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
+		nprps = (1U << dev->max_transfer_shift) / page_size;
+		num_pages = DIV_ROUND_UP(nprps, prps_per_page - 1);
+		slot->prp_list = memalign(page_size, num_pages * page_size);
+		if (!slot->prp_list) {
 			printf("Error: malloc prp_pool fail\n");
 			return -ENOMEM;
 		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
 	}
 
-	prp_pool = dev->prp_pool;
+	nprps = DIV_ROUND_UP(length, page_size);
+	prp_pool = slot->prp_list;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
-			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
-					page_size);
+			*(prp_pool + i) = cpu_to_le64((ulong)(prp_pool +
+							      prps_per_page));
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)slot->prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
-			   num_pages * page_size);
+	flush_dcache_range((ulong)slot->prp_list,
+			   (ulong)(prp_pool + prps_per_page));
 
 	return 0;
 }
@@ -650,15 +664,8 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 		 * and is reported as a power of two (2^n).
 		 *
 		 * The spec also says: a value of 0h indicates no restrictions
-		 * on transfer size. But in nvme_blk_read/write() below we have
-		 * the following algorithm for maximum number of logic blocks
-		 * per transfer:
-		 *
-		 * u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-		 *
-		 * In order for lbas not to overflow, the maximum number is 15
-		 * which means dev->max_transfer_shift = 15 + 9 (ns->lba_shift).
-		 * Let's use 20 which provides 1MB size.
+		 * on transfer size. But the PRP list of each I/O slot is sized
+		 * for the maximum transfer, so use 20 which provides 1MB size.
 		 */
 		dev->max_transfer_shift = 20;
 	}
@@ -741,65 +748,259 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+/* Number of blocks one command on @ns may transfer */
+static u32 nvme_max_lbas(struct nvme_ns *ns)
 {
-	struct nvme_ns *ns = dev_get_priv(udev);
-	struct nvme_dev *dev = ns->dev;
+	/* the Number of Logical Blocks field is 16 bits, zero-based */
+	return 1U << min_t(u32, ns->dev->max_transfer_shift - ns->lba_shift,
+			   16);
+}
+
+/**
+ * nvme_io_end() - Finish a request if none of its commands is outstanding
+ *
+ * @dev:	NVMe device
+ * @req:	Request to check
+ * Return: 1 if the request was finished, 0 if not
+ */
+static int nvme_io_end(struct nvme_dev *dev, struct blk_request *req)
+{
+	struct nvme_ns *ns = dev_get_priv(req->dev);
+	int i;
+
+	if (!list_empty(&req->sibling))
+		return 0;
+	for (i = 0; i < dev->io_depth; i++) {
+		if (dev->io_slots[i].req == req)
+			return 0;
+	}
+
+	if (req->op == BLK_REQ_READ)
+		invalidate_dcache_range((ulong)req->buffer,
+					(ulong)req->buffer +
+					(req->blkcnt << ns->lba_shift));
+	blk_req_complete(req, req->result);
+
+	return 1;
+}
+
+/**
+ * nvme_io_issue() - Put commands for the pending requests on the I/O queue
+ *
+ * Each request is split into commands of at most the maximum transfer size,
+ * which are queued while there are free slots. The doorbell is rung once for
+ * all the commands added.
+ *
+ * @dev:	NVMe device
+ * Return: number of requests finished, because a command could not be set up
+ */
+static int nvme_io_issue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	struct nvme_io_slot *slot;
+	struct blk_request *req;
 	struct nvme_command c;
-	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
-	u64 prp2;
-	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
-	uintptr_t temp_buffer = (uintptr_t)buffer;
-
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
-
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
-
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+	struct nvme_ns *ns;
+	bool queued = false;
+	int i, done = 0;
+	u64 buf, prp2;
+	u32 lbas;
+
+	while (!list_empty(&dev->io_pending) &&
+	       dev->io_inflight < dev->io_depth) {
+		req = list_first_entry(&dev->io_pending, struct blk_request,
+				       sibling);
+		ns = dev_get_priv(req->dev);
+		lbas = min_t(u64, req->blkcnt - dev->io_issued,
+			     nvme_max_lbas(ns));
+		buf = (ulong)req->buffer + (dev->io_issued << ns->lba_shift);
+
+		for (i = 0; dev->io_slots[i].req; i++)
+			;
+		slot = &dev->io_slots[i];
+		if (nvme_setup_prps(dev, slot, &prp2, lbas << ns->lba_shift,
+				    buf)) {
+			/* the commands already issued are still waited for */
+			req->result = -ENOMEM;
+			list_del_init(&req->sibling);
+			dev->io_issued = 0;
+			done += nvme_io_end(dev, req);
+			continue;
 		}
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
+		memset(&c, 0, sizeof(c));
+		c.rw.opcode = req->op == BLK_REQ_WRITE ? nvme_cmd_write :
+			nvme_cmd_read;
+		c.rw.command_id = cpu_to_le16(i);
+		c.rw.nsid = cpu_to_le32(ns->ns_id);
+		c.rw.slba = cpu_to_le64(req->start + dev->io_issued);
 		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
+		c.rw.prp1 = cpu_to_le64(buf);
 		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+
+		slot->req = req;
+		slot->blkcnt = lbas;
+		dev->io_inflight++;
+		dev->io_issued += lbas;
+		if (dev->io_issued == req->blkcnt) {
+			list_del_init(&req->sibling);
+			dev->io_issued = 0;
+		}
+
+		dev->io_time = timer_get_us();
+		if (ops && ops->submit_cmd) {
+			nvme_submit_cmd(nvmeq, &c);
+			continue;
+		}
+		memcpy(&nvmeq->sq_cmds[nvmeq->sq_tail], &c, sizeof(c));
+		flush_dcache_range((ulong)&nvmeq->sq_cmds[nvmeq->sq_tail],
+				   (ulong)&nvmeq->sq_cmds[nvmeq->sq_tail] +
+				   sizeof(c));
+		if (++nvmeq->sq_tail == nvmeq->q_depth)
+			nvmeq->sq_tail = 0;
+		queued = true;
+	}
+
+	if (queued)
+		writel(nvmeq->sq_tail, nvmeq->q_db);
+
+	return done;
+}
+
+/**
+ * nvme_io_abort() - Give up on all the I/O requests
+ *
+ * @dev:	NVMe device
+ * @err:	Error to finish the requests with
+ * Return: number of requests finished
+ */
+static int nvme_io_abort(struct nvme_dev *dev, int err)
+{
+	struct blk_request *req, *next;
+	LIST_HEAD(pending);
+	int i, done = 0;
+
+	list_splice_init(&dev->io_pending, &pending);
+	dev->io_issued = 0;
+	list_for_each_entry_safe(req, next, &pending, sibling) {
+		list_del_init(&req->sibling);
+		req->result = err;
+		done += nvme_io_end(dev, req);
+	}
+
+	for (i = 0; i < dev->io_depth; i++) {
+		req = dev->io_slots[i].req;
+		if (!req)
+			continue;
+		req->result = err;
+		dev->io_slots[i].req = NULL;
+		dev->io_inflight--;
+		done += nvme_io_end(dev, req);
+	}
+
+	return done;
+}
+
+static int nvme_blk_submit(struct udevice *udev, struct blk_request *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+
+	if (!req->blkcnt) {
+		blk_req_complete(req, 0);
+		return 0;
+	}
+
+	flush_dcache_range((ulong)req->buffer,
+			   (ulong)req->buffer + (req->blkcnt << ns->lba_shift));
+	list_add_tail(&req->sibling, &dev->io_pending);
+	nvme_io_issue(dev);
+
+	return 0;
+}
+
+/*
+ * All the completions posted so far are handled before the head doorbell is
+ * written, once for them all. The slots freed are then given to the commands
+ * still pending.
+ */
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	struct nvme_io_slot *slot;
+	struct blk_request *req;
+	int count = 0, done = 0;
+	u16 status, id;
+
+	if (!dev->io_inflight)
+		return nvme_io_issue(dev);
+
+	invalidate_dcache_range((ulong)nvmeq->cqes,
+				(ulong)nvmeq->cqes + NVME_CQ_ALLOCATION);
+	for (;;) {
+		status = readw(&nvmeq->cqes[nvmeq->cq_head].status);
+		if ((status & 0x01) != nvmeq->cq_phase)
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+		id = readw(&nvmeq->cqes[nvmeq->cq_head].command_id);
+
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq,
+					  &nvmeq->sq_cmds[nvmeq->sq_tail]);
+		if (++nvmeq->cq_head == nvmeq->q_depth) {
+			nvmeq->cq_head = 0;
+			nvmeq->cq_phase = !nvmeq->cq_phase;
+		}
+		count++;
+
+		if (id >= dev->io_depth || !dev->io_slots[id].req)
+			continue;
+		slot = &dev->io_slots[id];
+		req = slot->req;
+		slot->req = NULL;
+		dev->io_inflight--;
+
+		status >>= 1;
+		if (status) {
+			printf("ERROR: status = %x, command %d\n", status, id);
+			req->result = -EIO;
+		} else if (req->result >= 0) {
+			req->result += slot->blkcnt;
+		}
+		done += nvme_io_end(dev, req);
+	}
+
+	if (count) {
+		writel(nvmeq->cq_head, nvmeq->q_db + dev->db_stride);
+		dev->io_time = timer_get_us();
+	} else if (timer_get_us() - dev->io_time >= IO_TIMEOUT * USEC_PER_SEC) {
+		printf("Error: %s: I/O timed out\n", dev->udev->name);
+		return nvme_io_abort(dev, -ETIMEDOUT);
 	}
 
-	if (read)
-		invalidate_dcache_range((unsigned long)buffer,
-					(unsigned long)buffer + total_len);
+	return done + nvme_io_issue(dev);
+}
 
-	return (total_len - temp_len) >> desc->log2blksz;
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct blk_request req = {
+		.dev	= udev,
+		.op	= read ? BLK_REQ_READ : BLK_REQ_WRITE,
+		.start	= blknr,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
+
+	/* the commands of a large transfer are kept in flight together */
+	nvme_blk_submit(udev, &req);
+	while (!req.done)
+		nvme_blk_poll(udev);
+
+	return req.result;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -817,6 +1018,8 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -831,10 +1034,12 @@ int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
 	struct nvme_id_ns *id;
+	struct nvme_ops *ops;
 	int ret;
 
 	ndev->udev = udev;
 	INIT_LIST_HEAD(&ndev->namespaces);
+	INIT_LIST_HEAD(&ndev->io_pending);
 	if (readl(&ndev->bar->csts) == -1) {
 		ret = -EBUSY;
 		printf("Error: %s: Controller not ready!\n", udev->name);
@@ -860,21 +1065,29 @@ int nvme_init(struct udevice *udev)
 		goto free_queue;
 	}
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret) {
 		log_debug("Unable to setup I/O queues(err=%dE)\n", ret);
 		goto free_queue;
 	}
 
+	/*
+	 * One slot stays empty to tell a full submission queue from an empty
+	 * one. A controller-specific submission completes each command before
+	 * the next, so it gets only one.
+	 */
+	ops = (struct nvme_ops *)udev->driver->ops;
+	if (ops && ops->submit_cmd)
+		ndev->io_depth = 1;
+	else
+		ndev->io_depth = ndev->queues[NVME_IO_Q]->q_depth - 1;
+	ndev->io_slots = calloc(ndev->io_depth, sizeof(struct nvme_io_slot));
+	if (!ndev->io_slots) {
+		ret = -ENOMEM;
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	nvme_get_info_from_identify(ndev);
 
 	/* Create a blk device for each namespace */
@@ -882,7 +1095,7 @@ int nvme_init(struct udevice *udev)
 	id = memalign(ndev->page_size, sizeof(struct nvme_id_ns));
 	if (!id) {
 		ret = -ENOMEM;
-		goto free_queue;
+		goto free_slots;
 	}
 
 	for (int i = 1; i <= ndev->nn; i++) {
@@ -927,6 +1140,10 @@ int nvme_init(struct udevice *udev)
 
 free_id:
 	free(id);
+free_slots:
+	for (int i = 0; i < ndev->io_depth; i++)
+		free(ndev->io_slots[i].prp_list);
+	free(ndev->io_slots);
 free_queue:
 	free((void *)ndev->queues);
 free_nvme:
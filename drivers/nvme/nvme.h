@@ -594,6 +594,25 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+struct blk_request;
+
+/**
+ * struct nvme_io_slot - An I/O command in flight
+ *
+ * The index of the slot is used as the command ID, so that the completion
+ * leads back to it.
+ *
+ * @req: Block request the command is part of, NULL if the slot is free
+ * @blkcnt: Number of blocks transferred by the command
+ * @prp_list: PRP list pages for a transfer of the maximum size, allocated
+ *	when a command first needs them
+ */
+struct nvme_io_slot {
+	struct blk_request *req;
+	u32 blkcnt;
+	u64 *prp_list;
+};
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct udevice *udev;
@@ -618,9 +637,16 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
 	u32 nn;
+	/* I/O commands in flight, io_depth slots in all */
+	struct nvme_io_slot *io_slots;
+	int io_depth;
+	int io_inflight;
+	/* Requests with commands still to be issued, the first partly issued */
+	struct list_head io_pending;
+	u64 io_issued;
+	/* Time of the last I/O progress, in microseconds */
+	ulong io_time;
 };
 
 /* Admin queue and a single I/O queue. */
@@ -8,13 +8,40 @@
 
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
+#include <linux/list.h>
 #include <linux/log2.h>
+#include <linux/sizes.h>
 #include "virtio_blk.h"
 
+/* Largest request, so that a big transfer is spread over several in flight */
+#define VIRTIO_BLK_REQ_SIZE	SZ_1M
+/* Most data segments in one request */
+#define VIRTIO_BLK_SEG_MAX	32
+
+/**
+ * struct virtio_blk_req - a virtio-blk request in flight
+ *
+ * A block request is split into as many of these as its size needs.
+ */
+struct virtio_blk_req {
+	/**
+	 * @out_hdr - request header, first so that the buffer handed back by
+	 * the virtqueue leads to the request
+	 */
+	struct virtio_blk_outhdr out_hdr;
+	/** @req - block request this is part of, NULL if free */
+	struct blk_request *req;
+	/** @blkcnt - number of blocks transferred */
+	lbaint_t blkcnt;
+	/** @status - status written by the device */
+	u8 status;
+};
+
 /**
  * struct virtio_blk_priv - private data for virtio block device
  */
@@ -23,11 +50,30 @@ struct virtio_blk_priv {
 	struct virtqueue *vq;
 	/** @blksz_shift - log2 of block size divided by 512 */
 	u32 blksz_shift;
+	/** @seg_max - most data segments in a request */
+	u32 seg_max;
+	/** @size_max - most bytes in a data segment */
+	u32 size_max;
+	/** @req_blks - most blocks in a request */
+	lbaint_t req_blks;
+	/** @reqs - requests, one for each descriptor of the virtqueue */
+	struct virtio_blk_req *reqs;
+	/** @num_reqs - number of requests */
+	int num_reqs;
+	/** @inflight - number of requests in flight */
+	int inflight;
+	/** @pending - block requests not yet all in flight */
+	struct list_head pending;
+	/** @issued - blocks of the first pending block request in flight */
+	lbaint_t issued;
 };
 
 static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+	VIRTIO_BLK_F_SEG_MAX,
 	VIRTIO_BLK_F_BLK_SIZE,
-	VIRTIO_BLK_F_WRITE_ZEROES
+	VIRTIO_BLK_F_WRITE_ZEROES,
+	VIRTIO_RING_F_INDIRECT_DESC,
 };
 
 static void virtio_blk_init_header_sg(struct udevice *dev, u64 sector, u32 type,
@@ -61,89 +107,206 @@ static void virtio_blk_init_status_sg(u8 *status, struct virtio_sg *sg)
 	sg->length = sizeof(*status);
 }
 
-static void virtio_blk_init_data_sg(void *buffer, lbaint_t blkcnt, struct virtio_sg *sg)
+/* Finish @req if it is all in flight and none of it is still outstanding */
+static int virtio_blk_end(struct virtio_blk_priv *priv, struct blk_request *req)
 {
-	sg->addr = buffer;
-	sg->length = blkcnt * 512;
+	int i;
+
+	if (!list_empty(&req->sibling))
+		return 0;
+	for (i = 0; i < priv->num_reqs; i++) {
+		if (priv->reqs[i].req == req)
+			return 0;
+	}
+	blk_req_complete(req, req->result);
+
+	return 1;
 }
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+/**
+ * virtio_blk_issue() - Put the pending block requests on the virtqueue
+ *
+ * Each block request is split into requests of at most @req_blks blocks,
+ * which are added while the virtqueue has room. The device is kicked once for
+ * all of them.
+ *
+ * @dev:	virtio-blk device
+ */
+static void virtio_blk_issue(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	struct virtio_blk_outhdr out_hdr;
-	struct virtio_blk_discard_write_zeroes wz_hdr;
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg hdr_sg, wz_sg, data_sg, status_sg;
-	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct virtio_sg sg[VIRTIO_BLK_SEG_MAX + 2];
+	struct virtio_sg *sgs[VIRTIO_BLK_SEG_MAX + 2];
+	struct virtio_blk_req *vreq;
+	struct blk_request *req;
+	unsigned int n, num_out;
+	lbaint_t blkcnt;
+	bool added = false;
+	size_t len;
+	void *buf;
+	u32 type;
+	int i;
+
+	while (!list_empty(&priv->pending) && priv->inflight < priv->num_reqs) {
+		req = list_first_entry(&priv->pending, struct blk_request,
+				       sibling);
+		blkcnt = min(req->blkcnt - priv->issued, priv->req_blks);
+		for (i = 0; priv->reqs[i].req; i++)
+			;
+		vreq = &priv->reqs[i];
+
+		type = req->op == BLK_REQ_WRITE ? VIRTIO_BLK_T_OUT :
+			VIRTIO_BLK_T_IN;
+		virtio_blk_init_header_sg(dev, (req->start + priv->issued) <<
+					  priv->blksz_shift, type,
+					  &vreq->out_hdr, &sg[0]);
+		buf = req->buffer + (priv->issued << desc->log2blksz);
+		len = blkcnt << desc->log2blksz;
+		for (n = 1; len; n++) {
+			sg[n].addr = buf;
+			sg[n].length = min_t(size_t, len, priv->size_max);
+			buf += sg[n].length;
+			len -= sg[n].length;
+		}
+		virtio_blk_init_status_sg(&vreq->status, &sg[n++]);
+		for (i = 0; i < n; i++)
+			sgs[i] = &sg[i];
+
+		num_out = type == VIRTIO_BLK_T_OUT ? n - 1 : 1;
+		/* with the ring full, wait for some requests to finish */
+		if (virtqueue_add(priv->vq, sgs, num_out, n - num_out))
+			break;
+		added = true;
+
+		vreq->req = req;
+		vreq->blkcnt = blkcnt;
+		priv->inflight++;
+		priv->issued += blkcnt;
+		if (priv->issued == req->blkcnt) {
+			list_del_init(&req->sibling);
+			priv->issued = 0;
+		}
+	}
 
-	sector <<= priv->blksz_shift;
-	blkcnt <<= priv->blksz_shift;
-	virtio_blk_init_header_sg(dev, sector, type, &out_hdr, &hdr_sg);
-	sgs[num_out++] = &hdr_sg;
-
-	switch (type) {
-	case VIRTIO_BLK_T_IN:
-	case VIRTIO_BLK_T_OUT:
-		virtio_blk_init_data_sg(buffer, blkcnt, &data_sg);
-		if (type & VIRTIO_BLK_T_OUT)
-			sgs[num_out++] = &data_sg;
-		else
-			sgs[num_out + num_in++] = &data_sg;
-		break;
-
-	case VIRTIO_BLK_T_WRITE_ZEROES:
-		virtio_blk_init_write_zeroes_sg(dev, sector, blkcnt, &wz_hdr, &wz_sg);
-		sgs[num_out++] = &wz_sg;
-		break;
-
-	default:
-		return -EINVAL;
+	if (added)
+		virtqueue_kick(priv->vq);
+}
+
+static int virtio_blk_submit(struct udevice *dev, struct blk_request *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+
+	if (!req->blkcnt) {
+		blk_req_complete(req, 0);
+		return 0;
 	}
 
-	virtio_blk_init_status_sg(&status, &status_sg);
-	sgs[num_out + num_in++] = &status_sg;
-	log_debug("dev=%s, active=%d, priv=%p, priv->vq=%p\n", dev->name,
-		  device_active(dev), priv, priv->vq);
+	list_add_tail(&req->sibling, &priv->pending);
+	virtio_blk_issue(dev);
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
-		return ret;
+	return 0;
+}
 
-	virtqueue_kick(priv->vq);
+/* All the used buffers are taken before the freed room is filled again */
+static int virtio_blk_poll(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr *out_hdr;
+	struct virtio_blk_req *vreq;
+	struct blk_request *req;
+	int done = 0;
+
+	while ((out_hdr = virtqueue_get_buf(priv->vq, NULL))) {
+		vreq = container_of(out_hdr, struct virtio_blk_req, out_hdr);
+		req = vreq->req;
+		if (!req)
+			continue;
+		vreq->req = NULL;
+		priv->inflight--;
+
+		if (vreq->status != VIRTIO_BLK_S_OK)
+			req->result = -EIO;
+		else if (req->result >= 0)
+			req->result += vreq->blkcnt;
+		done += virtio_blk_end(priv, req);
+	}
+	virtio_blk_issue(dev);
 
-	log_debug("wait...");
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
-	log_debug("done\n");
+	return done;
+}
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt >> priv->blksz_shift : -EIO;
+static ulong virtio_blk_do_req(struct udevice *dev, lbaint_t start,
+			       lbaint_t blkcnt, void *buffer,
+			       enum blk_req_op op)
+{
+	struct blk_request req = {
+		.dev	= dev,
+		.op	= op,
+		.start	= start,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
+
+	/* the requests of a large transfer are kept in flight together */
+	virtio_blk_submit(dev, &req);
+	while (!req.done)
+		virtio_blk_poll(dev);
+
+	return req.result;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
 			     lbaint_t blkcnt, void *buffer)
 {
 	log_debug("read %s\n", dev->name);
-	return virtio_blk_do_req(dev, start, blkcnt, buffer,
-				 VIRTIO_BLK_T_IN);
+	return virtio_blk_do_req(dev, start, blkcnt, buffer, BLK_REQ_READ);
 }
 
 static ulong virtio_blk_write(struct udevice *dev, lbaint_t start,
 			      lbaint_t blkcnt, const void *buffer)
 {
 	return virtio_blk_do_req(dev, start, blkcnt, (void *)buffer,
-				 VIRTIO_BLK_T_OUT);
+				 BLK_REQ_WRITE);
 }
 
 static ulong virtio_blk_erase(struct udevice *dev, lbaint_t start,
 			      lbaint_t blkcnt)
 {
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	struct virtio_blk_outhdr out_hdr;
+	struct virtio_blk_discard_write_zeroes wz_hdr;
+	struct virtio_sg hdr_sg, wz_sg, status_sg;
+	struct virtio_sg *sgs[] = { &hdr_sg, &wz_sg, &status_sg };
+	u8 status;
+	int ret;
+
 	if (!virtio_has_feature(dev, VIRTIO_BLK_F_WRITE_ZEROES))
 		return -EOPNOTSUPP;
 
-	return virtio_blk_do_req(dev, start, blkcnt, NULL, VIRTIO_BLK_T_WRITE_ZEROES);
+	/* the used buffers must all be for this one */
+	while (priv->inflight || !list_empty(&priv->pending))
+		virtio_blk_poll(dev);
+
+	start <<= priv->blksz_shift;
+	blkcnt <<= priv->blksz_shift;
+	virtio_blk_init_header_sg(dev, start, VIRTIO_BLK_T_WRITE_ZEROES,
+				  &out_hdr, &hdr_sg);
+	virtio_blk_init_write_zeroes_sg(dev, start, blkcnt, &wz_hdr, &wz_sg);
+	virtio_blk_init_status_sg(&status, &status_sg);
+
+	ret = virtqueue_add(priv->vq, sgs, 2, 1);
+	if (ret)
+		return ret;
+
+	virtqueue_kick(priv->vq);
+
+	log_debug("wait...");
+	while (!virtqueue_get_buf(priv->vq, NULL))
+		;
+	log_debug("done\n");
+
+	return status == VIRTIO_BLK_S_OK ? blkcnt >> priv->blksz_shift : -EIO;
 }
 
 static int virtio_blk_bind(struct udevice *dev)
@@ -185,6 +348,7 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	unsigned int num;
 	u64 cap;
 	int ret;
 	u32 blk_size;
@@ -207,13 +371,52 @@ static int virtio_blk_probe(struct udevice *dev)
 	priv->blksz_shift = desc->log2blksz - 9;
 	desc->lba >>= priv->blksz_shift;
 
+	/*
+	 * Without an indirect table a request takes a descriptor for each
+	 * segment, plus the header and the status
+	 */
+	num = virtqueue_get_vring_size(priv->vq);
+	priv->seg_max = 1;
+	if (virtio_has_feature(dev, VIRTIO_BLK_F_SEG_MAX))
+		virtio_cread(dev, struct virtio_blk_config, seg_max,
+			     &priv->seg_max);
+	priv->seg_max = clamp(priv->seg_max, 1U,
+			      min_t(u32, VIRTIO_BLK_SEG_MAX, num - 2));
+	priv->size_max = U32_MAX;
+	if (virtio_has_feature(dev, VIRTIO_BLK_F_SIZE_MAX))
+		virtio_cread(dev, struct virtio_blk_config, size_max,
+			     &priv->size_max);
+	priv->size_max = max_t(u32, priv->size_max, desc->blksz);
+	priv->req_blks = min_t(u64, VIRTIO_BLK_REQ_SIZE,
+			       (u64)priv->seg_max * priv->size_max) >>
+			 desc->log2blksz;
+
+	priv->num_reqs = num;
+	priv->reqs = calloc(num, sizeof(struct virtio_blk_req));
+	if (!priv->reqs)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&priv->pending);
+
 	return 0;
 }
 
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	ret = virtio_reset(dev);
+	free(priv->reqs);
+
+	return ret;
+}
+
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
 	.erase	= virtio_blk_erase,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -222,7 +425,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
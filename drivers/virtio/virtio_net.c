@@ -5,15 +5,13 @@
  */
 
 #include <dm.h>
+#include <malloc.h>
 #include <net.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
 #include "virtio_net.h"
 
-/* Amount of buffers to keep in the RX virtqueue */
-#define VIRTIO_NET_NUM_RX_BUFS	32
-
 /*
  * This value comes from the VirtIO spec: 1500 for maximum packet size,
  * 14 for the Ethernet header, 12 for virtio_net_hdr. In total 1526 bytes.
@@ -29,22 +27,29 @@ struct virtio_net_priv {
 		};
 	};
 
-	char rx_buff[VIRTIO_NET_NUM_RX_BUFS][VIRTIO_NET_RX_BUF_SIZE];
+	char (*rx_buff)[VIRTIO_NET_RX_BUF_SIZE];
+	unsigned int rx_num;
 	bool rx_running;
 	int net_hdr_len;
+	/* packets from the last recv_batch(), not yet given back */
+	struct eth_rx_pkt rx_batch[ETH_PACKETS_BATCH_RECV];
+	int rx_batch_len;
 };
 
 /*
- * For simplicity, the driver only negotiates the VIRTIO_NET_F_MAC feature.
- * For the VIRTIO_NET_F_STATUS feature, we don't negotiate it, hence per spec
- * we should assume the link is always active.
+ * For simplicity, the driver only negotiates the VIRTIO_NET_F_MAC feature,
+ * and VIRTIO_RING_F_EVENT_IDX so that the device only asks for a kick when it
+ * has run out of buffers. For the VIRTIO_NET_F_STATUS feature, we don't
+ * negotiate it, hence per spec we should assume the link is always active.
  */
 static const u32 feature[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+	VIRTIO_RING_F_EVENT_IDX,
 };
 
 static const u32 feature_legacy[] = {
-	VIRTIO_NET_F_MAC
+	VIRTIO_NET_F_MAC,
+	VIRTIO_RING_F_EVENT_IDX,
 };
 
 static int virtio_net_start(struct udevice *dev)
@@ -59,7 +64,7 @@ static int virtio_net_start(struct udevice *dev)
 		sg.length = VIRTIO_NET_RX_BUF_SIZE;
 
 		/* setup the receive buffer address */
-		for (i = 0; i < VIRTIO_NET_NUM_RX_BUFS; i++) {
+		for (i = 0; i < priv->rx_num; i++) {
 			sg.addr = priv->rx_buff[i];
 			virtqueue_add(priv->rx_vq, sgs, 0, 1);
 		}
@@ -111,6 +116,15 @@ static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 	unsigned int len;
 	void *buf;
 
+	/* packets left over from a batch come first */
+	if (priv->rx_batch_len) {
+		*packetp = priv->rx_batch[0].packet;
+		len = priv->rx_batch[0].length;
+		memmove(priv->rx_batch, priv->rx_batch + 1,
+			--priv->rx_batch_len * sizeof(priv->rx_batch[0]));
+		return len;
+	}
+
 	buf = virtqueue_get_buf(priv->rx_vq, &len);
 	if (!buf)
 		return -EAGAIN;
@@ -119,22 +133,83 @@ static int virtio_net_recv(struct udevice *dev, int flags, uchar **packetp)
 	return len - priv->net_hdr_len;
 }
 
-static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
+/* Put the buffer of a packet back to the rx ring, without telling the device */
+static void virtio_net_refill(struct udevice *dev, uchar *packet)
 {
 	struct virtio_net_priv *priv = dev_get_priv(dev);
 	void *buf = packet - priv->net_hdr_len;
 	struct virtio_sg sg = { buf, VIRTIO_NET_RX_BUF_SIZE };
 	struct virtio_sg *sgs[] = { &sg };
 
-	/* Put the buffer back to the rx ring */
 	virtqueue_add(priv->rx_vq, sgs, 0, 1);
+}
+
+static int virtio_net_free_pkt(struct udevice *dev, uchar *packet, int length)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+
+	virtio_net_refill(dev, packet);
 	virtqueue_kick(priv->rx_vq);
 
 	return 0;
 }
 
+static int virtio_net_recv_batch(struct udevice *dev, int flags,
+				 struct eth_rx_pkt *pkts, int count)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	unsigned int len;
+	void *buf;
+	int n;
+
+	/* packets which were not processed last time are still ours */
+	n = min(count, priv->rx_batch_len);
+	for (; n < count && priv->rx_batch_len < ARRAY_SIZE(priv->rx_batch);
+	     n++) {
+		buf = virtqueue_get_buf(priv->rx_vq, &len);
+		if (!buf)
+			break;
+		priv->rx_batch[n].packet = buf + priv->net_hdr_len;
+		priv->rx_batch[n].length = len - priv->net_hdr_len;
+		priv->rx_batch_len++;
+	}
+	memcpy(pkts, priv->rx_batch, n * sizeof(*pkts));
+
+	return n;
+}
+
+static int virtio_net_free_batch(struct udevice *dev, struct eth_rx_pkt *pkts,
+				 int count)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int i;
+
+	count = min(count, priv->rx_batch_len);
+	for (i = 0; i < count; i++)
+		virtio_net_refill(dev, pkts[i].packet);
+	priv->rx_batch_len -= count;
+	memmove(priv->rx_batch, priv->rx_batch + count,
+		priv->rx_batch_len * sizeof(priv->rx_batch[0]));
+
+	/* a single notification for the whole batch, if the device wants one */
+	if (count)
+		virtqueue_kick(priv->rx_vq);
+
+	return 0;
+}
+
 static void virtio_net_stop(struct udevice *dev)
 {
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int i;
+
+	/* packets held from the last batch are stale by the next start */
+	for (i = 0; i < priv->rx_batch_len; i++)
+		virtio_net_refill(dev, priv->rx_batch[i].packet);
+	if (priv->rx_batch_len)
+		virtqueue_kick(priv->rx_vq);
+	priv->rx_batch_len = 0;
+
 	/*
 	 * There is no way to stop the queue from running, unless we issue
 	 * a reset to the virtio device, and re-do the queue initialization
@@ -201,6 +276,15 @@ static int virtio_net_probe(struct udevice *dev)
 	if (ret < 0)
 		return ret;
 
+	/* fill the RX ring, so the device can go on while we process a batch */
+	priv->rx_num = min_t(unsigned int, CONFIG_VIRTIO_NET_RX_BUFS,
+			     virtqueue_get_vring_size(priv->rx_vq));
+	priv->rx_buff = malloc(priv->rx_num * VIRTIO_NET_RX_BUF_SIZE);
+	if (!priv->rx_buff) {
+		virtio_del_vqs(dev);
+		return -ENOMEM;
+	}
+
 	/*
 	 * For v1.0 compliant device, it always assumes the member
 	 * 'num_buffers' exists in the struct virtio_net_hdr while
@@ -216,11 +300,25 @@ static int virtio_net_probe(struct udevice *dev)
 	return 0;
 }
 
+static int virtio_net_remove(struct udevice *dev)
+{
+	struct virtio_net_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	/* the device must stop using the buffers before they are freed */
+	ret = virtio_reset(dev);
+	free(priv->rx_buff);
+
+	return ret;
+}
+
 static const struct eth_ops virtio_net_ops = {
 	.start = virtio_net_start,
 	.send = virtio_net_send,
 	.recv = virtio_net_recv,
 	.free_pkt = virtio_net_free_pkt,
+	.recv_batch = virtio_net_recv_batch,
+	.free_batch = virtio_net_free_batch,
 	.stop = virtio_net_stop,
 	.write_hwaddr = virtio_net_write_hwaddr,
 	.read_rom_hwaddr = virtio_net_read_rom_hwaddr,
@@ -231,7 +329,7 @@ U_BOOT_DRIVER(virtio_net) = {
 	.id	= UCLASS_ETH,
 	.bind	= virtio_net_bind,
 	.probe	= virtio_net_probe,
-	.remove = virtio_reset,
+	.remove = virtio_net_remove,
 	.ops	= &virtio_net_ops,
 	.priv_auto	= sizeof(struct virtio_net_priv),
 	.plat_auto	= sizeof(struct eth_pdata),
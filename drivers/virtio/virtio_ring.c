@@ -95,12 +95,50 @@ static void virtqueue_detach_desc(struct virtqueue *vq, unsigned int idx)
 	bb = &vq->vring.bouncebufs[idx];
 	bounce_buffer_stop(bb);
 	desc->addr = cpu_to_virtio64(vq->vdev, (u64)(uintptr_t)bb->user_buffer);
+	/* the bounce buffer is gone, so hand back the caller's one */
+	vq->vring_desc_shadow[idx].addr = (u64)(uintptr_t)bb->user_buffer;
+}
+
+/**
+ * virtqueue_alloc_indirect() - Put a scatter-gather list in an indirect table
+ *
+ * @vq:		the struct virtqueue the table is for
+ * @sgs:	array of terminated scatterlists
+ * @out_sgs:	the number of scatterlists readable by other side
+ * @total_sgs:	the number of scatterlists in all
+ * Return: the table, or NULL if it could not be allocated
+ */
+static struct vring_desc *virtqueue_alloc_indirect(struct virtqueue *vq,
+						   struct virtio_sg *sgs[],
+						   unsigned int out_sgs,
+						   unsigned int total_sgs)
+{
+	struct vring_desc *desc;
+	unsigned int n;
+	u16 flags;
+
+	desc = malloc(total_sgs * sizeof(*desc));
+	if (!desc)
+		return NULL;
+
+	for (n = 0; n < total_sgs; n++) {
+		flags = n + 1 < total_sgs ? VRING_DESC_F_NEXT : 0;
+		if (n >= out_sgs)
+			flags |= VRING_DESC_F_WRITE;
+		desc[n].addr = cpu_to_virtio64(vq->vdev,
+					       (u64)(uintptr_t)sgs[n]->addr);
+		desc[n].len = cpu_to_virtio32(vq->vdev, sgs[n]->length);
+		desc[n].flags = cpu_to_virtio16(vq->vdev, flags);
+		desc[n].next = cpu_to_virtio16(vq->vdev, n + 1);
+	}
+
+	return desc;
 }
 
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		  unsigned int out_sgs, unsigned int in_sgs)
 {
-	struct vring_desc *desc;
+	struct vring_desc *desc, *indirect = NULL;
 	unsigned int descs_used = out_sgs + in_sgs;
 	unsigned int i, n, avail, uninitialized_var(prev);
 	int head;
@@ -112,6 +150,14 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	desc = vq->vring.desc;
 	i = head;
 
+	/* A chain takes a single descriptor of the ring through a table */
+	if (vq->indirect && descs_used > 1) {
+		indirect = virtqueue_alloc_indirect(vq, sgs, out_sgs,
+						    descs_used);
+		if (indirect)
+			descs_used = 1;
+	}
+
 	if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
 		      descs_used, vq->num_free);
@@ -122,10 +168,21 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		 */
 		if (out_sgs)
 			virtio_notify(vq->vdev, vq);
+		free(indirect);
 		return -ENOSPC;
 	}
 
-	for (n = 0; n < descs_used; n++) {
+	if (indirect) {
+		struct virtio_sg sg = {
+			.addr = indirect,
+			.length = (out_sgs + in_sgs) * sizeof(*indirect),
+		};
+
+		prev = i;
+		i = virtqueue_attach_desc(vq, i, &sg, VRING_DESC_F_INDIRECT);
+	}
+
+	for (n = 0; !indirect && n < descs_used; n++) {
 		u16 flags = VRING_DESC_F_NEXT;
 
 		if (n >= out_sgs)
@@ -238,6 +295,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 {
 	unsigned int i;
 	u16 last_used;
+	u64 addr;
 
 	if (!more_used(vq)) {
 		debug("(%s.%d): No more buffers in queue\n",
@@ -270,6 +328,14 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 	}
 
 	detach_buf(vq, i);
+	addr = vq->vring_desc_shadow[i].addr;
+	if (vq->vring_desc_shadow[i].flags & VRING_DESC_F_INDIRECT) {
+		struct vring_desc *indirect = (void *)(uintptr_t)addr;
+
+		/* the caller knows the chain by its first buffer */
+		addr = virtio64_to_cpu(vq->vdev, indirect[0].addr);
+		free(indirect);
+	}
 	vq->last_used_idx++;
 	/*
 	 * If we expect an interrupt for the next entry, tell host
@@ -280,7 +346,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
-	return (void *)(uintptr_t)vq->vring_desc_shadow[i].addr;
+	return (void *)(uintptr_t)addr;
 }
 
 static struct virtqueue *__vring_new_virtqueue(unsigned int index,
@@ -315,6 +381,9 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	list_add_tail(&vq->list, &uc_priv->vqs);
 
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	/* bounce buffers are kept for each descriptor of the ring */
+	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
+		       !vring.bouncebufs;
 
 	/* Tell other side not to bother us */
 	vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
@@ -160,6 +160,8 @@ static int virtio_sandbox_probe(struct udevice *udev)
 
 	/* fake some information for testing */
 	priv->device_features = BIT_ULL(VIRTIO_F_VERSION_1);
+	if (dev_read_bool(udev, "virtio-event-idx"))
+		priv->device_features |= BIT_ULL(VIRTIO_RING_F_EVENT_IDX);
 	uc_priv->device = dev_read_u32_default(udev, "virtio-type",
 					       VIRTIO_ID_RNG);
 	uc_priv->vendor = ('u' << 24) | ('b' << 16) | ('o' << 8) | 't';
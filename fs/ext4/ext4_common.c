@@ -1999,6 +1999,106 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	return blknr;
 }
 
+/*
+ * An extent with a length above this is unwritten (preallocated) and must
+ * read back as zeroes. Its real length is ee_len - EXT4_EXT_INIT_MAX_LEN.
+ */
+#define EXT4_EXT_INIT_MAX_LEN	(1 << 15)
+
+/* Check whether @leaf is an extent leaf which covers @fileblock */
+static bool ext4fs_leaf_covers(struct ext4_extent_header *leaf,
+			       lbaint_t fileblock)
+{
+	struct ext4_extent *extent = (struct ext4_extent *)(leaf + 1);
+	int entries = le16_to_cpu(leaf->eh_entries);
+	struct ext4_extent *last;
+	int len;
+
+	if (le16_to_cpu(leaf->eh_magic) != EXT4_EXT_MAGIC || leaf->eh_depth ||
+	    !entries)
+		return false;
+
+	last = &extent[entries - 1];
+	len = le16_to_cpu(last->ee_len);
+	if (len > EXT4_EXT_INIT_MAX_LEN)
+		len -= EXT4_EXT_INIT_MAX_LEN;
+
+	return fileblock >= le32_to_cpu(extent[0].ee_block) &&
+		fileblock < le32_to_cpu(last->ee_block) + len;
+}
+
+long ext4fs_map_blocks(struct ext2_inode *inode, lbaint_t fileblock,
+		       lbaint_t maxblocks, struct ext_block_cache *cache,
+		       lbaint_t *blknrp)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	lbaint_t startblock, endblock;
+	unsigned long long start;
+	long blknr, next, count;
+	int log2_blksz;
+	bool unwritten;
+	int i, len;
+
+	if (!(le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL)) {
+		/* indirect blocks: gather a run of consecutive blocks */
+		blknr = read_allocated_block(inode, fileblock, cache);
+		if (blknr < 0)
+			return blknr;
+		for (count = 1; count < maxblocks; count++) {
+			next = read_allocated_block(inode, fileblock + count,
+						    cache);
+			if (next < 0 || next != (blknr ? blknr + count : 0))
+				break;
+		}
+		*blknrp = blknr;
+
+		return count;
+	}
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+
+	/* reading a file mostly stays within the leaf used last time */
+	ext_block = (struct ext4_extent_header *)cache->buf;
+	if (!ext_block || !ext4fs_leaf_covers(ext_block, fileblock))
+		ext_block = ext4fs_get_extent_block(ext4fs_root, cache,
+						    (struct ext4_extent_header *)
+						    inode->b.blocks.dir_blocks,
+						    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		len = le16_to_cpu(extent[i].ee_len);
+		unwritten = len > EXT4_EXT_INIT_MAX_LEN;
+		if (unwritten)
+			len -= EXT4_EXT_INIT_MAX_LEN;
+		endblock = startblock + len;
+
+		if (startblock > fileblock) {
+			/* Sparse file, up to the start of this extent */
+			*blknrp = 0;
+			return min(startblock - fileblock, maxblocks);
+		} else if (fileblock < endblock) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*blknrp = unwritten ? 0 : start + fileblock - startblock;
+			return min(endblock - fileblock, maxblocks);
+		}
+	}
+
+	/* Sparse file, after the last extent in this leaf */
+	*blknrp = 0;
+
+	return 1;
+}
+
 /**
  * ext4fs_reinit_global() - Reinitialize values of ext4 write implementation's
  *			    global pointers
@@ -28,6 +28,7 @@
 #include <malloc.h>
 #include <part.h>
 #include <rtc.h>
+#include <linux/sizes.h>
 #include <u-boot/uuid.h>
 #include "ext4_common.h"
 
@@ -64,144 +65,66 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 }
 
 /*
- * Taken from openmoko-kernel mailing list: By Andy green
- * Optimized read file API : collects and defers contiguous sector
- * reads into one potentially more efficient larger sequential read action
+ * Read a file one run of blocks at a time. Each extent (or the part of it
+ * which is wanted) is mapped once and read with a single ext4fs_devread()
+ * straight into the caller's buffer. Holes are filled with zeroes.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	lbaint_t blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
-	lbaint_t delayed_start = 0;
-	lbaint_t delayed_extent = 0;
-	lbaint_t delayed_skipfirst = 0;
-	lbaint_t delayed_next = 0;
-	char *delayed_buf = NULL;
-	char *start_buf = buf;
-	short status;
+	lbaint_t fileblock, blockcnt;
 	struct ext_block_cache cache;
-
-	ext_cache_init(&cache);
+	loff_t left, bytes;
+	int skipfirst;
 
 	/* Adjust len so it we can't read past the end of the file. */
 	if (len + pos > filesize)
 		len = (filesize - pos);
 
-	if (blocksize <= 0 || len <= 0) {
-		ext_cache_fini(&cache);
+	if (blocksize <= 0 || len <= 0)
 		return -1;
-	}
 
+	ext_cache_init(&cache);
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	fileblock = lldiv(pos, blocksize);
+	skipfirst = pos - (loff_t)fileblock * blocksize;
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	for (left = len; left; left -= bytes) {
 		lbaint_t blknr;
-		long blknr_and_status;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
-		int skipfirst = 0;
-		blknr_and_status = read_allocated_block(&node->inode, i, &cache);
-		if (blknr_and_status < 0) {
+		long count;
+
+		/* keep each read within the int used by ext4fs_devread() */
+		count = ext4fs_map_blocks(&node->inode, fileblock,
+					  min_t(lbaint_t, blockcnt - fileblock,
+						SZ_1G / blocksize),
+					  &cache, &blknr);
+		if (count < 0) {
 			ext_cache_fini(&cache);
 			return -1;
 		}
 
-		/* Block number could becomes very large when CONFIG_SYS_64BIT_LBA is enabled
-		 * and wrap around at max long int
-		 */
-		blknr = (lbaint_t)blknr_and_status << log2_fs_blocksize;
-
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
-
-		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
+		bytes = min_t(loff_t, (loff_t)count * blocksize - skipfirst,
+			      left);
 		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-					if (status == 0) {
-						ext_cache_fini(&cache);
-						return -1;
-					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_skipfirst = skipfirst;
-				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
+			if (!ext4fs_devread(blknr << log2_fs_blocksize,
+					    skipfirst, bytes, buf)) {
+				ext_cache_fini(&cache);
+				return -1;
 			}
 		} else {
-			int n;
-			int n_left;
-			if (previous_block_number != -1) {
-				/* spill */
-				status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-				if (status == 0) {
-					ext_cache_fini(&cache);
-					return -1;
-				}
-				previous_block_number = -1;
-			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
-		}
-		buf += blocksize - skipfirst;
-	}
-	if (previous_block_number != -1) {
-		/* spill */
-		status = ext4fs_devread(delayed_start,
-					delayed_skipfirst, delayed_extent,
-					delayed_buf);
-		if (status == 0) {
-			ext_cache_fini(&cache);
-			return -1;
+			memset(buf, 0, bytes);
 		}
-		previous_block_number = -1;
+		buf += bytes;
+		fileblock += count;
+		skipfirst = 0;
 	}
 
-	*actread  = len;
+	*actread = len;
 	ext_cache_fini(&cache);
 	return 0;
 }
@@ -153,6 +153,9 @@ static void get_name(dir_entry *dirent, char *s_name)
 
 static int flush_dirty_fat_buffer(fsdata *mydata);
 
+/* A FAT12 entry must not straddle two FAT buffers */
+static_assert(FATBUFBLOCKS % 3 == 0);
+
 #if !CONFIG_IS_ENABLED(FAT_WRITE)
 /* Stub for read only operation */
 int flush_dirty_fat_buffer(fsdata *mydata)
@@ -314,6 +317,77 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/**
+ * struct fat_extent - A run of consecutive clusters in a cluster chain
+ *
+ * @clust: First cluster
+ * @count: Number of clusters
+ */
+struct fat_extent {
+	__u32 clust;
+	__u32 count;
+};
+
+/**
+ * get_extents() - decode part of a cluster chain into extents
+ *
+ * Following the whole chain before reading any data means that the FAT is
+ * read in order, and that each fragment of the file can be read with a single
+ * disk_read().
+ *
+ * @mydata:	file system description
+ * @clust:	first cluster to decode
+ * @nclust:	number of clusters to decode
+ * @extp:	returns an allocated array of extents, which the caller must
+ *		free
+ * Return:	number of extents, or -1 on error
+ */
+static int get_extents(fsdata *mydata, __u32 clust, __u32 nclust,
+		       struct fat_extent **extp)
+{
+	struct fat_extent *ext, *new;
+	int count = 0, size = 16;
+
+	ext = malloc(size * sizeof(*ext));
+	if (!ext) {
+		debug("Error: allocating buffer\n");
+		return -1;
+	}
+
+	ext[0].clust = clust;
+	ext[0].count = 1;
+	while (--nclust) {
+		__u32 next = get_fatent(mydata, clust);
+
+		if (CHECK_CLUST(next, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", next);
+			printf("Invalid FAT entry\n");
+			free(ext);
+			return -1;
+		}
+		if (next == clust + 1) {
+			ext[count].count++;
+		} else {
+			if (++count == size) {
+				size *= 2;
+				new = realloc(ext, size * sizeof(*ext));
+				if (!new) {
+					debug("Error: allocating buffer\n");
+					free(ext);
+					return -1;
+				}
+				ext = new;
+			}
+			ext[count].clust = next;
+			ext[count].count = 1;
+		}
+		clust = next;
+	}
+	*extp = ext;
+
+	return count + 1;
+}
+
 /**
  * get_contents() - read from file
  *
@@ -335,8 +409,9 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	struct fat_extent *ext;
 	loff_t actsize;
+	int count, i;
 
 	*gotsize = 0;
 	debug("Filesize: %llu bytes\n", filesize);
@@ -402,50 +477,26 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		}
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
+	count = get_extents(mydata, curclust,
+			    DIV_ROUND_UP(filesize, bytesperclust), &ext);
+	if (count < 0)
+		return -1;
 
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	/* read each fragment of the file in one go */
+	for (i = 0; i < count; i++) {
+		actsize = min(filesize, (loff_t)ext[i].count * bytesperclust);
+		if (get_cluster(mydata, ext[i].clust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
+			free(ext);
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
 		filesize -= actsize;
 		buffer += actsize;
+	}
+	free(ext);
 
-		curclust = get_fatent(mydata, endclust);
-		if (CHECK_CLUST(curclust, mydata->fatsize)) {
-			debug("curclust: 0x%x\n", curclust);
-			printf("Invalid FAT entry\n");
-			return -1;
-		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	return 0;
 }
 
 /*
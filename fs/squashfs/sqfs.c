@@ -14,6 +14,7 @@
 #include <linux/types.h>
 #include <asm/byteorder.h>
 #include <linux/compat.h>
+#include <linux/list.h>
 #include <memalign.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,170 @@
 static struct squashfs_ctxt ctxt;
 static int symlinknest;
 
+/**
+ * struct sqfs_cache_entry - A decompressed block in the cache
+ *
+ * @list: Node in the list of entries, most recently used first
+ * @key: Offset of the block on the disk
+ * @size: Size of @data in bytes
+ * @data: Contents of the block
+ */
+struct sqfs_cache_entry {
+	struct list_head list;
+	u64 key;
+	size_t size;
+	unsigned char data[];
+};
+
+/**
+ * struct sqfs_tables - Decompressed inode and directory tables
+ *
+ * These are shared by the cache and by each directory stream which uses them,
+ * and freed when the last of these lets go of them.
+ *
+ * @refcount: Number of users of the tables
+ * @size: Memory used by the tables
+ * @inode_table: Decompressed inode table
+ * @dir_table: Decompressed directory table
+ * @pos_list: Metadata block positions in the directory table
+ * @metablks_count: Number of metadata blocks in the directory table
+ */
+struct sqfs_tables {
+	int refcount;
+	size_t size;
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	u32 *pos_list;
+	int metablks_count;
+};
+
+/**
+ * struct sqfs_cache - Decompressed data kept between filesystem operations
+ *
+ * Each U-Boot filesystem operation probes and closes the filesystem, which
+ * used to mean decompressing the inode and directory tables every time. They
+ * are kept here, along with fragment blocks and fragment table entries, as
+ * long as the same filesystem is probed again. It is recognised by its device,
+ * partition and superblock.
+ *
+ * @dev: Block device of the cached filesystem, or NULL if there is none
+ * @part_start: Start block of the partition
+ * @sblk: Superblock of the cached filesystem
+ * @size: Memory used by the cache
+ * @tables: Decompressed inode and directory tables, or NULL if not cached
+ * @entries: List of struct sqfs_cache_entry
+ */
+struct sqfs_cache {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	struct squashfs_super_block sblk;
+	size_t size;
+	struct sqfs_tables *tables;
+	struct list_head entries;
+};
+
+static struct sqfs_cache sqfs_cache = {
+	.entries = LIST_HEAD_INIT(sqfs_cache.entries),
+};
+
+static void sqfs_cache_drop_entry(struct sqfs_cache_entry *entry)
+{
+	list_del(&entry->list);
+	sqfs_cache.size -= sizeof(*entry) + entry->size;
+	free(entry);
+}
+
+/* Give back tables from sqfs_get_tables(), freeing them if nothing uses them */
+static void sqfs_put_tables(struct sqfs_tables *tables)
+{
+	if (!tables || --tables->refcount)
+		return;
+
+	free(tables->inode_table);
+	free(tables->dir_table);
+	free(tables->pos_list);
+	free(tables);
+}
+
+static void sqfs_cache_drop(void)
+{
+	struct sqfs_cache_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &sqfs_cache.entries, list)
+		sqfs_cache_drop_entry(entry);
+	/* directory streams which still use the tables keep them */
+	sqfs_put_tables(sqfs_cache.tables);
+	sqfs_cache.tables = NULL;
+	sqfs_cache.dev = NULL;
+	sqfs_cache.size = 0;
+}
+
+/* Drop the cache unless it belongs to the filesystem being probed */
+static void sqfs_cache_check(struct squashfs_super_block *sblk)
+{
+	if (sqfs_cache.dev == ctxt.cur_dev &&
+	    sqfs_cache.part_start == ctxt.cur_part_info.start &&
+	    !memcmp(&sqfs_cache.sblk, sblk, sizeof(*sblk)))
+		return;
+
+	sqfs_cache_drop();
+	sqfs_cache.dev = ctxt.cur_dev;
+	sqfs_cache.part_start = ctxt.cur_part_info.start;
+	memcpy(&sqfs_cache.sblk, sblk, sizeof(*sblk));
+}
+
+/* Make room for @size more bytes by dropping the oldest entries */
+static bool sqfs_cache_reserve(size_t size)
+{
+	struct sqfs_cache_entry *entry;
+
+	if (size > CONFIG_VAL(SQUASHFS_CACHE_SIZE))
+		return false;
+
+	while (sqfs_cache.size + size > CONFIG_VAL(SQUASHFS_CACHE_SIZE)) {
+		if (list_empty(&sqfs_cache.entries))
+			return false;
+		entry = list_last_entry(&sqfs_cache.entries,
+					struct sqfs_cache_entry, list);
+		sqfs_cache_drop_entry(entry);
+	}
+
+	return true;
+}
+
+static void *sqfs_cache_find(u64 key, size_t *sizep)
+{
+	struct sqfs_cache_entry *entry;
+
+	list_for_each_entry(entry, &sqfs_cache.entries, list) {
+		if (entry->key == key) {
+			list_move(&entry->list, &sqfs_cache.entries);
+			if (sizep)
+				*sizep = entry->size;
+			return entry->data;
+		}
+	}
+
+	return NULL;
+}
+
+static void sqfs_cache_add(u64 key, const void *data, size_t size)
+{
+	struct sqfs_cache_entry *entry;
+
+	if (!sqfs_cache.dev || !sqfs_cache_reserve(sizeof(*entry) + size))
+		return;
+
+	entry = malloc(sizeof(*entry) + size);
+	if (!entry)
+		return;
+	entry->key = key;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+	list_add(&entry->list, &sqfs_cache.entries);
+	sqfs_cache.size += sizeof(*entry) + size;
+}
+
 static int sqfs_readdir_nest(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp);
 
 static int sqfs_disk_read(__u32 block, __u32 nr_blocks, void *buf)
@@ -106,11 +271,13 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 			    struct squashfs_fragment_block_entry *e)
 {
 	u64 start, end, exp_tbl, n_blks, src_len, table_offset, start_block;
+	u64 index_size;
 	unsigned char *metadata_buffer, *metadata, *table;
 	struct squashfs_fragment_block_entry *entries;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	unsigned long dest_len;
 	int block, offset, ret;
+	void *cached;
 	u16 header;
 
 	metadata_buffer = NULL;
@@ -120,13 +287,29 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
 		return -EINVAL;
 
+	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+
+	/* The index is cached under the start of the table it points into */
 	start = get_unaligned_le64(&sblk->fragment_table_start);
+	cached = sqfs_cache_find(start, NULL);
+	if (cached) {
+		start_block = get_unaligned_le64(cached + block * sizeof(u64));
+		goto read_entries;
+	}
+
 	end = get_unaligned_le64(&sblk->id_table_start);
 	exp_tbl = get_unaligned_le64(&sblk->export_table_start);
 
 	if (exp_tbl > start && exp_tbl < end)
 		end = exp_tbl;
 
+	/* The index must fit in the space before the next table */
+	index_size = (SQFS_FRAGMENT_INDEX(get_unaligned_le32(&sblk->fragments) -
+					  1) + 1) * sizeof(u64);
+	if (end <= start || index_size > end - start)
+		return -EINVAL;
+
 	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
 				  cpu_to_le64(end), &table_offset);
 
@@ -144,15 +327,23 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 		goto out;
 	}
 
-	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
-
 	/*
 	 * Get the start offset of the metadata block that contains the right
 	 * fragment block entry
 	 */
 	start_block = get_unaligned_le64(table + table_offset + block *
 					 sizeof(u64));
+	sqfs_cache_add(get_unaligned_le64(&sblk->fragment_table_start),
+		       table + table_offset, index_size);
+
+read_entries:
+	cached = sqfs_cache_find(start_block, NULL);
+	if (cached) {
+		entries = NULL;
+		*e = ((struct squashfs_fragment_block_entry *)cached)[offset];
+		ret = SQFS_COMPRESSED_BLOCK(e->size);
+		goto out;
+	}
 
 	start = start_block / ctxt.cur_dev->blksz;
 	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
@@ -201,6 +392,7 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	} else {
 		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
 	}
+	sqfs_cache_add(start_block, entries, SQFS_METADATA_BLOCK_SIZE);
 
 	*e = entries[offset];
 	ret = SQFS_COMPRESSED_BLOCK(e->size);
@@ -719,6 +911,10 @@ static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
 	return ret;
 }
 
+/*
+ * Returns the number of metadata blocks in the inode table, or a negative
+ * error code
+ */
 static int sqfs_read_inode_table(unsigned char **inode_table)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
@@ -803,6 +999,7 @@ static int sqfs_read_inode_table(unsigned char **inode_table)
 		table_offset += src_len + SQFS_HEADER_SIZE;
 		src_table += src_len + SQFS_HEADER_SIZE;
 	}
+	ret = metablks_count;
 
 free_itb:
 	free(itb);
@@ -914,13 +1111,58 @@ out:
 	return metablks_count;
 }
 
+/*
+ * Get the decompressed inode and directory tables, from the cache if they are
+ * there. The caller gets its own reference, to be given back with
+ * sqfs_put_tables(). Returns NULL on error.
+ */
+static struct sqfs_tables *sqfs_get_tables(void)
+{
+	struct sqfs_tables *tables;
+	int inode_count;
+
+	if (sqfs_cache.tables) {
+		sqfs_cache.tables->refcount++;
+		return sqfs_cache.tables;
+	}
+
+	tables = calloc(1, sizeof(*tables));
+	if (!tables)
+		return NULL;
+	tables->refcount = 1;
+
+	inode_count = sqfs_read_inode_table(&tables->inode_table);
+	if (inode_count < 0)
+		goto err;
+
+	tables->metablks_count = sqfs_read_directory_table(&tables->dir_table,
+							   &tables->pos_list);
+	if (tables->metablks_count < 1)
+		goto err;
+
+	tables->size = (inode_count + tables->metablks_count) *
+		SQFS_METADATA_BLOCK_SIZE +
+		tables->metablks_count * sizeof(u32);
+	if (sqfs_cache.dev && sqfs_cache_reserve(tables->size)) {
+		tables->refcount++;
+		sqfs_cache.tables = tables;
+		sqfs_cache.size += tables->size;
+	}
+
+	return tables;
+
+err:
+	sqfs_put_tables(tables);
+
+	return NULL;
+}
+
 static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
+	struct sqfs_tables *tables;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -933,17 +1175,12 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
+	tables = sqfs_get_tables();
+	if (!tables) {
 		ret = -EINVAL;
 		goto out;
 	}
+	dirs->tables = tables;
 
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
@@ -972,10 +1209,10 @@ static int sqfs_opendir_nest(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = tables->inode_table;
+	dirs->dir_table = tables->dir_table;
+	ret = sqfs_search_dir(dirs, token_list, token_count, tables->pos_list,
+			      tables->metablks_count);
 	if (ret)
 		goto out;
 
@@ -1001,10 +1238,9 @@ out:
 			free(token_list[j]);
 		free(token_list);
 	}
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
+		sqfs_put_tables(dirs->tables);
 		free(dirs);
 	}
 
@@ -1160,6 +1396,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	}
 
 	ctxt.sblk = sblk;
+	sqfs_cache_check(sblk);
 
 	ret = sqfs_decompressor_init(&ctxt);
 	if (ret) {
@@ -1369,37 +1606,108 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 	return datablk_count;
 }
 
+/*
+ * Get the decompressed contents of a fragment block, from the cache if it is
+ * there. If *freep is set on return, the caller must free *blockp.
+ */
+static int sqfs_get_fragment(struct squashfs_fragment_block_entry *frag_entry,
+			     bool comp, char **blockp, bool *freep)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u64 start, n_blks, table_size, table_offset;
+	char *fragment, *fragment_block;
+	unsigned long dest_len;
+	size_t buf_size;
+	int ret;
+
+	*freep = false;
+	*blockp = sqfs_cache_find(frag_entry->start, NULL);
+	if (*blockp)
+		return 0;
+
+	start = lldiv(frag_entry->start, ctxt.cur_dev->blksz);
+	table_size = SQFS_BLOCK_SIZE(frag_entry->size);
+	table_offset = frag_entry->start - (start * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size))
+		return -EINVAL;
+
+	fragment = malloc_cache_aligned(buf_size);
+	if (!fragment)
+		return -ENOMEM;
+
+	ret = sqfs_disk_read(start, n_blks, fragment);
+	if (ret < 0)
+		goto out;
+
+	if (comp) {
+		/* File compressed and fragmented */
+		dest_len = get_unaligned_le32(&sblk->block_size);
+		fragment_block = malloc(dest_len);
+		if (!fragment_block) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
+				      (void *)fragment + table_offset,
+				      frag_entry->size);
+		if (ret) {
+			free(fragment_block);
+			goto out;
+		}
+		free(fragment);
+		fragment = fragment_block;
+		table_offset = 0;
+		table_size = dest_len;
+	}
+
+	/* Small files often share a fragment block, so keep it */
+	sqfs_cache_add(frag_entry->start, fragment + table_offset, table_size);
+	*blockp = sqfs_cache_find(frag_entry->start, NULL);
+	if (*blockp) {
+		free(fragment);
+		return 0;
+	}
+
+	/* Not cached, so the caller gets the buffer */
+	memmove(fragment, fragment + table_offset, table_size);
+	*blockp = fragment;
+	*freep = true;
+
+	return 0;
+
+out:
+	free(fragment);
+
+	return ret;
+}
+
 static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 			  loff_t len, loff_t *actread)
 {
 	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
-	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
+	char *file = NULL, *resolved, *data;
+	u64 start, n_blks, table_size, data_offset, table_offset;
+	u64 pos, end, skip, count, block_size;
 	int ret, j, i_number, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
 	struct squashfs_symlink_inode *symlink;
+	struct fs_dirent *dent;
 	struct fs_dir_stream *dirsp = NULL;
 	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
 	unsigned long dest_len;
-	struct fs_dirent *dent;
 	unsigned char *ipos;
-	size_t buf_size;
+	bool free_frag;
 
 	*actread = 0;
 
-	if (offset) {
-		/*
-		 * TODO: implement reading at an offset in file
-		 */
-		printf("Error: reading at a specific offset in a squashfs file is not supported yet.\n");
-		return -EINVAL;
-	}
-
 	/*
 	 * sqfs_opendir_nest will uncompress inode and directory tables, and will
 	 * return a pointer to the directory that contains the requested file.
@@ -1490,156 +1798,121 @@ static int sqfs_read_nest(const char *filename, void *buf, loff_t offset,
 		goto out;
 	}
 
-	/* If the user specifies a length, check its sanity */
-	if (len) {
-		if (len > finfo.size) {
-			ret = -EINVAL;
-			goto out;
-		}
-
-		finfo.size = len;
-	} else {
-		len = finfo.size;
+	/* If the user specifies an offset or a length, check their sanity */
+	if (offset > finfo.size || len > finfo.size - offset) {
+		ret = -EINVAL;
+		goto out;
 	}
+	if (!len)
+		len = finfo.size - offset;
+	end = offset + len;
 
+	block_size = get_unaligned_le32(&sblk->block_size);
 	if (datablk_count) {
 		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
+		datablock = malloc(block_size);
 		if (!datablock) {
 			ret = -ENOMEM;
 			goto out;
 		}
 	}
 
-	for (j = 0; j < datablk_count; j++) {
+	/* Only read the blocks which hold the requested range */
+	for (j = 0, pos = 0; j < datablk_count && pos < end;
+	     j++, pos += block_size) {
 		char *data_buffer;
 
-		start = lldiv(data_offset, ctxt.cur_dev->blksz);
 		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
+		if (pos + block_size <= offset) {
+			data_offset += table_size;
+			continue;
+		}
+		skip = offset > pos ? offset - pos : 0;
+		count = min(block_size, end - pos) - skip;
+
+		start = lldiv(data_offset, ctxt.cur_dev->blksz);
 		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
 		n_blks = DIV_ROUND_UP(table_size + table_offset,
 				      ctxt.cur_dev->blksz);
 
 		/* Don't load any data for sparse blocks */
 		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
+			memset(buf + *actread, 0, count);
+			*actread += count;
+			continue;
+		}
 
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
+		data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+		if (!data_buffer) {
+			ret = -ENOMEM;
+			goto out;
+		}
 
-			data = data_buffer + table_offset;
+		ret = sqfs_disk_read(start, n_blks, data_buffer);
+		if (ret < 0) {
+			/*
+			 * Possible causes: too many data blocks or too large
+			 * SquashFS block size. Tip: re-compile the SquashFS
+			 * image with mksquashfs's -b <block_size> option.
+			 */
+			printf("Error: too many data blocks to be read.\n");
+			free(data_buffer);
+			goto out;
 		}
 
+		data = data_buffer + table_offset;
+
 		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
+		if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
+			/* a whole block can go straight into the buffer */
+			if (!skip && count == block_size) {
+				dest_len = block_size;
+				ret = sqfs_decompress(&ctxt, buf + *actread,
+						      &dest_len, data,
+						      table_size);
+			} else {
+				dest_len = block_size;
+				ret = sqfs_decompress(&ctxt, datablock,
+						      &dest_len, data,
+						      table_size);
+				memcpy(buf + *actread, datablock + skip,
+				       count);
+			}
+			if (ret) {
+				free(data_buffer);
 				goto out;
-
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
+			}
 		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
+			memcpy(buf + *actread, data + skip, count);
 		}
+		*actread += count;
 
 		data_offset += table_size;
 		free(data_buffer);
-		if (*actread >= len)
-			break;
 	}
 
 	/*
-	 * There is no need to continue if the file is not fragmented.
+	 * There is no need to continue if the file is not fragmented, or if
+	 * the requested range ends before the fragment.
 	 */
-	if (!finfo.frag) {
-		ret = 0;
-		goto out;
-	}
-
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	if (__builtin_mul_overflow(n_blks, ctxt.cur_dev->blksz, &buf_size)) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	fragment = malloc_cache_aligned(buf_size);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	ret = 0;
+	if (!finfo.frag || *actread >= len)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	ret = sqfs_get_fragment(&frag_entry, finfo.comp, &fragment_block,
+				&free_frag);
+	if (ret)
 		goto out;
 
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
+	pos = (u64)datablk_count * block_size;
+	skip = offset > pos ? offset - pos : 0;
+	memcpy(buf + *actread, &fragment_block[finfo.offset + skip],
+	       len - *actread);
+	*actread = len;
+	if (free_frag)
 		free(fragment_block);
 
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-	}
-
 out:
-	free(fragment);
 	free(datablock);
 	free(file);
 	free(dir);
@@ -1819,8 +2092,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_put_tables(sqfs_dirs->tables);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
@@ -272,8 +272,10 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() and let go of in sqfs_closedir(), which frees them
+	 * unless they are still in the cache.
 	 */
+	struct sqfs_tables *tables;
 	unsigned char *inode_table;
 	unsigned char *dir_table;
 };
@@ -10,6 +10,7 @@
 #include <bouncebuf.h>
 #include <dm/uclass-id.h>
 #include <efi.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -140,6 +141,24 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - get the number of blocks worth reading after a miss
+ *
+ * This should be called after blkcache_read() has missed. If the device is
+ * being read sequentially, it returns a larger count so that the following
+ * reads can come from the cache.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number of the read which missed
+ * @param blkcnt - number of blocks in the read which missed
+ *
+ * Return: - number of blocks to read and pass to blkcache_fill(), at least
+ * @blkcnt
+ */
+lbaint_t blkcache_readahead(int iftype, int dev, lbaint_t start,
+			    lbaint_t blkcnt);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -152,10 +171,14 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param blocks - maximum number of blocks in a read which is cached, or 0 to
+ *	cache nothing
+ * @param size - maximum memory used by the cache, in bytes
+ *
+ * Return: - 0 if OK, -EINVAL if @size is too small to hold a read of @blocks
+ *	512-byte blocks
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+int blkcache_configure(unsigned blocks, unsigned long size);
 
 /*
  * statistics of the block cache
@@ -163,9 +186,23 @@ void blkcache_configure(unsigned blocks, unsigned entries);
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
+	unsigned evictions; /* blocks dropped to make room */
+	unsigned entries; /* current count of cached blocks */
+	unsigned long size; /* current memory use in bytes */
 	unsigned max_blocks_per_entry;
-	unsigned max_entries;
+	unsigned long max_size;
+};
+
+/*
+ * statistics of the block cache for one device
+ */
+struct block_cache_dev_stats {
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned misses;
+	unsigned blocks; /* current count of cached blocks */
+	unsigned long size; /* current memory use in bytes */
 };
 
 /**
@@ -175,6 +212,16 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics for a device and reset
+ *
+ * @param index - index of the device in the cache, starting at 0
+ * @param stats - statistics are copied here
+ *
+ * Return: - 0 if OK, -ENOENT if @index is beyond the last device
+ */
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats);
+
 /** blkcache_free() - free all memory allocated to the block cache */
 void blkcache_free(void);
 
@@ -191,6 +238,12 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline lbaint_t blkcache_readahead(int iftype, int dev, lbaint_t start,
+					  lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 static inline void blkcache_free(void) {}
@@ -199,6 +252,58 @@ static inline void blkcache_free(void) {}
 
 struct udevice;
 
+/**
+ * enum blk_req_op - Operation carried out by a block request
+ *
+ * @BLK_REQ_READ: Read blocks into the buffer
+ * @BLK_REQ_WRITE: Write blocks from the buffer
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+struct blk_request;
+
+/**
+ * typedef blk_req_complete_t - Called when a block request has finished
+ *
+ * @req: Request which finished, with @req->result set
+ */
+typedef void (*blk_req_complete_t)(struct blk_request *req);
+
+/**
+ * struct blk_request - An asynchronous read or write of a block device
+ *
+ * Requests are started with blk_submit() and finish while the device is
+ * polled, by blk_poll() or blk_wait(). Requests in flight at the same time
+ * may finish in any order, so they must not overlap if one is a write.
+ *
+ * @dev: Block device to access
+ * @op: Operation to carry out
+ * @start: Start block number
+ * @blkcnt: Number of blocks
+ * @buffer: Data to write, or place for the data read; this must stay valid
+ *	until the request has finished
+ * @complete: Function to call when the request has finished, or NULL
+ * @priv: Private data of the caller, e.g. for use by @complete
+ * @result: Number of blocks transferred, or -ve error number, once finished
+ * @done: true once the request has finished
+ * @sibling: Node in a queue of the driver, while the request is in flight
+ */
+struct blk_request {
+	struct udevice *dev;
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	blk_req_complete_t complete;
+	void *priv;
+	long result;
+	bool done;
+	struct list_head sibling;
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -275,6 +380,33 @@ struct blk_ops {
 	 */
 	int (*buffer_aligned)(struct udevice *dev, struct bounce_buffer *state);
 #endif	/* CONFIG_BOUNCE_BUFFER */
+
+	/**
+	 * submit() - start an asynchronous read or write
+	 *
+	 * The request is finished later, from poll(), by calling
+	 * blk_req_complete(). Until then the driver may use @req->sibling to
+	 * queue it. This must be supplied along with poll(), and is optional:
+	 * without it, blk_submit() uses read() or write() and finishes the
+	 * request at once.
+	 *
+	 * @dev:	Block device to access
+	 * @req:	Request to start
+	 * @return 0 if started, -EBUSY if the device cannot take another
+	 * request until one has finished, other -ve on error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_request *req);
+
+	/**
+	 * poll() - finish the requests which the device has completed
+	 *
+	 * A request which the device fails to complete in time must be
+	 * finished with an error, since callers wait until it is finished.
+	 *
+	 * @dev:	Block device to check
+	 * @return number of requests finished, or -ve error number
+	 */
+	int (*poll)(struct udevice *dev);
 };
 
 #if CONFIG_IS_ENABLED(BLK)
@@ -331,6 +463,66 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
  */
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
 
+/**
+ * blk_submit() - Start an asynchronous read or write
+ *
+ * The caller sets up all of @req up to @priv. If the device cannot queue
+ * any more requests, this polls it until it can. If the driver does not
+ * support asynchronous requests, or the request is in the block cache, it
+ * finishes before this returns.
+ *
+ * @req: Request to start
+ * Return: 0 if the request was started, -ve on error, in which case
+ * @req->complete is not called
+ */
+int blk_submit(struct blk_request *req);
+
+/**
+ * blk_poll() - Finish the requests which a block device has completed
+ *
+ * This calls the @complete function of each request which finished.
+ *
+ * @dev: Block device to check
+ * Return: number of requests finished, or -ve on error
+ */
+int blk_poll(struct udevice *dev);
+
+/**
+ * blk_wait() - Wait for a block request to finish
+ *
+ * Other requests on the same device may finish meanwhile.
+ *
+ * @req: Request to wait for
+ * Return: number of blocks transferred, or -ve on error
+ */
+long blk_wait(struct blk_request *req);
+
+/**
+ * blk_req_complete() - Mark a request as finished, for use by drivers
+ *
+ * @req: Request which the device has completed
+ * @result: Number of blocks transferred, or -ve error number
+ */
+void blk_req_complete(struct blk_request *req, long result);
+
+/**
+ * blk_dread_async() - Start reading from a block device
+ *
+ * This fills in @req and starts it with blk_submit(). The caller sets
+ * @req->complete and @req->priv beforehand, and can wait for the read with
+ * blk_wait(). Several reads can be kept in flight this way, so that the
+ * device works on one while the caller deals with another.
+ *
+ * @desc: Block device descriptor
+ * @start: Start block for the read
+ * @blkcnt: Number of blocks to read
+ * @buffer: Place to put the data
+ * @req: Request to use
+ * Return: 0 if the read was started, -ve on error
+ */
+int blk_dread_async(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
+		    void *buffer, struct blk_request *req);
+
 /**
  * blk_find_device() - Find a block device
  *
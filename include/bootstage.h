@@ -213,6 +213,7 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_FSP_M,
 	BOOTSTAGE_ID_ACCUM_FSP_S,
 	BOOTSTAGE_ID_ACCUM_MMAP_SPI,
+	BOOTSTAGE_ID_ACCUM_SPL_FIT_LOAD,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
@@ -0,0 +1,280 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * eMMC Command Queue Host Controller Interface (CQHCI)
+ *
+ * Based on the Linux driver
+ */
+
+#ifndef __CQHCI_H
+#define __CQHCI_H
+
+#include <blk.h>
+#include <asm/io.h>
+#include <linux/bitops.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
+#include <linux/types.h>
+
+struct mmc;
+
+/* registers */
+#define CQHCI_VER			0x00
+#define CQHCI_CAP			0x04
+#define CQHCI_CFG			0x08
+#define  CQHCI_DCMD			BIT(12)
+#define  CQHCI_TASK_DESC_SZ		BIT(8)
+#define  CQHCI_ENABLE			BIT(0)
+#define CQHCI_CTL			0x0c
+#define  CQHCI_CLEAR_ALL_TASKS		BIT(8)
+#define  CQHCI_HALT			BIT(0)
+#define CQHCI_IS			0x10
+#define  CQHCI_IS_HAC			BIT(0)
+#define  CQHCI_IS_TCC			BIT(1)
+#define  CQHCI_IS_RED			BIT(2)
+#define  CQHCI_IS_TCL			BIT(3)
+#define  CQHCI_IS_GCE			BIT(4)
+#define  CQHCI_IS_ICCE			BIT(5)
+#define  CQHCI_IS_ERR_MASK		(CQHCI_IS_RED | CQHCI_IS_GCE | \
+					 CQHCI_IS_ICCE)
+#define  CQHCI_IS_MASK			(CQHCI_IS_TCC | CQHCI_IS_ERR_MASK)
+#define CQHCI_ISTE			0x14
+#define CQHCI_ISGE			0x18
+#define CQHCI_IC			0x1c
+#define CQHCI_TDLBA			0x20
+#define CQHCI_TDLBAU			0x24
+#define CQHCI_TDBR			0x28
+#define CQHCI_TCN			0x2c
+#define CQHCI_DQS			0x30
+#define CQHCI_DPT			0x34
+#define CQHCI_TCLR			0x38
+#define CQHCI_SSC1			0x40
+#define CQHCI_SSC2			0x44
+#define CQHCI_CRDCT			0x48
+#define CQHCI_RMEM			0x50
+#define CQHCI_TERRI			0x54
+#define  CQHCI_TERRI_D_TASK(x)		(((x) >> 24) & 0x1f)
+#define  CQHCI_TERRI_D_VALID		BIT(31)
+#define  CQHCI_TERRI_C_TASK(x)		(((x) >> 8) & 0x1f)
+#define  CQHCI_TERRI_C_VALID		BIT(15)
+#define CQHCI_CRI			0x58
+#define CQHCI_CRA			0x5c
+#define CQHCI_REG_SIZE			0x60
+
+/* first word of every descriptor */
+#define CQHCI_VALID			BIT(0)
+#define CQHCI_END			BIT(1)
+#define CQHCI_INT			BIT(2)
+#define CQHCI_ACT(x)			(((x) & 0x7) << 3)
+#define CQHCI_ACT_MASK			CQHCI_ACT(0x7)
+#define  CQHCI_ACT_TRAN			CQHCI_ACT(0x4)
+#define  CQHCI_ACT_TASK			CQHCI_ACT(0x5)
+#define  CQHCI_ACT_LINK			CQHCI_ACT(0x6)
+
+/* task descriptor fields; the second word is the block address */
+#define CQHCI_FORCED_PROG		BIT(6)
+#define CQHCI_DATA_DIR			BIT(12)	/* set for a read */
+#define CQHCI_BLK_COUNT(x)		(((x) & 0xffff) << 16)
+#define CQHCI_GET_BLK_COUNT(x)		((x) >> 16)
+
+/* transfer descriptor fields; the data address follows */
+#define CQHCI_DAT_LENGTH(x)		(((x) & 0xffff) << 16)
+#define CQHCI_GET_DAT_LENGTH(x)		((x) >> 16)
+
+/* Number of task slots of the engine */
+#define CQHCI_NUM_SLOTS			32
+/* Transfer descriptors for each task, and the data each one covers */
+#define CQHCI_MAX_SEGS			32
+#define CQHCI_SEG_SIZE			SZ_32K
+
+/* caps */
+#define CQHCI_TASK_DESC_SZ_128		BIT(0)
+
+/* quirks */
+#define CQHCI_QUIRK_SHORT_TXFR_DESC_SZ	BIT(0)
+
+struct cqhci_host;
+
+/**
+ * struct cqhci_host_ops - Hooks of the host controller which has the engine
+ *
+ * All of these are optional.
+ */
+struct cqhci_host_ops {
+	/**
+	 * read_l() - Read a register of the engine, instead of readl()
+	 *
+	 * @cq_host:	Command queue engine
+	 * @reg:	Register offset
+	 * Return: register value
+	 */
+	u32 (*read_l)(struct cqhci_host *cq_host, int reg);
+
+	/**
+	 * write_l() - Write a register of the engine, instead of writel()
+	 *
+	 * @cq_host:	Command queue engine
+	 * @val:	Value to write
+	 * @reg:	Register offset
+	 */
+	void (*write_l)(struct cqhci_host *cq_host, u32 val, int reg);
+
+	/**
+	 * enable() - Set up the host controller once the engine is enabled
+	 *
+	 * @mmc:	MMC device
+	 */
+	void (*enable)(struct mmc *mmc);
+
+	/**
+	 * disable() - Set the host controller back for single commands
+	 *
+	 * @mmc:	MMC device
+	 */
+	void (*disable)(struct mmc *mmc);
+};
+
+/**
+ * struct cqhci_slot - A task slot of the engine
+ *
+ * @req: Request the task is part of, NULL if the slot is free
+ * @blkcnt: Number of blocks of the task
+ */
+struct cqhci_slot {
+	struct blk_request *req;
+	lbaint_t blkcnt;
+};
+
+/**
+ * struct cqhci_host - A command queue engine
+ *
+ * The host driver fills in @mmio, @ops, @caps and @quirks before calling
+ * cqhci_init().
+ *
+ * @mmio: Base address of the engine's registers
+ * @mmc: MMC device the engine belongs to
+ * @ops: Hooks of the host controller
+ * @caps: Capabilities (CQHCI_TASK_DESC_SZ_128)
+ * @quirks: Quirks (CQHCI_QUIRK_...)
+ * @dma64: true if descriptors hold 64-bit addresses
+ * @enabled: true if the engine is enabled, so that tasks can be queued
+ * @task_desc_len: Length of a task descriptor in bytes
+ * @link_desc_len: Length of a link descriptor in bytes
+ * @trans_desc_len: Length of a transfer descriptor in bytes
+ * @slot_sz: Length of the descriptors of a slot in the task list
+ * @desc_base: Task descriptor list, each task followed by a link to its
+ *	transfer descriptors
+ * @trans_desc_base: Transfer descriptors, CQHCI_MAX_SEGS for each slot
+ * @slots: Task slots
+ * @depth: Number of slots in use, at most the queue depth of the card
+ * @inflight: Number of tasks queued
+ * @pending: Requests with blocks not yet queued, in order
+ * @issued: Number of blocks queued of the first pending request
+ * @time: Time of the last progress, in milliseconds, for the timeout
+ */
+struct cqhci_host {
+	void __iomem *mmio;
+	struct mmc *mmc;
+	const struct cqhci_host_ops *ops;
+	u32 caps;
+	u32 quirks;
+	bool dma64;
+	bool enabled;
+	int task_desc_len;
+	int link_desc_len;
+	int trans_desc_len;
+	int slot_sz;
+	u8 *desc_base;
+	u8 *trans_desc_base;
+	struct cqhci_slot slots[CQHCI_NUM_SLOTS];
+	uint depth;
+	uint inflight;
+	struct list_head pending;
+	lbaint_t issued;
+	ulong time;
+};
+
+static inline void cqhci_writel(struct cqhci_host *cq_host, u32 val, int reg)
+{
+	if (cq_host->ops && cq_host->ops->write_l)
+		cq_host->ops->write_l(cq_host, val, reg);
+	else
+		writel(val, cq_host->mmio + reg);
+}
+
+static inline u32 cqhci_readl(struct cqhci_host *cq_host, int reg)
+{
+	if (cq_host->ops && cq_host->ops->read_l)
+		return cq_host->ops->read_l(cq_host, reg);
+	else
+		return readl(cq_host->mmio + reg);
+}
+
+/**
+ * cqhci_init() - Set up a command queue engine
+ *
+ * This allocates the descriptors and attaches the engine to @mmc. It is
+ * enabled by the MMC core when a card with a command queue is used.
+ *
+ * @cq_host:	Command queue engine, set up as above
+ * @mmc:	MMC device of the host controller
+ * @dma64:	true if the controller uses 64-bit DMA addresses
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int cqhci_init(struct cqhci_host *cq_host, struct mmc *mmc, bool dma64);
+
+/**
+ * cqhci_deinit() - Detach a command queue engine and free its descriptors
+ *
+ * @cq_host:	Command queue engine
+ */
+void cqhci_deinit(struct cqhci_host *cq_host);
+
+/**
+ * cqhci_enable() - Enable the engine so that tasks can be queued
+ *
+ * The card must already be in command queue mode.
+ *
+ * @cq_host:	Command queue engine
+ * @depth:	Most tasks the card can queue
+ * Return: 0 if OK, -ve on error
+ */
+int cqhci_enable(struct cqhci_host *cq_host, uint depth);
+
+/**
+ * cqhci_disable() - Finish the tasks queued and disable the engine
+ *
+ * The requests queued are finished first, so that the card can then take
+ * single commands again once it leaves command queue mode.
+ *
+ * @cq_host:	Command queue engine
+ * Return: 0 if OK, -ECANCELED if the engine had given up on its tasks, other
+ * -ve on error
+ */
+int cqhci_disable(struct cqhci_host *cq_host);
+
+/**
+ * cqhci_submit() - Queue a block request on the engine
+ *
+ * The request is split into tasks of at most the host's transfer limit,
+ * which are queued while there are free slots, and the rest once tasks
+ * finish. The doorbell is rung once for all the tasks added.
+ *
+ * @cq_host:	Command queue engine, which must be enabled
+ * @req:	Request to queue
+ * Return: 0 if OK, -ve on error
+ */
+int cqhci_submit(struct cqhci_host *cq_host, struct blk_request *req);
+
+/**
+ * cqhci_poll() - Finish the requests whose tasks have all completed
+ *
+ * A task error, or no progress for a long time, fails all the requests
+ * queued and disables the engine. The MMC core then discards the tasks left
+ * in the card.
+ *
+ * @cq_host:	Command queue engine, which must be enabled
+ * Return: number of requests finished
+ */
+int cqhci_poll(struct cqhci_host *cq_host);
+
+#endif /* __CQHCI_H */
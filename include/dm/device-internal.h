@@ -13,10 +13,12 @@
 #include <event.h>
 #include <linker_lists.h>
 #include <dm/ofnode.h>
+#include <linux/list.h>
 
 struct device_node;
 struct driver_info;
 struct udevice;
+struct uthread;
 
 /*
  * These two macros DM_DEVICE_INST and DM_DEVICE_REF are only allowed in code
@@ -192,6 +194,84 @@ int device_of_to_plat(struct udevice *dev);
  */
 int device_probe(struct udevice *dev);
 
+/**
+ * struct device_probe_track - A device probe which is in progress
+ *
+ * DM_FLAG_ACTIVATED is set near the start of device_probe(), so with
+ * CONFIG_DM_PROBE_ASYNC it cannot tell another thread that the device is
+ * ready. Each probe in progress is recorded with one of these, which lives on
+ * the stack of device_probe(), so that other threads can wait for it.
+ *
+ * @dev: Device being probed, or NULL if the probe is not being tracked
+ * @owner: Thread which is doing the probe
+ * @sibling: Node in the list of probes in progress
+ */
+struct device_probe_track {
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+	struct udevice *dev;
+	struct uthread *owner;
+	struct list_head sibling;
+#endif
+};
+
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+/**
+ * device_probe_track_start() - Record that a device probe is starting
+ *
+ * @track: Record to fill in, which must stay valid until
+ *	device_probe_track_end() is called. It must be zeroed beforehand.
+ * @dev: Device which is about to be probed
+ */
+void device_probe_track_start(struct device_probe_track *track,
+			      struct udevice *dev);
+
+/**
+ * device_probe_track_end() - Record that a device probe has finished
+ *
+ * This does nothing if device_probe_track_start() was not called for @track.
+ *
+ * @track: Record passed to device_probe_track_start()
+ */
+void device_probe_track_end(struct device_probe_track *track);
+
+/**
+ * device_probe_wait() - Wait for a device which is being probed
+ *
+ * If another thread is probing @dev, this schedules other threads until that
+ * probe has finished. It returns straight away if @dev is not being probed,
+ * or if it is being probed by the calling thread.
+ *
+ * @dev: Device to wait for, which has DM_FLAG_ACTIVATED set
+ * Return: 0 if the device is ready for use, -ENODEV if its probe failed
+ */
+int device_probe_wait(struct udevice *dev);
+
+/**
+ * device_probe_async() - Probe a device in a separate thread
+ *
+ * This starts a uthread to probe @dev and returns without waiting for it to
+ * run. The probe makes progress whenever the caller calls uthread_schedule(),
+ * e.g. via udelay(). Anything which calls device_probe() on @dev, or on one of
+ * its children, waits for the probe to finish. Use dm_probe_async_wait() to
+ * wait for all such probes.
+ *
+ * If the thread cannot be created, @dev is probed before returning.
+ *
+ * @dev: Device to probe
+ * Return: 0 if OK, -ve on error from a synchronous probe
+ */
+int device_probe_async(struct udevice *dev);
+#else
+static inline void device_probe_track_start(struct device_probe_track *track,
+					    struct udevice *dev) {}
+static inline void device_probe_track_end(struct device_probe_track *track) {}
+static inline int device_probe_wait(struct udevice *dev) { return 0; }
+static inline int device_probe_async(struct udevice *dev)
+{
+	return device_probe(dev);
+}
+#endif
+
 /**
  * device_remove() - Remove a device, de-activating it
  *
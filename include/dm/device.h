@@ -87,6 +87,14 @@ struct driver_info;
  */
 #define DM_FLAG_PROBE_AFTER_BIND	(1 << 15)
 
+/*
+ * Device probe spends most of its time waiting for the hardware (link
+ * training, controller ready, PHY autonegotiation) and may run in a uthread
+ * alongside other probes. See dm_probe_async_start(). This can be set on a
+ * U_BOOT_DRIVER() definition or on a single device with dev_or_flags().
+ */
+#define DM_FLAG_PROBE_ASYNC		(1 << 16)
+
 /*
  * One or multiple of these flags are passed to device_remove() so that
  * a selective device removal as specified by the remove-stage and the
@@ -616,6 +616,27 @@ int of_count_phandle_with_args(const struct device_node *np,
 			       const char *list_name, const char *cells_name,
 			       int cells_count);
 
+/**
+ * of_index_build() - Build the phandle and path index for a tree
+ *
+ * This makes of_find_node_by_phandle() and of_find_node_opts_by_path() use
+ * hash tables for @root, instead of walking the tree. Only one tree is
+ * indexed at a time, so this replaces any existing index.
+ *
+ * @root: Root node of the tree to index
+ * Return: 0 if OK, -ENOMEM if not enough memory
+ */
+int of_index_build(struct device_node *root);
+
+/**
+ * of_index_drop() - Drop the phandle and path index
+ *
+ * This must be called before a tree which has been indexed is freed.
+ *
+ * @root: Only drop the index if it is for this tree, or NULL to drop it anyway
+ */
+void of_index_drop(struct device_node *root);
+
 /**
  * of_alias_scan() - Scan all properties of the 'aliases' node
  *
@@ -151,6 +151,26 @@ int dm_init_and_scan(bool pre_reloc_only);
  */
 int dm_autoprobe(void);
 
+/**
+ * dm_probe_async_start() - Start probing devices which allow async probe
+ *
+ * This starts a thread to probe each device with DM_FLAG_PROBE_ASYNC set,
+ * either in its driver or on the device itself. The threads run when the
+ * caller yields, e.g. in udelay(), or when it tries to use one of the devices.
+ * It can be called again once more devices are bound; devices which are
+ * already probed, or being probed, are skipped.
+ *
+ * Return: 0 (always)
+ */
+int dm_probe_async_start(void);
+
+/**
+ * dm_probe_async_wait() - Wait for probes started by dm_probe_async_start()
+ *
+ * Return: 0 (always)
+ */
+int dm_probe_async_wait(void);
+
 /**
  * dm_init() - Initialise Driver Model structures
  *
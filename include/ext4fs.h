@@ -210,6 +210,26 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache);
+
+/**
+ * ext4fs_map_blocks() - map a run of file blocks to filesystem blocks
+ *
+ * This finds the extent containing @fileblock and returns how much of it is
+ * left from @fileblock onwards, so that the whole run can be read at once.
+ * For files which use indirect blocks, consecutive blocks are gathered
+ * instead.
+ *
+ * @inode: Inode of the file
+ * @fileblock: First block in the file to map
+ * @maxblocks: Maximum number of blocks to map, at least 1
+ * @cache: Cache for extent tree blocks; the last leaf used is kept in it
+ * @blknrp: Returns the filesystem block holding @fileblock, or 0 if the run
+ *	is a hole which reads as zeroes
+ * Return: number of blocks in the run (1 to @maxblocks), or -ve on error
+ */
+long ext4fs_map_blocks(struct ext2_inode *inode, lbaint_t fileblock,
+		       lbaint_t maxblocks, struct ext_block_cache *cache,
+		       lbaint_t *blknrp);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
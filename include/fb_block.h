@@ -102,4 +102,45 @@ void fastboot_block_write_sparse_image(struct blk_desc *dev_desc, struct disk_pa
 void fastboot_block_flash_write(const char *part_name, void *download_buffer,
 				u32 download_bytes, char *response);
 
+/**
+ * fastboot_block_stream_start() - Start flashing an image as it is downloaded
+ *
+ * The image is written to the partition as it arrives, through
+ * fastboot_block_stream_write(), using @buffer to hold the data being written.
+ * It may be a sparse image or a raw one.
+ *
+ * @dev_desc: Block device we're going write to
+ * @info: Partition we're going write to
+ * @part_name: Name of partition we're going write to
+ * @buffer: Download buffer, split into two for the data being written
+ * @buffer_size: Size of @buffer in bytes
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_start(struct blk_desc *dev_desc,
+				struct disk_partition *info,
+				const char *part_name, void *buffer,
+				u32 buffer_size, char *response);
+
+/**
+ * fastboot_block_stream_write() - Write the next part of a streamed image
+ *
+ * @data: Data received
+ * @len: Number of bytes of @data
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_write(const void *data, u32 len, char *response);
+
+/**
+ * fastboot_block_stream_finish() - Finish flashing a streamed image
+ *
+ * This waits for the last write, so the download buffer can be used again
+ * once it returns, whether the image was written or not.
+ *
+ * @response: Pointer to fastboot response buffer
+ * Return: 0 on success, -ve on error
+ */
+int fastboot_block_stream_finish(char *response);
+
 #endif // _FB_BLOCK_H_
@@ -34,6 +34,49 @@ int gzip_parse_header(const unsigned char *src, unsigned long len);
  */
 int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *lenp);
 
+struct gunzip_stream;
+
+/**
+ * gunzip_stream_init() - Start decompressing gzipped data piece by piece
+ *
+ * This allows gzipped data to be decompressed as it arrives, e.g. while an
+ * image is being read from storage, rather than only once it is all in
+ * memory.
+ *
+ * @gsp: Returns the new stream, which must be released with
+ *	gunzip_stream_finish()
+ * @dst: Destination for uncompressed data
+ * @dstlen: Size of destination buffer
+ * Return: 0 if OK, -ENOMEM if out of memory, -EIO if zlib failed to start
+ */
+int gunzip_stream_init(struct gunzip_stream **gsp, void *dst, ulong dstlen);
+
+/**
+ * gunzip_stream_feed() - Decompress the next piece of gzipped data
+ *
+ * The data may be split up anywhere, even within the gzip header. The CRC in
+ * the gzip trailer is checked. Data fed in after the end of the trailer is
+ * ignored.
+ *
+ * @gs: Stream to feed
+ * @src: Next piece of compressed data
+ * @len: Length of data at @src
+ * Return: 0 if more data is needed, 1 once the end of the compressed stream
+ * has been reached, -ENOSPC if the destination buffer is too small, -EIO if
+ * the header is invalid or on a decode error
+ */
+int gunzip_stream_feed(struct gunzip_stream *gs, const void *src, ulong len);
+
+/**
+ * gunzip_stream_finish() - Finish decompression and release a stream
+ *
+ * @gs: Stream to finish
+ * @lenp: If not NULL, returns the number of bytes written to the destination
+ * Return: 0 if the whole compressed stream was decoded, -EIO if it was cut
+ * short
+ */
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp);
+
 /**
  * zunzip() - Uncompress blocks compressed with zlib without headers
  *
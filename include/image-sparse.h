@@ -26,6 +26,17 @@ struct sparse_storage {
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
 
+	/*
+	 * Optional: make blocks read as zeroes without writing them, e.g. by
+	 * erasing them, for runs of zeroes in the image. The range is aligned
+	 * to erase_blks blocks. Returns the number of blocks cleared, and
+	 * anything but blkcnt makes the caller write zeroes to them instead.
+	 */
+	lbaint_t	(*erase)(struct sparse_storage *info,
+				 lbaint_t blk,
+				 lbaint_t blkcnt);
+	u32		erase_blks;
+
 	void		(*mssg)(const char *str, char *response);
 };
 
@@ -42,3 +53,125 @@ static inline int is_sparse_image(void *buf)
 
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * enum sparse_stream_state - What a sparse stream expects next
+ *
+ * @SPARSE_STREAM_HEADER: The file header, which tells a sparse image from a
+ *	raw one
+ * @SPARSE_STREAM_CHUNK: A chunk header
+ * @SPARSE_STREAM_RAW: Data to write, from a raw chunk or a raw image
+ * @SPARSE_STREAM_FILL: The value of a fill chunk
+ * @SPARSE_STREAM_DONE: Nothing, all chunks have been seen
+ */
+enum sparse_stream_state {
+	SPARSE_STREAM_HEADER,
+	SPARSE_STREAM_CHUNK,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_DONE,
+};
+
+/**
+ * struct sparse_stream_buf - One of the two buffers of a sparse stream
+ *
+ * @data: Buffer, of sparse_stream.buf_size bytes
+ * @blk: Block to write the buffer to
+ * @len: Number of bytes in the buffer
+ */
+struct sparse_stream_buf {
+	void *data;
+	lbaint_t blk;
+	size_t len;
+};
+
+/**
+ * struct sparse_stream - An image which is written as it arrives
+ *
+ * Data is collected in one buffer while the other is written to the device,
+ * in a thread when UTHREAD is enabled. The @info->write method must write
+ * exactly the blocks asked for, as a block device does.
+ *
+ * @info: Where to write the image
+ * @state: What is expected next
+ * @sparse: true if this is a sparse image, false for a raw one
+ * @write_failed: true if a write of one of the buffers failed
+ * @err: First error seen, which stops the stream
+ * @sparse_header: Header of the sparse image
+ * @chunk_header: Header of the current chunk
+ * @hdr: Header (or fill value) being collected
+ * @hdr_len: Number of bytes in @hdr
+ * @skip: Number of bytes to drop before carrying on in @state
+ * @left: Number of bytes of raw data left in the current chunk
+ * @chunk: Index of the current chunk
+ * @blk: Next block to write, after the data already given to a write
+ * @bytes_written: Number of bytes written so far
+ * @total_blocks: Number of blocks of the sparse image seen so far
+ * @buf: The two buffers
+ * @buf_size: Size of each buffer in bytes, a whole number of blocks
+ * @cur: Index of the buffer being filled
+ * @writing: Buffer being written, NULL if none
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	enum sparse_stream_state state;
+	bool sparse;
+	bool write_failed;
+	int err;
+	sparse_header_t sparse_header;
+	chunk_header_t chunk_header;
+	u8 hdr[sizeof(sparse_header_t)];
+	size_t hdr_len;
+	u64 skip;
+	u64 left;
+	unsigned int chunk;
+	lbaint_t blk;
+	u64 bytes_written;
+	u32 total_blocks;
+	struct sparse_stream_buf buf[2];
+	size_t buf_size;
+	int cur;
+	struct sparse_stream_buf *writing;
+};
+
+/**
+ * sparse_stream_start() - Start writing an image as it arrives
+ *
+ * The image may be a sparse image or a raw one, which is written from the
+ * start of @info.
+ *
+ * @ss: Stream to set up
+ * @info: Where to write the image
+ * @buf: Buffer space, split into two for the stream to use
+ * @buf_size: Size of @buf in bytes, at least two blocks
+ * Return: 0 if OK, -ENOSPC if @buf is too small
+ */
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			void *buf, size_t buf_size);
+
+/**
+ * sparse_stream_write() - Write the next part of an image
+ *
+ * @ss: Stream to write to
+ * @data: Data received
+ * @len: Number of bytes of @data
+ * @response: Set to a message, through @info->mssg, on error
+ * Return: 0 if OK, -ve on error, after which the stream is finished by
+ *	sparse_stream_finish()
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data, size_t len,
+			char *response);
+
+/**
+ * sparse_stream_finish() - Write what is left of an image and check it
+ *
+ * This waits for all writes to finish, so the buffer can be used again
+ * afterwards.
+ *
+ * @ss: Stream to finish
+ * @part_name: Name of the partition written, for the message
+ * @response: Set to a message, through @info->mssg, on error
+ * Return: 0 if OK, -ve on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response);
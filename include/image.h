@@ -1345,6 +1345,42 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       const void *key_blob, const void *data,
 			       size_t size);
 
+/**
+ * struct fit_image_digest - Digest of an image computed ahead of verification
+ *
+ * @noffset:	Offset in the FIT of the hash node this digest belongs to
+ * @value:	Digest value
+ * @value_len:	Length of @value in bytes
+ */
+struct fit_image_digest {
+	int noffset;
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int value_len;
+};
+
+/**
+ * fit_image_verify_with_digests() - Verify an image using known digests
+ *
+ * This works like fit_image_verify_with_data() but hash nodes listed in
+ * @digests are checked against the supplied value rather than hashing @data
+ * again. This is used by loaders which hash the data while reading it.
+ * Signatures are always checked against @data.
+ *
+ * @fit:	Pointer to the FIT format image header
+ * @image_offset: Offset in @fit of image to verify
+ * @key_blob:	FDT containing public keys
+ * @data:	Image data to verify
+ * @size:	Size of image data
+ * @digests:	Precomputed digests, may be NULL if @digest_count is 0
+ * @digest_count: Number of entries in @digests
+ * Return: 1 if all hashes are valid, 0 otherwise
+ */
+int fit_image_verify_with_digests(const void *fit, int image_noffset,
+				  const void *key_blob, const void *data,
+				  size_t size,
+				  const struct fit_image_digest *digests,
+				  int digest_count);
+
 int fit_image_verify(const void *fit, int noffset);
 #if CONFIG_IS_ENABLED(FIT_SIGNATURE)
 int fit_config_verify(const void *fit, int conf_noffset);
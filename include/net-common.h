@@ -267,6 +267,17 @@ enum eth_recv_flags {
 	ETH_RECV_CHECK_DEVICE		= 1 << 0,
 };
 
+/**
+ * struct eth_rx_pkt - A packet handed over by eth_ops::recv_batch()
+ *
+ * @packet: Start of the packet, in the driver's receive buffer
+ * @length: Length of the packet in bytes
+ */
+struct eth_rx_pkt {
+	uchar *packet;
+	int length;
+};
+
 /**
  * struct eth_ops - functions of Ethernet MAC controllers
  *
@@ -280,6 +291,17 @@ enum eth_recv_flags {
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
+ * recv_batch: Check if the hardware received packets and hand back up to
+ *	       "count" of them in "pkts", in the order they were received.
+ *	       Return the number of packets, 0 if the receive FIFO is empty or
+ *	       an error. When supplied, eth_rx() uses this instead of recv(), so
+ *	       that the driver can pass over a whole run of its receive ring in
+ *	       one call. recv() and free_pkt() must still be provided, as the
+ *	       lwIP stack and DSA ports receive through them - optional
+ * free_batch: Give back the first "count" packets from the last recv_batch()
+ *	       once the network stack has processed them, so that the driver
+ *	       can refill its receive ring and tell the hardware once for the
+ *	       whole batch - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -302,6 +324,10 @@ struct eth_ops {
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
+	int (*recv_batch)(struct udevice *dev, int flags,
+			  struct eth_rx_pkt *pkts, int count);
+	int (*free_batch)(struct udevice *dev, struct eth_rx_pkt *pkts,
+			  int count);
 	void (*stop)(struct udevice *dev);
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
 	int (*write_hwaddr)(struct udevice *dev);
@@ -612,6 +638,10 @@ enum wget_http_method {
  * @hdr_cont_len:	content length according to headers. Filled by wget
  * @headers:		buffer for headers. Filled by wget.
  * @silent:		do not print anything to the console. Filled by client.
+ * @jobs:		number of range requests to make in parallel, 0 or 1 for
+ *			a single request. Filled by client.
+ * @hash:		"<algo>:<hex digest>" the download must match, or NULL.
+ *			Filled by client.
  */
 struct wget_http_info {
 	enum wget_http_method method;
@@ -623,6 +653,8 @@ struct wget_http_info {
 	u32 hdr_cont_len;
 	char *headers;
 	bool silent;
+	u32 jobs;
+	const char *hash;
 };
 
 extern struct wget_http_info default_wget_info;
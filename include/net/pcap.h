@@ -4,19 +4,44 @@
  * Ramon Fried <rfried.dev@gmail.com>
  */
 
+/**
+ * enum pcap_filter - Protocols which can be selected for capture
+ *
+ * @PCAP_FILTER_ARP:	ARP packets
+ * @PCAP_FILTER_IP:	all IPv4 packets
+ * @PCAP_FILTER_IP6:	all IPv6 packets
+ * @PCAP_FILTER_ICMP:	ICMP over IPv4 and ICMPv6
+ * @PCAP_FILTER_UDP:	UDP over IPv4 or IPv6
+ * @PCAP_FILTER_TCP:	TCP over IPv4 or IPv6
+ */
+enum pcap_filter {
+	PCAP_FILTER_ARP,
+	PCAP_FILTER_IP,
+	PCAP_FILTER_IP6,
+	PCAP_FILTER_ICMP,
+	PCAP_FILTER_UDP,
+	PCAP_FILTER_TCP,
+};
+
 /**
  * pcap_init() - Initialize PCAP memory buffer
  *
+ * Once the buffer is full, the oldest packets are overwritten by new ones.
+ *
  * @paddr	physicaly memory address to store buffer
  * @size	maximum size of capture file in memory
+ * @snaplen	maximum number of bytes to keep from each packet, 0 for all
  *
  * Return:	0 on success, -ERROR on error
  */
-int pcap_init(phys_addr_t paddr, unsigned long size);
+int pcap_init(phys_addr_t paddr, unsigned long size, unsigned int snaplen);
 
 /**
  * pcap_start_stop() - start / stop pcap capture
  *
+ * Stopping the capture puts the packets in order in the buffer, so that it
+ * holds a PCAP file, and sets the "pcapsize" environment variable to its size.
+ *
  * @start	if true, start capture if false stop capture
  *
  * Return:	0 on success, -ERROR on error
@@ -30,6 +55,19 @@ int pcap_start_stop(bool start);
  */
 int pcap_clear(void);
 
+/**
+ * pcap_set_filter() - only capture packets of a protocol
+ *
+ * Packets of any of the protocols selected are captured. Until one is
+ * selected, all packets are.
+ *
+ * @name	name of the protocol (see enum pcap_filter), or "all" to
+ *		capture all packets again
+ *
+ * Return:	0 on success, -EINVAL if the protocol is not known
+ */
+int pcap_set_filter(const char *name);
+
 /**
  * pcap_print_status() - print status of pcap capture
  *
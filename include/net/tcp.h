@@ -86,7 +86,15 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_8	0x08
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
-#define TCP_SCALE	0x01		/* Scale			*/
+
+/* Receive window, by default one segment for each receive buffer */
+#if CONFIG_PROT_TCP_RCV_WND
+  #define TCP_RCV_WND_SIZE	CONFIG_PROT_TCP_RCV_WND
+#elif PKTBUFSRX != 0
+  #define TCP_RCV_WND_SIZE	(PKTBUFSRX * TCP_MSS)
+#else
+  #define TCP_RCV_WND_SIZE	(4 * TCP_MSS)
+#endif
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -358,6 +366,9 @@ enum tcp_status {
  * @rmt_timestamp:	Remote timestamp
  *
  * @rmt_win_scale:	Remote window scale factor
+ * @rmt_win_scale_set:	Non-zero if the remote end sent a window scale option
+ * @loc_win_scale:	Local window scale factor, zero unless both ends sent
+ *			  the window scale option
  *
  * @lost:		Used for SACK
  *
@@ -420,6 +431,8 @@ struct tcp_stream {
 
 	/* TCP window scale */
 	u8		rmt_win_scale;
+	u8		rmt_win_scale_set;
+	u8		loc_win_scale;
 
 	/* TCP sliding window control used to request re-TX */
 	struct tcp_sack_v lost;
@@ -8,6 +8,8 @@
 #ifndef __SANDBOX_HOST__
 #define __SANDBOX_HOST__
 
+#include <linux/list.h>
+
 /**
  * struct host_sb_plat - platform data for a host device
  *
@@ -21,6 +23,29 @@ struct host_sb_plat {
 	int fd;
 };
 
+/* Number of requests which a host block device can have in flight */
+#define HOST_BLK_QUEUE_DEPTH	16
+
+/**
+ * struct host_blk_priv - private data for a host block device
+ *
+ * Asynchronous requests are queued when they are submitted and all carried
+ * out at the next poll, which stands in for the time a real device takes to
+ * complete them. A caller keeping more requests in flight therefore needs
+ * fewer polls.
+ *
+ * @queue: Requests submitted since the last poll
+ * @queued: Number of requests in @queue
+ * @polls: Number of polls which finished requests
+ * @reads: Number of reads from the backing file
+ */
+struct host_blk_priv {
+	struct list_head queue;
+	int queued;
+	uint polls;
+	uint reads;
+};
+
 /**
  * struct host_ops - operations supported by UCLASS_HOST
  */
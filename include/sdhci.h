@@ -125,6 +125,7 @@
 #define  SDHCI_INT_CARD_INSERT	BIT(6)
 #define  SDHCI_INT_CARD_REMOVE	BIT(7)
 #define  SDHCI_INT_CARD_INT	BIT(8)
+#define  SDHCI_INT_CQE		BIT(14)
 #define  SDHCI_INT_ERROR	BIT(15)
 #define  SDHCI_INT_TIMEOUT	BIT(16)
 #define  SDHCI_INT_CRC		BIT(17)
@@ -256,8 +257,11 @@
 #define SDHCI_QUIRK_SUPPORT_SINGLE	(1 << 10)
 /* Capability register bit-63 indicates HS400 support */
 #define SDHCI_QUIRK_CAPS_BIT63_FOR_HS400	BIT(11)
+/* Controller does not handle SET_BLOCK_COUNT ahead of a data command */
+#define SDHCI_QUIRK_BROKEN_CMD23	BIT(12)
 
 /* to make gcc happy */
+struct cqhci_host_ops;
 struct sdhci_host;
 
 /*
@@ -308,8 +312,15 @@ struct sdhci_ops {
 #else
 #define ADMA_DESC_LEN	8
 #endif
+#if CONFIG_MMC_SDHCI_ADMA_DESCS
+#define ADMA_TABLE_NO_ENTRIES CONFIG_MMC_SDHCI_ADMA_DESCS
+#else
 #define ADMA_TABLE_NO_ENTRIES DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * \
 			      MMC_MAX_BLOCK_LEN, ADMA_MAX_LEN)
+#endif
+/* Most blocks in one transfer, which must fit in the descriptor table */
+#define ADMA_MAX_BLK_COUNT (ADMA_TABLE_NO_ENTRIES * ADMA_MAX_LEN / \
+			    MMC_MAX_BLOCK_LEN)
 
 #define ADMA_TABLE_SZ (ADMA_TABLE_NO_ENTRIES * ADMA_DESC_LEN)
 
@@ -533,6 +544,12 @@ void sdhci_set_voltage(struct sdhci_host *host);
  */
 void sdhci_set_control_reg(struct sdhci_host *host);
 extern const struct dm_mmc_ops sdhci_ops;
+
+/*
+ * Hooks for a command queue engine in the controller, which switch it
+ * between ADMA2 tasks and single commands
+ */
+extern const struct cqhci_host_ops sdhci_cqhci_ops;
 #else
 #endif
 
@@ -30,6 +30,22 @@ typedef struct {
 
 extern const uint8_t sha512_der_prefix[];
 
+/**
+ * sha512_process() - Hash whole blocks of data
+ *
+ * This is the portable C code unless the architecture provides its own.
+ *
+ * @ctx: Context to update
+ * @data: Data to hash
+ * @blocks: Number of SHA512_BLOCK_SIZE blocks in @data
+ */
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks);
+
+/* The portable C version of sha512_process() */
+void sha512_process_generic(sha512_context *ctx, const unsigned char *data,
+			    unsigned int blocks);
+
 void sha512_starts(sha512_context * ctx);
 void sha512_update(sha512_context *ctx, const uint8_t *input, uint32_t length);
 void sha512_finish(sha512_context * ctx, uint8_t digest[SHA512_SUM_LEN]);
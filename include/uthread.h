@@ -101,6 +101,12 @@ int uthread_create(struct uthread *uthr, void (*fn)(void *), void *arg,
  * Return: true if a thread was scheduled, false if no runnable thread was found
  */
 bool uthread_schedule(void);
+/**
+ * uthread_self() - return the thread which is currently running
+ *
+ * Return: the current thread; the main thread has its own static object
+ */
+struct uthread *uthread_self(void);
 /**
  * uthread_grp_new_id() - return a new ID for a thread group
  *
@@ -169,6 +175,11 @@ static inline bool uthread_schedule(void)
 	return false;
 }
 
+static inline struct uthread *uthread_self(void)
+{
+	return NULL;
+}
+
 static inline unsigned int uthread_grp_new_id(void)
 {
 	return 0;
@@ -103,6 +103,7 @@ struct vring {
  * @vring: actual memory layout for this queue
  * @vring_desc_shadow: guest-only copy of descriptors
  * @event: host publishes avail event idx
+ * @indirect: chains of more than one buffer go in an indirect table
  * @free_head: head of free buffer list
  * @num_added: number we've added since last sync
  * @last_used_idx: last used index we've seen
@@ -117,6 +118,7 @@ struct virtqueue {
 	struct vring vring;
 	struct vring_desc_shadow *vring_desc_shadow;
 	bool event;
+	bool indirect;
 	unsigned int free_head;
 	unsigned int num_added;
 	u16 last_used_idx;
@@ -223,7 +225,7 @@ void virtqueue_kick(struct virtqueue *vq);
  * operations at the same time (except where noted).
  *
  * Returns NULL if there are no used buffers, or the memory buffer
- * handed to virtqueue_add_*().
+ * handed to virtqueue_add_*(), i.e. the first of the scatterlists.
  */
 void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 
@@ -8,6 +8,7 @@
 #include <command.h>
 #include <console.h>
 #include <div64.h>
+#include <errno.h>
 #include <gzip.h>
 #include <image.h>
 #include <malloc.h>
@@ -82,6 +83,78 @@ __rcode int gunzip(void *dst, int dstlen, unsigned char *src, unsigned long *len
 	return zunzip(dst, dstlen, src, lenp, 1, offset);
 }
 
+struct gunzip_stream {
+	z_stream s;
+	bool done;
+	void *dst;
+};
+
+int gunzip_stream_init(struct gunzip_stream **gsp, void *dst, ulong dstlen)
+{
+	struct gunzip_stream *gs;
+	int r;
+
+	gs = calloc(1, sizeof(*gs));
+	if (!gs)
+		return -ENOMEM;
+
+	gs->s.zalloc = gzalloc;
+	gs->s.zfree = gzfree;
+	/* let zlib parse the gzip header, however it is split up */
+	r = inflateInit2(&gs->s, 16 + MAX_WBITS);
+	if (r != Z_OK) {
+		printf("Error: inflateInit2() returned %d\n", r);
+		free(gs);
+		return -EIO;
+	}
+	gs->dst = dst;
+	gs->s.next_out = dst;
+	gs->s.avail_out = dstlen;
+	*gsp = gs;
+
+	return 0;
+}
+
+int gunzip_stream_feed(struct gunzip_stream *gs, const void *src, ulong len)
+{
+	int r;
+
+	if (gs->done)
+		return 1;
+
+	gs->s.next_in = (unsigned char *)src;
+	gs->s.avail_in = len;
+	while (gs->s.avail_in) {
+		r = inflate(&gs->s, Z_NO_FLUSH);
+		if (r == Z_STREAM_END) {
+			gs->done = true;
+			return 1;
+		}
+		if (r == Z_BUF_ERROR && !gs->s.avail_out) {
+			puts("Error: gunzip output buffer too small\n");
+			return -ENOSPC;
+		}
+		if (r != Z_OK) {
+			printf("Error: inflate() returned %d\n", r);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int gunzip_stream_finish(struct gunzip_stream *gs, ulong *lenp)
+{
+	int ret = gs->done ? 0 : -EIO;
+
+	if (lenp)
+		*lenp = gs->s.next_out - (unsigned char *)gs->dst;
+	inflateEnd(&gs->s);
+	free(gs);
+
+	return ret;
+}
+
 #ifdef CONFIG_CMD_UNZIP
 __weak
 void gzwrite_progress_init(size_t expectedsize)
@@ -42,10 +42,16 @@
 #include <malloc.h>
 #include <part.h>
 #include <sparse_format.h>
+#include <uthread.h>
 #include <asm/cache.h>
 
 #include <linux/math64.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
+#include <linux/string.h>
+
+/* Runs of zeroes shorter than this are written, as erasing is not worth it */
+#define SPARSE_ERASE_MIN_BYTES	SZ_128K
 
 static void default_log(const char *ignored, char *response) {}
 
@@ -106,6 +112,161 @@ write_fail:
 	return -1;
 }
 
+static lbaint_t write_sparse_chunk_fill(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					uint32_t fill_val, char *response)
+{
+	uint32_t *fill_buf;
+	int fill_buf_num_blks;
+	lbaint_t blks, start = blk;
+	int i;
+	int j;
+
+	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	fill_buf = (uint32_t *)
+		   memalign(ARCH_DMA_MINALIGN,
+			    ROUNDUP(info->blksz * fill_buf_num_blks,
+				    ARCH_DMA_MINALIGN));
+	if (!fill_buf) {
+		info->mssg("Malloc failed for: CHUNK_TYPE_FILL", response);
+		return -1;
+	}
+
+	for (i = 0; i < (info->blksz * fill_buf_num_blks / sizeof(fill_val));
+	     i++)
+		fill_buf[i] = fill_val;
+
+	if (blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		free(fill_buf);
+		return -1;
+	}
+
+	for (i = 0; i < blkcnt;) {
+		j = blkcnt - i;
+		if (j > fill_buf_num_blks)
+			j = fill_buf_num_blks;
+		blks = info->write(info, blk, j, fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (blks < j) {
+			printf("%s: %s " LBAFU " [%d]\n", __func__,
+			       "Write failed, block #", blk, j);
+			info->mssg("flash write failure", response);
+			free(fill_buf);
+			return -1;
+		}
+		blk += blks;
+		i += j;
+	}
+	free(fill_buf);
+
+	return blk - start;
+}
+
+/*
+ * Make blocks read as zeroes, erasing as much of them as the storage can and
+ * writing zeroes to the rest
+ */
+static lbaint_t write_sparse_chunk_zero(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					char *response)
+{
+	u32 align = max(info->erase_blks, 1U);
+	lbaint_t start, end;
+	u32 rem;
+
+	if (blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -1;
+	}
+
+	div_u64_rem(blk, align, &rem);
+	start = rem ? blk + align - rem : blk;
+	div_u64_rem(blk + blkcnt, align, &rem);
+	end = blk + blkcnt - rem;
+	if (!info->erase || end <= start ||
+	    (end - start) * info->blksz < SPARSE_ERASE_MIN_BYTES ||
+	    info->erase(info, start, end - start) != end - start)
+		return write_sparse_chunk_fill(info, blk, blkcnt, 0, response);
+
+	if (start > blk &&
+	    IS_ERR_VALUE(write_sparse_chunk_fill(info, blk, start - blk, 0,
+						 response)))
+		return -1;
+	if (end < blk + blkcnt &&
+	    IS_ERR_VALUE(write_sparse_chunk_fill(info, end, blk + blkcnt - end,
+						 0, response)))
+		return -1;
+
+	return blkcnt;
+}
+
+/* Return the number of blocks at the start of @data which are all zeroes */
+static lbaint_t sparse_zero_blks(struct sparse_storage *info, const void *data,
+				 lbaint_t blkcnt)
+{
+	lbaint_t i;
+
+	for (i = 0; i < blkcnt; i++) {
+		if (memchr_inv(data + i * info->blksz, 0, info->blksz))
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Write a raw chunk. If the storage can erase, long runs of zeroes in it are
+ * erased rather than written, as they are in images of mostly empty
+ * filesystems.
+ */
+static lbaint_t write_sparse_chunk_data(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					void *data, char *response)
+{
+	lbaint_t min_blks = SPARSE_ERASE_MIN_BYTES / info->blksz;
+	lbaint_t start = blk;
+	lbaint_t i, j, zeros = 0;
+	lbaint_t blks;
+
+	if (!info->erase)
+		return write_sparse_chunk_raw(info, blk, blkcnt, data,
+					      response);
+
+	for (i = 0; i < blkcnt; i = j + zeros) {
+		for (j = i; j < blkcnt; j += zeros + 1) {
+			zeros = sparse_zero_blks(info, data + j * info->blksz,
+						 blkcnt - j);
+			if (zeros >= min_blks)
+				break;
+		}
+		if (j >= blkcnt) {
+			j = blkcnt;
+			zeros = 0;
+		}
+
+		if (j > i) {
+			blks = write_sparse_chunk_raw(info, blk, j - i,
+						      data + i * info->blksz,
+						      response);
+			if (IS_ERR_VALUE(blks))
+				return blks;
+			blk += blks;
+		}
+		if (zeros) {
+			blks = write_sparse_chunk_zero(info, blk, zeros,
+						       response);
+			if (IS_ERR_VALUE(blks))
+				return blks;
+			blk += blks;
+		}
+	}
+
+	return blk - start;
+}
+
 int write_sparse_image(struct sparse_storage *info,
 		       const char *part_name, void *data, char *response)
 {
@@ -116,16 +277,10 @@ int write_sparse_image(struct sparse_storage *info,
 	unsigned int chunk;
 	unsigned int offset;
 	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
 	uint32_t fill_val;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
-
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
 
 	/* Read and skip over sparse image header */
 	sparse_header = (sparse_header_t *)data;
@@ -209,8 +364,8 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 
-			blks = write_sparse_chunk_raw(info, blk, blkcnt,
-						      data, response);
+			blks = write_sparse_chunk_data(info, blk, blkcnt,
+						       data, response);
 			if (IS_ERR_VALUE(blks))
 				return -1;
 
@@ -227,58 +382,23 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
-			}
-
 			fill_val = *(uint32_t *)data;
 			data = (char *)data + sizeof(uint32_t);
 
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
+			if (fill_val)
+				blks = write_sparse_chunk_fill(info, blk, blkcnt,
+							       fill_val,
+							       response);
+			else
+				blks = write_sparse_chunk_zero(info, blk, blkcnt,
+							       response);
+			if (IS_ERR_VALUE(blks))
 				return -1;
-			}
 
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
+			blk += blks;
 			bytes_written += ((u64)blkcnt) * info->blksz;
 			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
 							 sparse_header->blk_sz);
-			free(fill_buf);
 			break;
 
 		case CHUNK_TYPE_DONT_CARE:
@@ -316,3 +436,393 @@ int write_sparse_image(struct sparse_storage *info,
 
 	return 0;
 }
+
+static void sparse_stream_writer(void *arg)
+{
+	struct sparse_stream *ss = arg;
+	struct sparse_stream_buf *buf = ss->writing;
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt = buf->len / info->blksz;
+	lbaint_t blks;
+
+	blks = info->write(info, buf->blk, blkcnt, buf->data);
+	if (blks != blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, buf->blk, blkcnt);
+		ss->write_failed = true;
+	}
+	buf->len = 0;
+	ss->writing = NULL;
+}
+
+/* Wait for the buffer being written, so that the device is free */
+static int sparse_stream_sync(struct sparse_stream *ss, char *response)
+{
+	while (ss->writing)
+		uthread_schedule();
+
+	if (ss->write_failed) {
+		ss->info->mssg("flash write failure", response);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Start writing the buffer being filled, padded to a whole number of blocks,
+ * and switch to the other one. The write runs in a thread if it can, so that
+ * more data can be received while it is in progress.
+ */
+static int sparse_stream_submit(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	struct sparse_stream_buf *buf = &ss->buf[ss->cur];
+	lbaint_t blkcnt;
+	int ret;
+
+	if (!buf->len)
+		return 0;
+
+	blkcnt = DIV_ROUND_UP(buf->len, info->blksz);
+	memset(buf->data + buf->len, '\0', blkcnt * info->blksz - buf->len);
+	buf->len = blkcnt * info->blksz;
+	if (buf->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -ENOSPC;
+	}
+
+	ret = sparse_stream_sync(ss, response);
+	if (ret)
+		return ret;
+
+	ss->blk += blkcnt;
+	ss->bytes_written += buf->len;
+	ss->writing = buf;
+	if (uthread_create(NULL, sparse_stream_writer, ss, 0, 0))
+		sparse_stream_writer(ss);
+	ss->cur ^= 1;
+
+	return 0;
+}
+
+/* Copy data to be written at the next block into the buffers */
+static int sparse_stream_copy(struct sparse_stream *ss, const void *data,
+			      size_t len, char *response)
+{
+	struct sparse_stream_buf *buf;
+	size_t n;
+	int ret;
+
+	while (len) {
+		buf = &ss->buf[ss->cur];
+		if (!buf->len)
+			buf->blk = ss->blk;
+		n = min(len, ss->buf_size - buf->len);
+		memcpy(buf->data + buf->len, data, n);
+		buf->len += n;
+		data += n;
+		len -= n;
+		if (buf->len == ss->buf_size) {
+			ret = sparse_stream_submit(ss, response);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Collect a header which may be split across several calls. Return: true
+ * once all @size bytes of it are in ss->hdr
+ */
+static bool sparse_stream_gather(struct sparse_stream *ss, const void **data,
+				 size_t *len, size_t size)
+{
+	size_t n = min(*len, size - ss->hdr_len);
+
+	memcpy(ss->hdr + ss->hdr_len, *data, n);
+	ss->hdr_len += n;
+	*data += n;
+	*len -= n;
+	if (ss->hdr_len < size)
+		return false;
+	ss->hdr_len = 0;
+
+	return true;
+}
+
+static void sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+
+	if (++ss->chunk < sparse_header->total_chunks)
+		ss->state = SPARSE_STREAM_CHUNK;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+}
+
+static int sparse_stream_header(struct sparse_stream *ss, char *response)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+	struct sparse_storage *info = ss->info;
+	unsigned int offset;
+
+	/* anything else is written as it is */
+	if (!is_sparse_image(ss->hdr)) {
+		puts("Flashing Raw Image\n");
+		ss->state = SPARSE_STREAM_RAW;
+		ss->left = U64_MAX;
+		return sparse_stream_copy(ss, ss->hdr, sizeof(*sparse_header),
+					  response);
+	}
+
+	memcpy(sparse_header, ss->hdr, sizeof(*sparse_header));
+	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	if (offset || sparse_header->file_hdr_sz < sizeof(*sparse_header) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse_header->blk_sz);
+		info->mssg("sparse image block size issue", response);
+		return -EINVAL;
+	}
+
+	puts("Flashing Sparse Image\n");
+	ss->sparse = true;
+	ss->skip = sparse_header->file_hdr_sz - sizeof(*sparse_header);
+	if (sparse_header->total_chunks)
+		ss->state = SPARSE_STREAM_CHUNK;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+
+	return 0;
+}
+
+static int sparse_stream_chunk(struct sparse_stream *ss, char *response)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+	chunk_header_t *chunk_header = &ss->chunk_header;
+	struct sparse_storage *info = ss->info;
+	u64 chunk_data_sz;
+	lbaint_t blkcnt;
+	int ret;
+
+	memcpy(chunk_header, ss->hdr, sizeof(*chunk_header));
+	debug("=== Chunk Header ===\n");
+	debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+	debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+	debug("total_size: 0x%x\n", chunk_header->total_sz);
+
+	/* skip the rest of a header which is longer than expected */
+	ss->skip = sparse_header->chunk_hdr_sz - sizeof(*chunk_header);
+	chunk_data_sz = (u64)sparse_header->blk_sz * chunk_header->chunk_sz;
+	blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_header->total_sz !=
+		    sparse_header->chunk_hdr_sz + chunk_data_sz) {
+			info->mssg("Bogus chunk size for chunk type Raw",
+				   response);
+			return -EINVAL;
+		}
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->left = chunk_data_sz;
+		ss->state = SPARSE_STREAM_RAW;
+		if (!ss->left)
+			sparse_stream_next_chunk(ss);
+		break;
+
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz !=
+		    sparse_header->chunk_hdr_sz + sizeof(uint32_t)) {
+			info->mssg("Bogus chunk size for chunk type FILL",
+				   response);
+			return -EINVAL;
+		}
+		ss->state = SPARSE_STREAM_FILL;
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		ret = sparse_stream_submit(ss, response);
+		if (!ret)
+			ret = sparse_stream_sync(ss, response);
+		if (ret)
+			return ret;
+		ss->blk += info->reserve(info, ss->blk, blkcnt);
+		ss->total_blocks += chunk_header->chunk_sz;
+		sparse_stream_next_chunk(ss);
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz !=
+		    sparse_header->chunk_hdr_sz + sizeof(uint32_t)) {
+			info->mssg("Bogus chunk size for chunk type CRC32",
+				   response);
+			return -EINVAL;
+		}
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->skip += sizeof(uint32_t);
+		sparse_stream_next_chunk(ss);
+		break;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		info->mssg("Unknown chunk type", response);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int sparse_stream_fill(struct sparse_stream *ss, char *response)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+	chunk_header_t *chunk_header = &ss->chunk_header;
+	struct sparse_storage *info = ss->info;
+	u64 chunk_data_sz;
+	lbaint_t blkcnt;
+	lbaint_t blks;
+	int ret;
+
+	ret = sparse_stream_submit(ss, response);
+	if (!ret)
+		ret = sparse_stream_sync(ss, response);
+	if (ret)
+		return ret;
+
+	chunk_data_sz = (u64)sparse_header->blk_sz * chunk_header->chunk_sz;
+	blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+	if (*(uint32_t *)ss->hdr)
+		blks = write_sparse_chunk_fill(info, ss->blk, blkcnt,
+					       *(uint32_t *)ss->hdr, response);
+	else
+		blks = write_sparse_chunk_zero(info, ss->blk, blkcnt,
+					       response);
+	if (IS_ERR_VALUE(blks))
+		return -EIO;
+
+	ss->blk += blks;
+	ss->bytes_written += (u64)blkcnt * info->blksz;
+	ss->total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
+					     sparse_header->blk_sz);
+	sparse_stream_next_chunk(ss);
+
+	return 0;
+}
+
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			void *buf, size_t buf_size)
+{
+	size_t half = ALIGN_DOWN(buf_size / 2, info->blksz);
+
+	if (!half)
+		return -ENOSPC;
+
+	memset(ss, '\0', sizeof(*ss));
+	if (!info->mssg)
+		info->mssg = default_log;
+	ss->info = info;
+	ss->blk = info->start;
+	ss->buf[0].data = buf;
+	ss->buf[1].data = buf + half;
+	ss->buf_size = half;
+	ss->state = SPARSE_STREAM_HEADER;
+
+	return 0;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data, size_t len,
+			char *response)
+{
+	size_t n;
+	int ret = 0;
+
+	if (ss->err) {
+		ss->info->mssg("flash write failure", response);
+		return ss->err;
+	}
+
+	while (len && !ret) {
+		if (ss->skip) {
+			n = min_t(u64, len, ss->skip);
+			data += n;
+			len -= n;
+			ss->skip -= n;
+			continue;
+		}
+
+		switch (ss->state) {
+		case SPARSE_STREAM_HEADER:
+			if (sparse_stream_gather(ss, &data, &len,
+						 sizeof(sparse_header_t)))
+				ret = sparse_stream_header(ss, response);
+			break;
+		case SPARSE_STREAM_CHUNK:
+			if (sparse_stream_gather(ss, &data, &len,
+						 sizeof(chunk_header_t)))
+				ret = sparse_stream_chunk(ss, response);
+			break;
+		case SPARSE_STREAM_FILL:
+			if (sparse_stream_gather(ss, &data, &len,
+						 sizeof(uint32_t)))
+				ret = sparse_stream_fill(ss, response);
+			break;
+		case SPARSE_STREAM_RAW:
+			n = min_t(u64, len, ss->left);
+			ret = sparse_stream_copy(ss, data, n, response);
+			data += n;
+			len -= n;
+			ss->left -= n;
+			if (!ss->left)
+				sparse_stream_next_chunk(ss);
+			break;
+		case SPARSE_STREAM_DONE:
+			/* anything after the last chunk is ignored */
+			return 0;
+		}
+	}
+	ss->err = ret;
+
+	return ret;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response)
+{
+	int ret = ss->err;
+
+	/* an image too short to have a sparse header is a raw one */
+	if (!ret && ss->state == SPARSE_STREAM_HEADER && ss->hdr_len) {
+		puts("Flashing Raw Image\n");
+		ret = sparse_stream_copy(ss, ss->hdr, ss->hdr_len, response);
+	}
+	if (!ret)
+		ret = sparse_stream_submit(ss, response);
+
+	/* the buffers must not be reused until the last write is done */
+	if (!ret)
+		ret = sparse_stream_sync(ss, response);
+	else
+		while (ss->writing)
+			uthread_schedule();
+	if (ret)
+		return ret;
+
+	if (ss->sparse) {
+		debug("Wrote %d blocks, expected to write %d blocks\n",
+		      ss->total_blocks, ss->sparse_header.total_blks);
+		if (ss->state != SPARSE_STREAM_DONE ||
+		    ss->total_blocks != ss->sparse_header.total_blks) {
+			ss->info->mssg("sparse image write failure", response);
+			return -EIO;
+		}
+	}
+	printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+	       part_name);
+
+	return 0;
+}
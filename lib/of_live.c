@@ -335,6 +335,9 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 		debug("Failed to scan live tree aliases: err=%d\n", ret);
 		return ret;
 	}
+	/* the tree still works without the index, just more slowly */
+	if (of_index_build(*rootp))
+		debug("Failed to index live tree\n");
 	debug("%s: stop\n", __func__);
 
 	if (CONFIG_IS_ENABLED(EVENT)) {
@@ -351,6 +354,7 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 
 void of_live_free(struct device_node *root)
 {
+	of_index_drop(root);
 	/* the tree is stored as a contiguous block of memory */
 	free(root);
 }
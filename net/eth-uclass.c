@@ -435,6 +435,41 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+/**
+ * eth_rx_batch() - Process the packets handed over by recv_batch()
+ *
+ * The packets are given back in one go after processing, rather than one at
+ * a time, so the driver only has to refill its ring and poke the hardware
+ * once per batch.
+ *
+ * @dev: Ethernet device to receive from
+ * Return: number of packets received, 0 if none, or -ve on error
+ */
+static int eth_rx_batch(struct udevice *dev)
+{
+	struct eth_rx_pkt pkts[ETH_PACKETS_BATCH_RECV];
+	struct eth_ops *ops = eth_get_ops(dev);
+	int count;
+	int i;
+
+	count = ops->recv_batch(dev, ETH_RECV_CHECK_DEVICE, pkts,
+				ARRAY_SIZE(pkts));
+	if (count <= 0)
+		return count;
+
+	for (i = 0; i < count;) {
+		net_process_received_packet(pkts[i].packet, pkts[i].length);
+		i++;
+		/* leave the rest with the driver, as recv() would */
+		if (!eth_is_active(dev))
+			break;
+	}
+	if (ops->free_batch)
+		ops->free_batch(dev, pkts, i);
+
+	return count;
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
@@ -450,6 +485,11 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
+	if (eth_get_ops(current)->recv_batch) {
+		ret = eth_rx_batch(current);
+		goto done;
+	}
+
 	/* Process up to 32 packets at one time */
 	flags = ETH_RECV_CHECK_DEVICE;
 	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
@@ -464,6 +504,7 @@ int eth_rx(void)
 		if (!eth_is_active(current))
 			break;
 	}
+done:
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
@@ -39,10 +39,12 @@
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 #include <flash.h>
 #endif
+#include <env.h>
 #include <image.h>
 #include <log.h>
 #include <net.h>
 #include <mapmem.h>
+#include <linux/kernel.h>
 #include "nfs.h"
 #include "nfs-common.h"
 
@@ -68,6 +70,28 @@ int nfs_len;
 
 const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
+/* Most READ requests which can be in flight at once */
+#define NFS_READ_WINDOW_MAX	16
+
+/**
+ * struct nfs_read - A READ request in flight
+ *
+ * @xid: Transaction ID of the request, 0 if this entry is free
+ * @offset: Offset in the file of the data asked for
+ * @len: Number of bytes asked for
+ * @sent: Time at which the request was last sent, in milliseconds
+ */
+struct nfs_read {
+	u32 xid;
+	int offset;
+	int len;
+	ulong sent;
+};
+
+static struct nfs_read nfs_reads[NFS_READ_WINDOW_MAX];
+static int nfs_read_window;	/* number of entries of nfs_reads[] in use */
+static int nfs_read_end;	/* end of the file, once a READ has found it */
+
 enum nfs_version choosen_nfs_version = NFS_V3;
 
 static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
@@ -409,6 +433,74 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+static void nfs_read_send(struct nfs_read *rd)
+{
+	nfs_read_req(rd->offset, rd->len);
+	rd->xid = rpc_id;
+	rd->sent = get_timer(0);
+}
+
+/*
+ * Start reading the file, with up to nfswindowsize requests in flight. The
+ * server may answer them in any order, since each reply is matched to its
+ * request by transaction ID.
+ */
+static void nfs_read_start(void)
+{
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	nfs_read_window = env_get_ulong("nfswindowsize", 10,
+					CONFIG_NFS_READ_WINDOW);
+	nfs_read_window = clamp(nfs_read_window, 1, NFS_READ_WINDOW_MAX);
+	nfs_read_end = INT_MAX;
+	nfs_offset = 0;
+	nfs_len = NFS_READ_SIZE;
+}
+
+/*
+ * Ask for more of the file until the window is full. Requests which have
+ * had no reply within the timeout are sent again, or all requests in flight
+ * if @resend is true.
+ *
+ * Return: number of requests in flight
+ */
+static int nfs_read_fill(bool resend)
+{
+	struct nfs_read *rd;
+	int busy = 0;
+
+	for (rd = nfs_reads; rd < nfs_reads + nfs_read_window; rd++) {
+		/* nothing past the end of the file is needed */
+		if (rd->xid && rd->offset >= nfs_read_end)
+			rd->xid = 0;
+		if (rd->xid) {
+			if (resend || get_timer(rd->sent) >= nfs_timeout)
+				nfs_read_send(rd);
+		} else if (nfs_offset < nfs_read_end) {
+			rd->offset = nfs_offset;
+			rd->len = nfs_len;
+			nfs_offset += nfs_len;
+			nfs_read_send(rd);
+		} else {
+			continue;
+		}
+		busy++;
+	}
+
+	return busy;
+}
+
+static struct nfs_read *nfs_read_find(u32 xid)
+{
+	struct nfs_read *rd;
+
+	for (rd = nfs_reads; rd < nfs_reads + nfs_read_window; rd++) {
+		if (xid && rd->xid == xid)
+			return rd;
+	}
+
+	return NULL;
+}
+
 /**************************************************************************
  * RPC request dispatcher
  **************************************************************************
@@ -438,7 +530,7 @@ void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_fill(true);
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -687,18 +779,20 @@ static int nfs_readlink_reply(uchar *pkt, unsigned int len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned int len)
+static int nfs_read_reply(uchar *pkt, unsigned int len, struct nfs_read **rdp)
 {
 	struct rpc_t rpc_pkt;
+	struct nfs_read *rd;
 	int rlen;
 	uchar *data_ptr;
 
 	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	/* a late reply to a request which has been answered already */
+	rd = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!rd)
 		return -NFS_RPC_DROP;
+	*rdp = rd;
 
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
@@ -711,10 +805,10 @@ static int nfs_read_reply(uchar *pkt, unsigned int len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if (nfs_offset != 0 && !((nfs_offset) %
+	if (rd->offset != 0 && !((rd->offset) %
 			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
 		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
+	if (!(rd->offset % ((NFS_READ_SIZE / 2) * 10)))
 		putc('#');
 
 	if (choosen_nfs_version != NFS_V3) {
@@ -734,10 +828,12 @@ static int nfs_read_reply(uchar *pkt, unsigned int len)
 			&rpc_pkt.u.reply.data[4 + nfsv3_data_offset];
 	}
 
-	if (((uchar *)&rpc_pkt.u.reply.data[0] - (uchar *)&rpc_pkt + rlen) > len)
+	if (((uchar *)&rpc_pkt.u.reply.data[0] - (uchar *)&rpc_pkt + rlen) > len ||
+	    rlen > rd->len)
 		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
+	/* an empty read past the end of the file must not change its size */
+	if (rlen && store_block(data_ptr, rd->offset, rlen))
 		return -9999;
 
 	return rlen;
@@ -745,6 +841,7 @@ static int nfs_read_reply(uchar *pkt, unsigned int len)
 
 void nfs_pkt_recv(uchar *pkt, unsigned int len)
 {
+	struct nfs_read *rd;
 	int rlen;
 	int reply;
 
@@ -813,8 +910,7 @@ void nfs_pkt_recv(uchar *pkt, unsigned int len)
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			nfs_send();
 		}
 		break;
@@ -838,22 +934,34 @@ void nfs_pkt_recv(uchar *pkt, unsigned int len)
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
+		rlen = nfs_read_reply(pkt, len, &rd);
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		nfs_refresh_timeout();
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			if (!rlen) {
+				/* nothing is left from here on */
+				nfs_read_end = min(nfs_read_end, rd->offset);
+				rd->xid = 0;
+			} else if (rlen < rd->len) {
+				/* ask for the rest of a short read */
+				rd->offset += rlen;
+				rd->len -= rlen;
+				nfs_read_send(rd);
+			} else {
+				rd->xid = 0;
+			}
+			if (nfs_read_fill(false))
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
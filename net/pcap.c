@@ -5,6 +5,7 @@
 
 #include <env.h>
 #include <net.h>
+#include <net6.h>
 #include <net/pcap.h>
 #include <time.h>
 #include <linux/errno.h>
@@ -12,15 +13,31 @@
 
 #define LINKTYPE_ETHERNET	1
 
+/* Length of the captured packets, unless set by pcap_init() */
+#define PCAP_SNAPLEN_MAX	65535
+
 static bool initialized;
 static bool running;
-static bool buffer_full;
 static void *buf;
 static unsigned int max_size;
-static unsigned int pos;
+
+/*
+ * The packets are kept in a ring after the file header, overwriting the
+ * oldest ones once it is full, so that a capture left running holds the
+ * packets which led up to a failure. The ring is only turned into a PCAP
+ * file, with the packets in order, when the capture is stopped.
+ */
+static void *ring;
+static unsigned int ring_size;
+static unsigned int ring_first;
+static unsigned int ring_used;
+
+static unsigned int snaplen;
+static unsigned int filter;
 
 static unsigned long incoming_count;
 static unsigned long outgoing_count;
+static unsigned long dropped_count;
 
 struct pcap_header {
 	u32 magic;
@@ -43,12 +60,35 @@ static struct pcap_header file_header = {
 	.magic = 0xa1b2c3d4,
 	.version_major = 2,
 	.version_minor = 4,
-	.snaplen = 65535,
+	.snaplen = PCAP_SNAPLEN_MAX,
 	.network = LINKTYPE_ETHERNET,
 };
 
-int pcap_init(phys_addr_t paddr, unsigned long size)
+static const char *const filter_names[] = {
+	[PCAP_FILTER_ARP] = "arp",
+	[PCAP_FILTER_IP] = "ip",
+	[PCAP_FILTER_IP6] = "ip6",
+	[PCAP_FILTER_ICMP] = "icmp",
+	[PCAP_FILTER_UDP] = "udp",
+	[PCAP_FILTER_TCP] = "tcp",
+};
+
+static void pcap_reset(void)
+{
+	ring_first = 0;
+	ring_used = 0;
+	incoming_count = 0;
+	outgoing_count = 0;
+	dropped_count = 0;
+}
+
+int pcap_init(phys_addr_t paddr, unsigned long size, unsigned int snap)
 {
+	if (size <= sizeof(file_header) + sizeof(struct pcap_packet_header)) {
+		printf("PCAP buffer too small\n");
+		return -EINVAL;
+	}
+
 	buf = map_physmem(paddr, size, 0);
 	if (!buf) {
 		printf("Failed mapping PCAP memory\n");
@@ -58,17 +98,45 @@ int pcap_init(phys_addr_t paddr, unsigned long size)
 	printf("PCAP capture initialized: addr: 0x%lx max length: %lu\n",
 	       (unsigned long)buf, size);
 
+	snaplen = snap && snap < PCAP_SNAPLEN_MAX ? snap : PCAP_SNAPLEN_MAX;
+	file_header.snaplen = snaplen;
 	memcpy(buf, &file_header, sizeof(file_header));
-	pos = sizeof(file_header);
+	ring = buf + sizeof(file_header);
+	ring_size = size - sizeof(file_header);
 	max_size = size;
 	initialized = true;
 	running = false;
-	buffer_full = false;
-	incoming_count = 0;
-	outgoing_count = 0;
+	filter = 0;
+	pcap_reset();
 	return 0;
 }
 
+/* Reverse @len bytes at @p, for rotating the ring in place */
+static void pcap_reverse(u8 *p, unsigned int len)
+{
+	u8 *q = p + len - 1;
+	u8 tmp;
+
+	while (p < q) {
+		tmp = *p;
+		*p++ = *q;
+		*q-- = tmp;
+	}
+}
+
+/* Put the oldest packet at the start of the ring, making a PCAP file */
+static void pcap_finish(void)
+{
+	if (ring_first) {
+		pcap_reverse(ring, ring_first);
+		pcap_reverse(ring + ring_first, ring_size - ring_first);
+		pcap_reverse(ring, ring_size);
+		ring_first = 0;
+	}
+
+	env_set_hex("pcapsize", sizeof(file_header) + ring_used);
+}
+
 int pcap_start_stop(bool start)
 {
 	if (!initialized) {
@@ -77,6 +145,8 @@ int pcap_start_stop(bool start)
 	}
 
 	running = start;
+	if (!start)
+		pcap_finish();
 
 	return 0;
 }
@@ -88,65 +158,175 @@ int pcap_clear(void)
 		return -ENODEV;
 	}
 
-	pos = sizeof(file_header);
-	incoming_count = 0;
-	outgoing_count = 0;
-	buffer_full = false;
+	pcap_reset();
 
 	printf("pcap capture cleared\n");
 	return 0;
 }
 
+int pcap_set_filter(const char *name)
+{
+	int i;
+
+	if (!strcmp(name, "all")) {
+		filter = 0;
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(filter_names); i++) {
+		if (!strcmp(name, filter_names[i])) {
+			filter |= BIT(i);
+			return 0;
+		}
+	}
+
+	printf("error: unknown protocol '%s'\n", name);
+	return -EINVAL;
+}
+
+/* Check whether the capture filter lets a packet through */
+static bool pcap_match(const u8 *packet, size_t len)
+{
+	const struct ethernet_hdr *et = (const void *)packet;
+	const struct ip_hdr *ip;
+	const struct ip6_hdr *ip6;
+	uint hlen = ETHER_HDR_SIZE;
+	uint proto;
+
+	if (len < ETHER_HDR_SIZE)
+		return false;
+
+	proto = ntohs(et->et_protlen);
+	if (proto == PROT_VLAN && len >= VLAN_ETHER_HDR_SIZE) {
+		proto = ntohs(((const struct vlan_ethernet_hdr *)et)->vet_type);
+		hlen = VLAN_ETHER_HDR_SIZE;
+	}
+
+	switch (proto) {
+	case PROT_ARP:
+		return filter & BIT(PCAP_FILTER_ARP);
+	case PROT_IP:
+		if (filter & BIT(PCAP_FILTER_IP))
+			return true;
+		if (len < hlen + IP_HDR_SIZE)
+			return false;
+		ip = (const void *)packet + hlen;
+		proto = ip->ip_p;
+		break;
+	case PROT_IP6:
+		if (filter & BIT(PCAP_FILTER_IP6))
+			return true;
+		if (len < hlen + IP6_HDR_SIZE)
+			return false;
+		ip6 = (const void *)packet + hlen;
+		proto = ip6->nexthdr == PROT_ICMPV6 ? IPPROTO_ICMP :
+			ip6->nexthdr;
+		break;
+	default:
+		return false;
+	}
+
+	switch (proto) {
+	case IPPROTO_ICMP:
+		return filter & BIT(PCAP_FILTER_ICMP);
+	case IPPROTO_UDP:
+		return filter & BIT(PCAP_FILTER_UDP);
+	case IPPROTO_TCP:
+		return filter & BIT(PCAP_FILTER_TCP);
+	}
+
+	return false;
+}
+
+/* Copy into the ring at @offset from the oldest packet, wrapping round */
+static void pcap_ring_write(unsigned int offset, const void *data,
+			    unsigned int len)
+{
+	unsigned int pos = (ring_first + offset) % ring_size;
+	unsigned int part = min(len, ring_size - pos);
+
+	memcpy(ring + pos, data, part);
+	memcpy(ring, data + part, len - part);
+}
+
+/* Drop the oldest packet from the ring */
+static void pcap_ring_drop(void)
+{
+	struct pcap_packet_header header;
+	unsigned int part = min_t(unsigned int, sizeof(header),
+				  ring_size - ring_first);
+	unsigned int len;
+
+	memcpy(&header, ring + ring_first, part);
+	memcpy((void *)&header + part, ring, sizeof(header) - part);
+
+	len = sizeof(header) + header.incl_len;
+	ring_first = (ring_first + len) % ring_size;
+	ring_used -= len;
+	dropped_count++;
+}
+
 int pcap_post(const void *packet, size_t len, bool outgoing)
 {
 	struct pcap_packet_header header;
-	u64 cur_time = timer_get_us();
+	u64 cur_time;
+	unsigned int incl_len;
 
 	if (!initialized || !running || !buf)
 		return -ENODEV;
 
-	if (buffer_full)
-		return -ENOMEM;
+	if (filter && !pcap_match(packet, len))
+		return 0;
 
-	if ((pos + len + sizeof(header)) >= max_size) {
-		buffer_full = true;
-		printf("\n!!! Buffer is full, consider increasing buffer size !!!\n");
-		return -ENOMEM;
-	}
+	incl_len = min_t(size_t, len, snaplen);
+	if (sizeof(header) + incl_len > ring_size)
+		incl_len = ring_size - sizeof(header);
+	while (ring_used + sizeof(header) + incl_len > ring_size)
+		pcap_ring_drop();
 
+	cur_time = timer_get_us();
 	header.ts_sec = cur_time / 1000000;
 	header.ts_usec = cur_time % 1000000;
-	header.incl_len = len;
+	header.incl_len = incl_len;
 	header.orig_len = len;
 
-	memcpy(buf + pos, &header, sizeof(header));
-	pos += sizeof(header);
-	memcpy(buf + pos, packet, len);
-	pos += len;
+	pcap_ring_write(ring_used, &header, sizeof(header));
+	pcap_ring_write(ring_used + sizeof(header), packet, incl_len);
+	ring_used += sizeof(header) + incl_len;
 
 	if (outgoing)
 		outgoing_count++;
 	else
 		incoming_count++;
 
-	env_set_hex("pcapsize", pos);
-
 	return 0;
 }
 
 int pcap_print_status(void)
 {
+	int i;
+
 	if (!initialized) {
 		printf("pcap was not initialized\n");
 		return -ENODEV;
 	}
 	printf("PCAP status:\n");
-	printf("\tInitialized addr: 0x%lx\tmax length: %u\n",
-	       (unsigned long)buf, max_size);
-	printf("\tStatus: %s.\t file size: %u\n", running ? "Active" : "Idle",
-	       pos);
+	printf("\tInitialized addr: 0x%lx\tmax length: %u\tsnap length: %u\n",
+	       (unsigned long)buf, max_size, snaplen);
+	printf("\tStatus: %s.\t file size: %zu\n", running ? "Active" : "Idle",
+	       sizeof(file_header) + ring_used);
 	printf("\tIncoming packets: %lu Outgoing packets: %lu\n",
 	       incoming_count, outgoing_count);
+	if (dropped_count)
+		printf("\tOldest packets overwritten: %lu\n", dropped_count);
+	printf("\tFilter:");
+	if (!filter)
+		printf(" all");
+	for (i = 0; i < ARRAY_SIZE(filter_names); i++) {
+		if (filter & BIT(i))
+			printf(" %s", filter_names[i]);
+	}
+	printf("\n");
 
 	return 0;
 }
@@ -36,16 +36,13 @@
 #define TCP_SEND_RETRY		3
 #define TCP_SEND_TIMEOUT	2000UL
 #define TCP_RX_INACTIVE_TIMEOUT	30000UL
-#if PKTBUFSRX != 0
-  #define TCP_RCV_WND_SIZE	(PKTBUFSRX * TCP_MSS)
-#else
-  #define TCP_RCV_WND_SIZE	(4 * TCP_MSS)
-#endif
+/* Largest shift allowed by RFC 7323 */
+#define TCP_MAX_SCALE		14
 
 #define TCP_PACKET_OK		0
 #define TCP_PACKET_DROP		1
 
-static struct tcp_stream tcp_stream;
+static struct tcp_stream tcp_streams[CONFIG_PROT_TCP_MAX_STREAMS];
 
 static int (*tcp_stream_on_create)(struct tcp_stream *tcp);
 
@@ -156,6 +153,9 @@ static void tcp_stream_init(struct tcp_stream *tcp,
 	tcp->state = TCP_CLOSED;
 	tcp->lost.len = TCP_OPT_LEN_2;
 	tcp->rcv_wnd = TCP_RCV_WND_SIZE;
+	while ((tcp->rcv_wnd >> tcp->loc_win_scale) > 0xffff &&
+	       tcp->loc_win_scale < TCP_MAX_SCALE)
+		tcp->loc_win_scale++;
 	tcp->max_retry_count = TCP_SEND_RETRY;
 	tcp->initial_timeout = TCP_SEND_TIMEOUT;
 	tcp->rx_inactiv_timeout = TCP_RX_INACTIVE_TIMEOUT;
@@ -172,17 +172,20 @@ static void tcp_stream_destroy(struct tcp_stream *tcp)
 void tcp_init(void)
 {
 	static int initialized;
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
 	tcp_stream_on_create = NULL;
 	if (!initialized) {
 		initialized = 1;
-		memset(tcp, 0, sizeof(struct tcp_stream));
+		memset(tcp_streams, 0, sizeof(tcp_streams));
 	}
 
-	tcp_stream_set_state(tcp, TCP_CLOSED);
-	tcp_stream_set_status(tcp, TCP_ERR_RST);
-	tcp_stream_destroy(tcp);
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++) {
+		tcp_stream_set_state(tcp, TCP_CLOSED);
+		tcp_stream_set_status(tcp, TCP_ERR_RST);
+		tcp_stream_destroy(tcp);
+	}
 }
 
 void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
@@ -193,12 +196,17 @@ void tcp_stream_set_on_create_handler(int (*on_create)(struct tcp_stream *))
 static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 					 u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
-	if (!tcp_stream_on_create ||
-	    tcp->state != TCP_CLOSED)
+	if (!tcp_stream_on_create)
 		return NULL;
 
+	for (tcp = tcp_streams; tcp->state != TCP_CLOSED; tcp++) {
+		/* no free stream */
+		if (tcp == tcp_streams + ARRAY_SIZE(tcp_streams) - 1)
+			return NULL;
+	}
+
 	tcp_stream_init(tcp, rhost, rport, lport);
 	if (!tcp_stream_on_create(tcp))
 		return NULL;
@@ -209,12 +217,15 @@ static struct tcp_stream *tcp_stream_add(struct in_addr rhost,
 struct tcp_stream *tcp_stream_get(int is_new, struct in_addr rhost,
 				  u16 rport, u16 lport)
 {
-	struct tcp_stream *tcp = &tcp_stream;
+	struct tcp_stream *tcp;
 
-	if (tcp->rhost.s_addr == rhost.s_addr &&
-	    tcp->rport == rport &&
-	    tcp->lport == lport)
-		return tcp;
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++) {
+		if (tcp->rhost.s_addr == rhost.s_addr &&
+		    tcp->rport == rport &&
+		    tcp->lport == lport)
+			return tcp;
+	}
 
 	return is_new ? tcp_stream_add(rhost, rport, lport) : NULL;
 }
@@ -434,8 +445,9 @@ void tcp_streams_poll(void)
 	struct tcp_stream	*tcp;
 
 	time = get_timer(0);
-	tcp = &tcp_stream;
-	tcp_stream_poll(tcp, time);
+	for (tcp = tcp_streams; tcp < tcp_streams + ARRAY_SIZE(tcp_streams);
+	     tcp++)
+		tcp_stream_poll(tcp, time);
 }
 
 /**
@@ -549,7 +561,7 @@ void net_set_syn_options(struct tcp_stream *tcp, union tcp_build_pkt *b)
 	b->ip.mss.len = TCP_OPT_LEN_4;
 	b->ip.mss.mss = htons(TCP_MSS);
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	b->ip.scale.scale = tcp->loc_win_scale;
 	b->ip.scale.len = TCP_OPT_LEN_3;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
@@ -656,7 +668,10 @@ int tcp_set_tcp_header(struct tcp_stream *tcp, uchar *pkt, int payload_len,
 	 * it is, then the u-boot tftp or nfs kernel netboot should be
 	 * considered.
 	 */
-	b->ip.hdr.tcp_win = htons(tcp->rcv_wnd >> TCP_SCALE);
+	if (action & TCP_SYN)
+		b->ip.hdr.tcp_win = htons(min_t(u32, tcp->rcv_wnd, 0xffff));
+	else
+		b->ip.hdr.tcp_win = htons(tcp->rcv_wnd >> tcp->loc_win_scale);
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -795,7 +810,9 @@ void tcp_parse_options(struct tcp_stream *tcp, uchar *o, int o_len)
 			break;
 		case TCP_O_SCL:
 			wsopt = (struct tcp_scale *)p;
-			tcp->rmt_win_scale = wsopt->scale;
+			tcp->rmt_win_scale = min_t(u8, wsopt->scale,
+						   TCP_MAX_SCALE);
+			tcp->rmt_win_scale_set = 1;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
@@ -811,6 +828,24 @@ void tcp_parse_options(struct tcp_stream *tcp, uchar *o, int o_len)
 	}
 }
 
+/**
+ * tcp_win_scale_check() - Check window scaling when a SYN is received
+ * @tcp: tcp stream
+ * @syn_sent: true if our SYN, which offers window scaling, went first
+ *
+ * Scaling is only used if both ends send the option in their SYN (RFC 7323).
+ * Otherwise the receive window has to fit into the 16-bit window field.
+ */
+static void tcp_win_scale_check(struct tcp_stream *tcp, bool syn_sent)
+{
+	if (syn_sent && tcp->rmt_win_scale_set)
+		return;
+
+	tcp->rmt_win_scale = 0;
+	tcp->loc_win_scale = 0;
+	tcp->rcv_wnd = min_t(u32, tcp->rcv_wnd, 0xffff);
+}
+
 static int tcp_seg_in_wnd(struct tcp_stream *tcp,
 			  u32 tcp_seq_num, int payload_len)
 {
@@ -984,10 +1019,13 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 	 */
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
-	tcp_win_size = ntohs(b->ip.hdr.tcp_win) << tcp->rmt_win_scale;
-
 	tcp_flags = b->ip.hdr.tcp_flags;
 
+	/* The window in a SYN segment is never scaled */
+	tcp_win_size = ntohs(b->ip.hdr.tcp_win);
+	if (!(tcp_flags & TCP_SYN))
+		tcp_win_size <<= tcp->rmt_win_scale;
+
 //	printf("pkt: seq=%d, ack=%d, flags=%x, len=%d\n",
 //		tcp_seq_num - tcp->irs, tcp_ack_num - tcp->iss, tcp_flags, pkt_len);
 //	printf("tcp: rcv_nxt=%d, snd_una=%d, snd_nxt=%d\n\n",
@@ -1008,6 +1046,8 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 
 		tcp->irs = tcp_seq_num;
 		tcp->rcv_nxt = tcp->irs + 1;
+		/* our SYN-ACK does not carry any options */
+		tcp_win_scale_check(tcp, false);
 
 		tcp->iss = tcp_get_start_seq();
 		tcp->snd_una = tcp->iss;
@@ -1047,6 +1087,7 @@ void tcp_rx_state_machine(struct tcp_stream *tcp,
 		tcp->irs = tcp_seq_num;
 		tcp->rcv_nxt = tcp->irs + 1;
 		tcp->snd_una = tcp_ack_num;
+		tcp_win_scale_check(tcp, true);
 
 		tcp_stream_restart_rx_timer(tcp);
 
@@ -1211,8 +1252,14 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 struct tcp_stream *tcp_stream_connect(struct in_addr rhost, u16 rport)
 {
 	struct tcp_stream *tcp;
+	uint lport;
+
+	/* streams opened in the same tick must still use different ports */
+	lport = random_port();
+	while (tcp_stream_get(0, rhost, rport, lport))
+		lport = RANDOM_PORT_START + (lport + 1) % RANDOM_PORT_RANGE;
 
-	tcp = tcp_stream_add(rhost, rport, random_port());
+	tcp = tcp_stream_add(rhost, rport, lport);
 	if (!tcp)
 		return NULL;
 
@@ -17,6 +17,7 @@
 #include <net.h>
 #include <net6.h>
 #include <asm/global_data.h>
+#include <linux/bitmap.h>
 #include <net/tftp.h>
 #include "bootp.h"
 
@@ -104,6 +105,22 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Window size to ask the server for */
+static ushort	tftp_window_request;
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+/* most blocks kept when they arrive after a lost one, must divide 64K */
+#define TFTP_AHEAD_BLOCKS	256
+/* Blocks received ahead of the next one expected, by block number */
+static DECLARE_BITMAP(tftp_ahead_map, TFTP_AHEAD_BLOCKS);
+/* Number of the last block if it was received ahead, else -1 */
+static int	tftp_ahead_last;
+/* Number of times the server was asked to send part of a window again */
+static uint	tftp_resends;
+/* Window size learned from the loss seen by earlier transfers */
+static ushort	tftp_window_learned;
+/* Window size option which tftp_window_learned started from */
+static ushort	tftp_window_learned_option;
+#endif
 #ifdef CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -194,6 +211,11 @@ static void new_transfer(void)
 	tftp_block_wrap_offset = 0;
 #ifdef CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
+#endif
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+	bitmap_zero(tftp_ahead_map, TFTP_AHEAD_BLOCKS);
+	tftp_ahead_last = -1;
+	tftp_resends = 0;
 #endif
 	led_activity_blink();
 }
@@ -286,6 +308,101 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+/**
+ * tftp_ahead_store() - Keep a block which arrived after a lost one
+ *
+ * Blocks after a gap in the window are stored straight away, so that only
+ * the lost ones have to be sent again. Once the gap is filled,
+ * tftp_ahead_advance() moves past all of them.
+ *
+ * @block: Block number
+ * @src: Block data
+ * @len: Length of the block data
+ * Return: true if the block was dealt with, false if it is not ahead of the
+ * next one expected, within the window
+ */
+static bool tftp_ahead_store(ushort block, uchar *src, unsigned int len)
+{
+	ushort ahead = block - (ushort)(tftp_cur_block + 1);
+	int bit = block % TFTP_AHEAD_BLOCKS;
+
+	if (tftp_state != STATE_DATA || tftp_put_active ||
+	    ahead >= min_t(uint, tftp_windowsize, TFTP_AHEAD_BLOCKS))
+		return false;
+
+	if (!test_bit(bit, tftp_ahead_map)) {
+		if (store_block(tftp_cur_block + 1 + ahead, src, len)) {
+			eth_halt_state_only();
+			net_set_state(NETLOOP_FAIL);
+			return true;
+		}
+		__set_bit(bit, tftp_ahead_map);
+		if (len < tftp_block_size)
+			tftp_ahead_last = block;
+	}
+
+	/*
+	 * The server waits for an ACK at the end of its window, so only ask
+	 * for the missing blocks then, rather than on the first gap
+	 */
+	if ((block == tftp_next_ack || block == tftp_ahead_last) &&
+	    tftp_last_nack != tftp_cur_block) {
+		tftp_send();
+		tftp_last_nack = tftp_cur_block;
+		tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+		tftp_resends++;
+	}
+
+	return true;
+}
+
+/**
+ * tftp_ahead_advance() - Move past the blocks received ahead of a lost one
+ *
+ * Return: true if the last block has now been received
+ */
+static bool tftp_ahead_advance(void)
+{
+	ushort next = tftp_cur_block + 1;
+
+	while (test_bit(next % TFTP_AHEAD_BLOCKS, tftp_ahead_map)) {
+		__clear_bit(next % TFTP_AHEAD_BLOCKS, tftp_ahead_map);
+		tftp_cur_block = next;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		if (next == tftp_ahead_last)
+			return true;
+		next++;
+	}
+
+	return false;
+}
+
+/**
+ * tftp_window_learn() - Pick the window size to ask for on the next transfer
+ *
+ * The window cannot change once the server has agreed to it, so adapt it
+ * between transfers instead: halve it when more than one window in eight
+ * had to be sent again, and double it, up to the windowsize option, after a
+ * transfer without loss.
+ */
+static void tftp_window_learn(void)
+{
+	ulong windows;
+
+	windows = (tftp_cur_block + tftp_block_wrap * TFTP_SEQUENCE_SIZE) /
+		  tftp_windowsize + 1;
+	if (tftp_resends * 8 > windows)
+		tftp_window_learned = max(tftp_windowsize / 2, 1);
+	else if (!tftp_resends)
+		tftp_window_learned = min_t(uint, tftp_window_learned * 2,
+					    tftp_window_size_option);
+	debug("TFTP resends %u in %lu windows, next windowsize %d\n",
+	      tftp_resends, windows, tftp_window_learned);
+}
+#endif
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -312,6 +429,10 @@ static void tftp_complete(void)
 		efi_set_bootdev("Net", "", tftp_filename,
 				map_sysmem(tftp_load_addr, 0),
 				net_boot_file_size);
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+	if (!tftp_put_active)
+		tftp_window_learn();
+#endif
 	net_set_state(NETLOOP_SUCCESS);
 }
 
@@ -366,9 +487,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_request > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_request, 0);
 		len = pkt - xp;
 		break;
 
@@ -605,6 +726,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			debug("Received unexpected block: %d, expected: %d\n",
 			      ntohs(*(__be16 *)pkt),
 			      (ushort)(tftp_cur_block + 1));
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+			if (tftp_ahead_store(ntohs(*(__be16 *)pkt), pkt + 2,
+					     len))
+				break;
+#endif
 			/*
 			 * Only ACK if the block count received is greater than
 			 * the expected block count, otherwise skip ACK.
@@ -624,6 +750,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+				tftp_resends++;
+#endif
 			}
 			break;
 		}
@@ -675,14 +804,23 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			tftp_complete();
 			break;
 		}
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+		if (tftp_ahead_advance()) {
+			tftp_send();
+			tftp_complete();
+			break;
+		}
+#endif
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Blocks received ahead may
+		 *	have taken us past the end of the window.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((short)((ushort)tftp_cur_block - tftp_next_ack) >= 0) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
 		}
 		break;
 
@@ -714,8 +852,14 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 static void tftp_timeout_handler(void)
 {
 	if (++timeout_count > timeout_count_max) {
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+		tftp_window_learned = max(tftp_window_learned / 2, 1);
+#endif
 		restart("Retry count exceeded");
 	} else {
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+		tftp_resends++;
+#endif
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 		if (tftp_state != STATE_RECV_WRQ)
@@ -814,8 +958,17 @@ void tftp_start(enum proto_t protocol)
 
 	sanitize_tftp_block_size_option(protocol);
 
+	tftp_window_request = tftp_window_size_option;
+#ifdef CONFIG_TFTP_ADAPTIVE_WINDOW
+	if (tftp_window_learned_option != tftp_window_size_option) {
+		tftp_window_learned_option = tftp_window_size_option;
+		tftp_window_learned = tftp_window_size_option;
+	}
+	tftp_window_request = tftp_window_learned;
+#endif
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_request, timeout_ms);
 
 	if (IS_ENABLED(CONFIG_IPV6))
 		tftp_remote_ip6 = net_server_ip6;
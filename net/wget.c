@@ -9,13 +9,16 @@
 #include <display_options.h>
 #include <env.h>
 #include <efi_loader.h>
+#include <hash.h>
 #include <image.h>
 #include <lmb.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <net.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <stdlib.h>
+#include <linux/math64.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -28,10 +31,12 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define HTTP_STATUS_BAD		0
 #define HTTP_STATUS_OK		200
+#define HTTP_STATUS_PARTIAL	206
 
 static const char http_proto[] = "HTTP/1.0";
 static const char http_eom[] = "\r\n\r\n";
 static const char content_len[] = "Content-Length:";
+static const char accept_ranges[] = "Accept-Ranges: bytes";
 static const char linefeed[] = "\r\n";
 static struct in_addr web_server_ip;
 static unsigned int server_port;
@@ -42,6 +47,37 @@ static int wget_tsize_num_hash;
 static char *image_url;
 static enum net_loop_state wget_loop_state;
 
+/**
+ * struct wget_range - A request of 'wget -j'
+ *
+ * The first entry is a HEAD request which finds the size of the file. Once
+ * it is answered, the file is split into ranges which are fetched over
+ * separate TCP streams, one entry each. The response header of each one is
+ * kept here until it is parsed, as the destination buffer belongs to the
+ * data of all the ranges.
+ *
+ * @tcp: TCP stream of the request, NULL if it is closed
+ * @start: Offset of the range in the file
+ * @len: Length of the range
+ * @rx: Bytes of the range received so far
+ * @hdr_size: Size of the response header, 0 until it has been parsed
+ * @hdr: Response header, nul-terminated
+ */
+struct wget_range {
+	struct tcp_stream *tcp;
+	ulong start;
+	ulong len;
+	ulong rx;
+	u32 hdr_size;
+	char hdr[HTTP_MAX_HDR_LEN + 1];
+};
+
+static struct wget_range *wget_ranges;
+static int wget_range_count, wget_range_max;
+/* The server does not take range requests, so the file is fetched whole */
+static bool wget_range_whole;
+static u32 wget_rx_packets;
+
 /**
  * store_block() - store block in memory
  * @src: source of data
@@ -98,23 +134,63 @@ static void show_block_marker(u32 packets)
 	}
 }
 
-static void tcp_stream_on_closed(struct tcp_stream *tcp)
+/**
+ * wget_check_hash() - Check the download against the hash given by the client
+ *
+ * Return: 0 if it matches or there is nothing to check, -ve on error
+ */
+static int wget_check_hash(void)
 {
-	if (tcp->status != TCP_ERR_OK)
-		wget_loop_state = NETLOOP_FAIL;
+	u8 expect[HASH_MAX_DIGEST_SIZE], digest[HASH_MAX_DIGEST_SIZE];
+	struct hash_algo *algo;
+	char algo_name[16];
+	const char *sep;
+	void *ptr;
 
-	net_set_state(wget_loop_state);
-	if (wget_loop_state != NETLOOP_SUCCESS) {
-		net_boot_file_size = 0;
+	if (!CONFIG_IS_ENABLED(HASH) || !wget_info->hash)
+		return 0;
+
+	sep = strchr(wget_info->hash, ':');
+	if (!sep || sep - wget_info->hash >= sizeof(algo_name))
+		goto bad_hash;
+	strlcpy(algo_name, wget_info->hash, sep - wget_info->hash + 1);
+	if (hash_lookup_algo(algo_name, &algo) ||
+	    strlen(sep + 1) != algo->digest_size * 2)
+		goto bad_hash;
+	hash_parse_string(algo_name, sep + 1, expect);
+
+	ptr = map_sysmem(image_load_addr, net_boot_file_size);
+	algo->hash_func_ws(ptr, net_boot_file_size, digest, algo->chunk_size);
+	unmap_sysmem(ptr);
+
+	if (memcmp(expect, digest, algo->digest_size)) {
 		if (!wget_info->silent)
-			printf("\nwget: Transfer Fail, TCP status - %d\n",
-			       tcp->status);
+			printf("\nwget: %s of the download does not match\n",
+			       algo_name);
+		return -EBADMSG;
+	}
+
+	return 0;
+
+bad_hash:
+	if (!wget_info->silent)
+		printf("\nwget: bad hash '%s'\n", wget_info->hash);
+
+	return -EINVAL;
+}
+
+static void wget_success(u32 rx_packets)
+{
+	if (wget_check_hash()) {
+		net_boot_file_size = 0;
+		net_set_state(NETLOOP_FAIL);
 		return;
 	}
 
+	net_set_state(NETLOOP_SUCCESS);
 	if (!wget_info->silent)
 		printf("\nPackets received %d, Transfer Successful\n",
-		       tcp->rx_packets);
+		       rx_packets);
 	wget_info->file_size = net_boot_file_size;
 	if (wget_info->method == WGET_HTTP_METHOD_GET && wget_info->set_bootdev) {
 		efi_set_bootdev("Http", NULL, image_url,
@@ -124,11 +200,86 @@ static void tcp_stream_on_closed(struct tcp_stream *tcp)
 	}
 }
 
+static void tcp_stream_on_closed(struct tcp_stream *tcp)
+{
+	if (tcp->status != TCP_ERR_OK)
+		wget_loop_state = NETLOOP_FAIL;
+
+	if (wget_loop_state != NETLOOP_SUCCESS) {
+		net_set_state(wget_loop_state);
+		net_boot_file_size = 0;
+		if (!wget_info->silent)
+			printf("\nwget: Transfer Fail, TCP status - %d\n",
+			       tcp->status);
+		return;
+	}
+
+	wget_success(tcp->rx_packets);
+}
+
+/**
+ * wget_parse_header() - Parse the status line and length of a response
+ *
+ * @hdr: Response header, nul-terminated in place of its final empty line
+ * @hdr_size: Size of the header, including the final empty line
+ * @lenp: Returns the Content-Length, or -1 if there is none
+ * Return: HTTP status code, HTTP_STATUS_BAD if there is no valid status line
+ */
+static u32 wget_parse_header(char *hdr, u32 hdr_size, ulong *lenp)
+{
+	char *pos, *tail;
+	int reply_len;
+	u32 status;
+
+	*lenp = -1;
+
+	/* check for HTTP proto */
+	if (strncasecmp(hdr, "HTTP/", 5)) {
+		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
+				       "(no HTTP Status Line found)\n");
+		return HTTP_STATUS_BAD;
+	}
+
+	/* get HTTP reply len */
+	pos = strstr(hdr, linefeed);
+	if (pos)
+		reply_len = pos - hdr;
+	else
+		reply_len = hdr_size - strlen(http_eom);
+
+	pos = strchr(hdr, ' ');
+	if (!pos || pos - hdr > reply_len) {
+		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
+				       "(no HTTP Status Code found)\n");
+		return HTTP_STATUS_BAD;
+	}
+
+	status = (u32)simple_strtoul(pos + 1, &tail, 10);
+	if (tail == pos + 1 || *tail != ' ') {
+		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
+				       "(bad HTTP Status Code)\n");
+		return HTTP_STATUS_BAD;
+	}
+
+	debug_cond(DEBUG_WGET, "wget: HTTP Status Code %d\n", status);
+
+	pos = strstr(hdr, content_len);
+	if (pos) {
+		pos += strlen(content_len) + 1;
+		while (*pos == ' ')
+			pos++;
+		*lenp = simple_strtoul(pos, &tail, 10);
+		if (*tail != '\r' && *tail != '\n' && *tail != '\0')
+			*lenp = -1;
+	}
+
+	return status;
+}
+
 static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
 {
-	char	*pos, *tail;
+	char	*pos;
 	uchar	saved, *ptr;
-	int	reply_len;
 
 	if (http_hdr_size) {
 		net_boot_file_size = rx_bytes - http_hdr_size;
@@ -160,40 +311,8 @@ static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
 	if (wget_info->headers && http_hdr_size < MAX_HTTP_HEADERS_SIZE)
 		strcpy(wget_info->headers, ptr);
 
-	/* check for HTTP proto */
-	if (strncasecmp((char *)ptr, "HTTP/", 5)) {
-		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
-				       "(no HTTP Status Line found)\n");
-		tcp_stream_close(tcp);
-		goto end;
-	}
-
-	/* get HTTP reply len */
-	pos = strstr((char *)ptr, linefeed);
-	if (pos)
-		reply_len = pos - (char *)ptr;
-	else
-		reply_len = http_hdr_size - strlen(http_eom);
-
-	pos = strchr((char *)ptr, ' ');
-	if (!pos || pos - (char *)ptr > reply_len) {
-		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
-				       "(no HTTP Status Code found)\n");
-		tcp_stream_close(tcp);
-		goto end;
-	}
-
-	wget_info->status_code = (u32)simple_strtoul(pos + 1, &tail, 10);
-	if (tail == pos + 1 || *tail != ' ') {
-		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer "
-				       "(bad HTTP Status Code)\n");
-		tcp_stream_close(tcp);
-		goto end;
-	}
-
-	debug_cond(DEBUG_WGET,
-		   "wget: HTTP Status Code %d\n", wget_info->status_code);
-
+	wget_info->status_code = wget_parse_header((char *)ptr, http_hdr_size,
+						   &content_length);
 	if (wget_info->status_code != HTTP_STATUS_OK) {
 		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer\n");
 		tcp_stream_close(tcp);
@@ -203,17 +322,6 @@ static void tcp_stream_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
 	debug_cond(DEBUG_WGET, "wget: Connctd pkt %p  hlen %x\n",
 		   ptr, http_hdr_size);
 
-	content_length = -1;
-	pos = strstr((char *)ptr, content_len);
-	if (pos) {
-		pos += strlen(content_len) + 1;
-		while (*pos == ' ')
-			pos++;
-		content_length = simple_strtoul(pos, &tail, 10);
-		if (*tail != '\r' && *tail != '\n' && *tail != '\0')
-			content_length = -1;
-	}
-
 	if (content_length != -1) {
 		debug_cond(DEBUG_WGET,
 			   "wget: Connected Len %lu\n",
@@ -270,6 +378,284 @@ static int tcp_stream_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf, int max
 	return ret;
 }
 
+static struct wget_range *wget_range_find(struct tcp_stream *tcp)
+{
+	int i;
+
+	for (i = 0; i < wget_range_count; i++) {
+		if (wget_ranges[i].tcp == tcp)
+			return &wget_ranges[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * wget_ranges_stop() - Reset the streams of 'wget -j' and forget the ranges
+ */
+static void wget_ranges_stop(void)
+{
+	int i;
+
+	for (i = 0; i < wget_range_count; i++) {
+		if (wget_ranges[i].tcp)
+			tcp_stream_reset(wget_ranges[i].tcp);
+	}
+	free(wget_ranges);
+	wget_ranges = NULL;
+	wget_range_count = 0;
+}
+
+static void wget_ranges_fail(void)
+{
+	wget_ranges_stop();
+	net_boot_file_size = 0;
+	net_set_state(NETLOOP_FAIL);
+}
+
+/**
+ * wget_ranges_start() - Request the ranges of the file, once its size is known
+ *
+ * Return: 0 if OK, -ENOSPC if there are not enough free TCP streams
+ */
+static int wget_ranges_start(void)
+{
+	struct wget_range *r;
+	int i, n;
+
+	n = 1;
+	if (!wget_range_whole)
+		n = min_t(ulong, wget_range_max, content_length);
+
+	for (i = 1; i <= n; i++) {
+		r = &wget_ranges[i];
+		r->start = div_u64((u64)content_length * (i - 1), n);
+		r->len = div_u64((u64)content_length * i, n) - r->start;
+		r->tcp = tcp_stream_connect(web_server_ip, server_port);
+		if (!r->tcp)
+			return -ENOSPC;
+		wget_range_count = i + 1;
+		tcp_stream_put(r->tcp);
+	}
+
+	return 0;
+}
+
+/**
+ * wget_range_parse() - Parse the response header of a request of 'wget -j'
+ *
+ * @tcp: TCP stream of the request
+ * @r: Request
+ * @rx_bytes: Bytes received so far
+ * @statusp: Returns the HTTP status code
+ * @lenp: Returns the Content-Length, or -1 if there is none
+ * Return: size of the header, 0 if it is not complete
+ */
+static u32 wget_range_parse(struct tcp_stream *tcp, struct wget_range *r,
+			    u32 rx_bytes, u32 *statusp, ulong *lenp)
+{
+	char *pos;
+	u32 hdr_size;
+
+	r->hdr[rx_bytes] = '\0';
+	pos = strstr(r->hdr, http_eom);
+	if (!pos) {
+		if (rx_bytes >= HTTP_MAX_HDR_LEN ||
+		    tcp->state != TCP_ESTABLISHED) {
+			if (!wget_info->silent)
+				printf("ERROR: missed HTTP header\n");
+			tcp_stream_reset(tcp);
+		}
+		return 0;
+	}
+
+	hdr_size = pos - r->hdr + strlen(http_eom);
+	*pos = '\0';
+	*statusp = wget_parse_header(r->hdr, hdr_size, lenp);
+
+	return hdr_size;
+}
+
+static void wget_range_head(struct tcp_stream *tcp, struct wget_range *r,
+			    u32 rx_bytes)
+{
+	u32 hdr_size, status;
+	ulong len;
+
+	hdr_size = wget_range_parse(tcp, r, rx_bytes, &status, &len);
+	if (!hdr_size)
+		return;
+
+	if (wget_info->headers && hdr_size < MAX_HTTP_HEADERS_SIZE)
+		strcpy(wget_info->headers, r->hdr);
+	wget_info->status_code = status;
+	if (status != HTTP_STATUS_OK) {
+		debug_cond(DEBUG_WGET, "wget: Connected Bad Xfer\n");
+		tcp_stream_close(tcp);
+		return;
+	}
+
+	if (len != -1) {
+		wget_info->hdr_cont_len = len;
+		if (wget_info->buffer_size && wget_info->buffer_size < len) {
+			tcp_stream_reset(tcp);
+			return;
+		}
+	}
+	content_length = len;
+	r->hdr_size = hdr_size;
+
+	/* fetch the file in one piece if the server cannot split it */
+	wget_range_whole = !len || len == -1 || !strstr(r->hdr, accept_ranges);
+	debug_cond(DEBUG_WGET, "wget: Len %lu, %s\n", len,
+		   wget_range_whole ? "no ranges" : "ranges");
+
+	if (wget_ranges_start()) {
+		if (!wget_info->silent)
+			printf("No free tcp streams\n");
+		wget_ranges_fail();
+	}
+}
+
+static int wget_range_body(struct tcp_stream *tcp, struct wget_range *r,
+			   u32 rx_bytes)
+{
+	u32 hdr_size, status;
+	ulong len;
+
+	hdr_size = wget_range_parse(tcp, r, rx_bytes, &status, &len);
+	if (!hdr_size)
+		return -EAGAIN;
+
+	if (status != (wget_range_whole ? HTTP_STATUS_OK : HTTP_STATUS_PARTIAL) ||
+	    (len != -1 && len != r->len)) {
+		debug_cond(DEBUG_WGET, "wget: Range %lu+%lu refused, status %u\n",
+			   r->start, r->len, status);
+		tcp_stream_reset(tcp);
+		return -EINVAL;
+	}
+
+	/* the data which came in with the header */
+	rx_bytes -= hdr_size;
+	if (rx_bytes > r->len ||
+	    store_block((uchar *)r->hdr + hdr_size, r->start, rx_bytes) < 0) {
+		tcp_stream_reset(tcp);
+		return -EIO;
+	}
+	r->hdr_size = hdr_size;
+
+	return 0;
+}
+
+static void wget_range_on_closed(struct tcp_stream *tcp)
+{
+	struct wget_range *r = wget_range_find(tcp);
+	int i;
+
+	if (!r)
+		return;
+
+	r->tcp = NULL;
+	wget_rx_packets += tcp->rx_packets;
+
+	/* the HEAD request is done with once it has been answered */
+	if (r == wget_ranges && r->hdr_size)
+		return;
+
+	if (tcp->status != TCP_ERR_OK || !r->hdr_size ||
+	    (content_length != -1 && r->rx != r->len)) {
+		wget_ranges_fail();
+		if (!wget_info->silent)
+			printf("\nwget: Transfer Fail, TCP status - %d\n",
+			       tcp->status);
+		return;
+	}
+
+	for (i = 1; i < wget_range_count; i++) {
+		if (wget_ranges[i].tcp)
+			return;
+	}
+
+	wget_ranges_stop();
+	wget_success(wget_rx_packets);
+}
+
+static void wget_range_on_rcv_nxt_update(struct tcp_stream *tcp, u32 rx_bytes)
+{
+	struct wget_range *r = wget_range_find(tcp);
+	int i;
+
+	if (!r)
+		return;
+
+	if (!r->hdr_size) {
+		if (r == wget_ranges) {
+			wget_range_head(tcp, r, rx_bytes);
+			return;
+		}
+		if (wget_range_body(tcp, r, rx_bytes))
+			return;
+	}
+
+	r->rx = rx_bytes - r->hdr_size;
+	net_boot_file_size = 0;
+	for (i = 1; i < wget_range_count; i++)
+		net_boot_file_size += wget_ranges[i].rx;
+	show_block_marker(tcp->rx_packets);
+}
+
+static int wget_range_rx(struct tcp_stream *tcp, u32 rx_offs, void *buf,
+			 int len)
+{
+	struct wget_range *r = wget_range_find(tcp);
+	u32 skip = 0;
+
+	if (!r)
+		return -1;
+
+	if (!r->hdr_size) {
+		/* take the header in order, so that it can be parsed */
+		if (rx_offs > tcp_stream_rx_offs(tcp) ||
+		    rx_offs >= HTTP_MAX_HDR_LEN)
+			return 0;
+		len = min_t(int, len, HTTP_MAX_HDR_LEN - rx_offs);
+		memcpy(r->hdr + rx_offs, buf, len);
+		return len;
+	}
+
+	/* a resent segment may still hold the end of the header */
+	if (rx_offs < r->hdr_size)
+		skip = min_t(u32, r->hdr_size - rx_offs, len);
+	if (skip == len)
+		return len;
+
+	rx_offs += skip - r->hdr_size;
+	if (rx_offs + len - skip > r->len ||
+	    store_block(buf + skip, r->start + rx_offs, len - skip) < 0)
+		return -1;
+
+	return len;
+}
+
+static int wget_range_tx(struct tcp_stream *tcp, u32 tx_offs, void *buf,
+			 int maxlen)
+{
+	struct wget_range *r = wget_range_find(tcp);
+
+	if (!r || tx_offs)
+		return 0;
+
+	if (r == wget_ranges)
+		return snprintf(buf, maxlen, "HEAD %s %s\r\n\r\n",
+				image_url, http_proto);
+	if (wget_range_whole)
+		return snprintf(buf, maxlen, "GET %s %s\r\n\r\n",
+				image_url, http_proto);
+
+	return snprintf(buf, maxlen, "GET %s %s\r\nRange: bytes=%lu-%lu\r\n\r\n",
+			image_url, http_proto, r->start, r->start + r->len - 1);
+}
+
 static int tcp_stream_on_create(struct tcp_stream *tcp)
 {
 	if (tcp->rhost.s_addr != web_server_ip.s_addr ||
@@ -278,10 +664,17 @@ static int tcp_stream_on_create(struct tcp_stream *tcp)
 
 	tcp->max_retry_count = WGET_RETRY_COUNT;
 	tcp->initial_timeout = WGET_TIMEOUT;
-	tcp->on_closed = tcp_stream_on_closed;
-	tcp->on_rcv_nxt_update = tcp_stream_on_rcv_nxt_update;
-	tcp->rx = tcp_stream_rx;
-	tcp->tx = tcp_stream_tx;
+	if (wget_ranges) {
+		tcp->on_closed = wget_range_on_closed;
+		tcp->on_rcv_nxt_update = wget_range_on_rcv_nxt_update;
+		tcp->rx = wget_range_rx;
+		tcp->tx = wget_range_tx;
+	} else {
+		tcp->on_closed = tcp_stream_on_closed;
+		tcp->on_rcv_nxt_update = tcp_stream_on_rcv_nxt_update;
+		tcp->rx = tcp_stream_rx;
+		tcp->tx = tcp_stream_tx;
+	}
 
 	return 1;
 }
@@ -352,15 +745,28 @@ void wget_start(void)
 	if (wget_info->headers)
 		wget_info->headers[0] = 0;
 
+	/* one stream finds the size of the file, the others fetch it */
+	wget_ranges_stop();
+	wget_rx_packets = 0;
+	wget_range_max = min_t(u32, wget_info->jobs,
+			       CONFIG_PROT_TCP_MAX_STREAMS - 1);
+	if (wget_range_max > 1 && wget_info->method == WGET_HTTP_METHOD_GET)
+		wget_ranges = calloc(wget_range_max + 1, sizeof(*wget_ranges));
+
 	server_port = env_get_ulong("httpdstp", 10, SERVER_PORT) & 0xffff;
 	tcp_stream_set_on_create_handler(tcp_stream_on_create);
 	tcp = tcp_stream_connect(web_server_ip, server_port);
 	if (!tcp) {
 		if (!wget_info->silent)
 			printf("No free tcp streams\n");
+		wget_ranges_stop();
 		net_set_state(NETLOOP_FAIL);
 		return;
 	}
+	if (wget_ranges) {
+		wget_ranges[0].tcp = tcp;
+		wget_range_count = 1;
+	}
 	tcp_stream_put(tcp);
 }
 
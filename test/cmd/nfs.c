@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the nfs command, against a stand-in NFSv3 server
+ */
+
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/cmd.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../net/nfs.h"
+#include "../../net/nfs-common.h"
+
+#define SB_NFS_MOUNT_PORT	635
+#define SB_NFS_PORT		2049
+/* eight full READs and a short one */
+#define SB_NFS_SIZE		(NFS_READ_SIZE * 8 + 100)
+
+/**
+ * struct sb_nfs_server - An NFSv3 server which answers each request at once
+ *
+ * @data: Contents of the file
+ * @reads: Number of READ requests received
+ * @rounds: Number of receive batches in which READ requests were sent, i.e.
+ *	the number of round trips taken to read the file
+ * @last_batch: Receive batch in which the last READ request was sent
+ */
+struct sb_nfs_server {
+	u8 data[SB_NFS_SIZE];
+	int reads;
+	int rounds;
+	int last_batch;
+};
+
+static struct sb_nfs_server sb_nfs;
+
+/* Queue the reply to an RPC call, with @len bytes of results in @res */
+static void sb_nfs_reply(struct udevice *dev, void *packet, void *res,
+			 int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be32 *call = (void *)ip + IP_UDP_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+	__be32 *reply;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	/* id, type, reply status, verifier (two words), accept status */
+	reply = (void *)eth_recv + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	memset(reply, '\0', 6 * sizeof(u32));
+	reply[0] = call[0];
+	reply[1] = htonl(MSG_REPLY);
+	memcpy(reply + 6, res, len);
+	len += 6 * sizeof(u32);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	memset(ipr, '\0', IP_UDP_HDR_SIZE);
+	ipr->ip_hl_v = 0x45;
+	ipr->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	ipr->ip_off = htons(IP_FLAGS_DFRAG);
+	ipr->ip_ttl = 255;
+	ipr->ip_p = IPPROTO_UDP;
+	net_copy_ip(&ipr->ip_dst, &ip->ip_src);
+	net_copy_ip(&ipr->ip_src, &ip->ip_dst);
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = ip->udp_dst;
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+
+static void sb_nfs_read(struct udevice *dev, void *packet, __be32 *args)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	u32 res[5 + NFS_READ_SIZE / sizeof(u32)];
+	int offset, count;
+
+	/* file handle, then a 64-bit offset and the count */
+	args += 1 + ntohl(args[0]) / sizeof(u32);
+	offset = ntohl(args[1]);
+	count = ntohl(args[2]);
+	count = max(0, min(count, SB_NFS_SIZE - offset));
+
+	sb_nfs.reads++;
+	if (priv->recv_batches != sb_nfs.last_batch) {
+		sb_nfs.rounds++;
+		sb_nfs.last_batch = priv->recv_batches;
+	}
+
+	/* status, no attributes, count, eof and the data */
+	res[0] = 0;
+	res[1] = 0;
+	res[2] = htonl(count);
+	res[3] = htonl(offset + count == SB_NFS_SIZE);
+	res[4] = htonl(count);
+	if (count)
+		memcpy(res + 5, sb_nfs.data + offset, count);
+	sb_nfs_reply(dev, packet, res, 5 * sizeof(u32) + ALIGN(count, 4));
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be32 *call = (void *)ip + IP_UDP_HDR_SIZE;
+	u32 res[4];
+	__be32 *args;
+	int proc;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	/* skip the credentials and the verifier */
+	args = call + 6;
+	args += 2 + ALIGN(ntohl(args[1]), 4) / sizeof(u32);
+	args += 2 + ALIGN(ntohl(args[1]), 4) / sizeof(u32);
+	proc = ntohl(call[5]);
+
+	/* a small file handle is all any call needs */
+	res[0] = 0;
+	res[1] = htonl(2 * sizeof(u32));
+	res[2] = htonl(0x12345678);
+	res[3] = htonl(0x9abcdef0);
+
+	switch (ntohs(ip->udp_dst)) {
+	case SUNRPC_PORT:
+		if (ntohl(args[0]) == PROG_MOUNT)
+			res[0] = htonl(SB_NFS_MOUNT_PORT);
+		else
+			res[0] = htonl(SB_NFS_PORT);
+		sb_nfs_reply(dev, packet, res, sizeof(u32));
+		break;
+	case SB_NFS_MOUNT_PORT:
+		if (proc == MOUNT_ADDENTRY)
+			sb_nfs_reply(dev, packet, res, sizeof(res));
+		else
+			sb_nfs_reply(dev, packet, res, 0);
+		break;
+	case SB_NFS_PORT:
+		if (proc == NFS3PROC_LOOKUP)
+			sb_nfs_reply(dev, packet, res, sizeof(res));
+		else if (proc == NFS_READ)
+			sb_nfs_read(dev, packet, args);
+		break;
+	}
+
+	return 0;
+}
+
+/* Fetch the file, returning the number of round trips taken to read it */
+static int sb_nfs_get(struct unit_test_state *uts)
+{
+	sb_nfs.reads = 0;
+	sb_nfs.rounds = 0;
+	sb_nfs.last_batch = -1;
+	ut_assertok(run_command("nfs 0x20000 1.1.2.2:/export/test.img", 0));
+	ut_asserteq(SB_NFS_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(sb_nfs.data, map_sysmem(0x20000, 0), SB_NFS_SIZE);
+
+	return sb_nfs.rounds;
+}
+
+static int net_test_nfs_window(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	int i;
+
+	for (i = 0; i < SB_NFS_SIZE; i++)
+		sb_nfs.data[i] = i * 7 + (i >> 10);
+
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/*
+	 * One READ at a time takes a round trip for each block, then one for
+	 * the rest of the short block, which finds the end of the file
+	 */
+	env_set("nfswindowsize", "1");
+	ut_asserteq(10, sb_nfs_get(uts));
+	ut_asserteq(10, sb_nfs.reads);
+
+	/* two in flight nearly halve that, with one more READ past the end */
+	env_set("nfswindowsize", "2");
+	ut_asserteq(6, sb_nfs_get(uts));
+	ut_asserteq(11, sb_nfs.reads);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("nfswindowsize", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_nfs_window, 0);
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the pcap command
+ */
+
+#include <command.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/pcap.h>
+#include <test/cmd.h>
+#include <test/ut.h>
+
+#define PCAP_TEST_ADDR		0x20000
+#define PCAP_TEST_HDR_SIZE	24
+#define PCAP_TEST_PKT_HDR_SIZE	16
+#define PCAP_TEST_SNAPLEN	64
+#define PCAP_TEST_PKT_LEN	100
+/* room for three snapped packets and a bit, so that packets wrap round */
+#define PCAP_TEST_SIZE		(PCAP_TEST_HDR_SIZE + 250)
+
+/* Make an Ethernet frame of protocol @prot, marked with @mark */
+static void pcap_test_packet(u8 *pkt, uint prot, u8 mark)
+{
+	struct ethernet_hdr *et = (void *)pkt;
+	struct ip_hdr *ip = (void *)pkt + ETHER_HDR_SIZE;
+	int i;
+
+	for (i = 0; i < PCAP_TEST_PKT_LEN; i++)
+		pkt[i] = mark + i;
+	et->et_protlen = htons(prot);
+	ip->ip_p = IPPROTO_UDP;
+}
+
+/* Check the packet at @rec was the one marked with @mark, snapped */
+static int pcap_test_check(struct unit_test_state *uts, u32 *rec, u8 mark)
+{
+	u8 pkt[PCAP_TEST_PKT_LEN];
+
+	ut_asserteq(PCAP_TEST_SNAPLEN, rec[2]);
+	ut_asserteq(PCAP_TEST_PKT_LEN, rec[3]);
+	pcap_test_packet(pkt, PROT_IP, mark);
+	ut_asserteq_mem(pkt, rec + 4, PCAP_TEST_SNAPLEN);
+
+	return 0;
+}
+
+static int net_test_pcap_ring(struct unit_test_state *uts)
+{
+	const uint rec_size = PCAP_TEST_PKT_HDR_SIZE + PCAP_TEST_SNAPLEN;
+	u8 pkt[PCAP_TEST_PKT_LEN];
+	u32 *file;
+	int i;
+
+	file = map_sysmem(PCAP_TEST_ADDR, PCAP_TEST_SIZE);
+	ut_assertok(run_commandf("pcap init %x %d %d", PCAP_TEST_ADDR,
+				 PCAP_TEST_SIZE, PCAP_TEST_SNAPLEN));
+	ut_assertok(run_command("pcap start", 0));
+
+	/* the first two are overwritten, the fourth wraps round the ring */
+	for (i = 0; i < 5; i++) {
+		pcap_test_packet(pkt, PROT_IP, i);
+		ut_assertok(pcap_post(pkt, sizeof(pkt), i & 1));
+	}
+
+	/* stopping puts the three latest packets in order */
+	ut_assertok(run_command("pcap stop", 0));
+	ut_asserteq(PCAP_TEST_HDR_SIZE + 3 * rec_size,
+		    env_get_hex("pcapsize", 0));
+	ut_asserteq(0xa1b2c3d4, file[0]);
+	ut_asserteq(PCAP_TEST_SNAPLEN, file[4]);
+	for (i = 0; i < 3; i++)
+		ut_assertok(pcap_test_check(uts,
+					    (void *)file + PCAP_TEST_HDR_SIZE +
+					    i * rec_size, i + 2));
+
+	/* only ARP gets through, and the capture can go on after a stop */
+	ut_assertok(run_command("pcap clear", 0));
+	ut_assertok(run_command("pcap filter arp", 0));
+	ut_assertok(run_command("pcap start", 0));
+	pcap_test_packet(pkt, PROT_IP, 0);
+	ut_assertok(pcap_post(pkt, sizeof(pkt), false));
+	pcap_test_packet(pkt, PROT_ARP, 0);
+	ut_assertok(pcap_post(pkt, sizeof(pkt), false));
+	ut_assertok(run_command("pcap stop", 0));
+	ut_asserteq(PCAP_TEST_HDR_SIZE + rec_size, env_get_hex("pcapsize", 0));
+	ut_asserteq_mem(pkt, (void *)file + PCAP_TEST_HDR_SIZE +
+			PCAP_TEST_PKT_HDR_SIZE, PCAP_TEST_SNAPLEN);
+
+	/* UDP is also matched inside IP */
+	ut_assertok(run_command("pcap clear", 0));
+	ut_assertok(run_command("pcap filter all udp", 0));
+	ut_assertok(run_command("pcap start", 0));
+	pcap_test_packet(pkt, PROT_ARP, 0);
+	ut_assertok(pcap_post(pkt, sizeof(pkt), false));
+	pcap_test_packet(pkt, PROT_IP, 7);
+	ut_assertok(pcap_post(pkt, sizeof(pkt), false));
+	ut_assertok(run_command("pcap stop", 0));
+	ut_asserteq(PCAP_TEST_HDR_SIZE + rec_size, env_get_hex("pcapsize", 0));
+	ut_assertok(pcap_test_check(uts, (void *)file + PCAP_TEST_HDR_SIZE, 7));
+
+	ut_assertok(run_command("pcap filter all", 0));
+	env_set("pcapsize", NULL);
+	unmap_sysmem(file);
+
+	return 0;
+}
+CMD_TEST(net_test_pcap_ring, 0);
@@ -10,8 +10,11 @@
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <hash.h>
+#include <hexdump.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net/tcp.h>
 #include <net/wget.h>
@@ -27,6 +30,28 @@
 #define LEN_B_TO_DW(x) ((x) >> 2)
 #define GET_TCP_HDR_LEN_IN_BYTES(x) ((x) >> 2)
 
+/* Window scale the server offers, if it offers one */
+#define SB_TCP_SCALE	7
+
+/* Size of the file served in ranges, and most connections open at once */
+#define SB_RANGE_SIZE	1000
+#define SB_RANGE_CONNS	4
+
+/**
+ * struct sb_tcp_info - What the server saw of the receive window
+ *
+ * @win_scale: true if the server sends the window scale option
+ * @syn_scale: Window scale sent by U-Boot in its SYN, -1 if none
+ * @syn_win: Window sent by U-Boot in its SYN
+ * @ack_win: Window sent by U-Boot in its last ACK
+ */
+static struct sb_tcp_info {
+	bool win_scale;
+	int syn_scale;
+	u16 syn_win;
+	u16 ack_win;
+} sb_tcp;
+
 static int sb_arp_handler(struct udevice *dev, void *packet,
 			  unsigned int len)
 {
@@ -55,11 +80,27 @@ static int sb_syn_handler(struct udevice *dev, void *packet,
 	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
 	struct ethernet_hdr *eth_send;
 	struct ip_tcp_hdr *tcp_send;
+	int hdr_len = TCP_HDR_SIZE;
+	u8 *opt, *end;
 
 	/* Don't allow the buffer to overrun */
 	if (priv->recv_packets >= PKTBUFSRX)
 		return 0;
 
+	sb_tcp.syn_win = ntohs(tcp->tcp_win);
+	sb_tcp.syn_scale = -1;
+	opt = (u8 *)tcp + IP_TCP_HDR_SIZE;
+	end = opt + GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen) - TCP_HDR_SIZE;
+	while (opt < end && *opt != TCP_O_END) {
+		if (*opt == TCP_1_NOP) {
+			opt++;
+			continue;
+		}
+		if (*opt == TCP_O_SCL)
+			sb_tcp.syn_scale = opt[2];
+		opt += opt[1];
+	}
+
 	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
 	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
 	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
@@ -71,24 +112,32 @@ static int sb_syn_handler(struct udevice *dev, void *packet,
 	tcp_send->tcp_dst = tcp->tcp_src;
 	tcp_send->tcp_seq = htonl(priv->iss);
 	tcp_send->tcp_ack = htonl(priv->irs + 1);
-	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	if (sb_tcp.win_scale) {
+		opt = (u8 *)tcp_send + IP_TCP_HDR_SIZE;
+		opt[0] = TCP_1_NOP;
+		opt[1] = TCP_O_SCL;
+		opt[2] = TCP_OPT_LEN_3;
+		opt[3] = SB_TCP_SCALE;
+		hdr_len += 4;
+	}
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(hdr_len));
 	tcp_send->tcp_flags = TCP_SYN | TCP_ACK;
-	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS / 2);
 	tcp_send->tcp_xsum = 0;
 	tcp_send->tcp_ugr = 0;
 	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
 						   tcp->ip_src,
 						   tcp->ip_dst,
-						   TCP_HDR_SIZE,
-						   IP_TCP_HDR_SIZE);
+						   hdr_len,
+						   IP_HDR_SIZE + hdr_len);
 	net_set_ip_header((uchar *)tcp_send,
 			  tcp->ip_src,
 			  tcp->ip_dst,
-			  IP_TCP_HDR_SIZE,
+			  IP_HDR_SIZE + hdr_len,
 			  IPPROTO_TCP);
 
 	priv->recv_packet_length[priv->recv_packets] =
-		ETHER_HDR_SIZE + IP_TCP_HDR_SIZE;
+		ETHER_HDR_SIZE + IP_HDR_SIZE + hdr_len;
 	++priv->recv_packets;
 
 	return 0;
@@ -137,6 +186,7 @@ static int sb_ack_handler(struct udevice *dev, void *packet,
 	tcp_send->tcp_dst = tcp->tcp_src;
 	data = (void *)tcp_send + IP_TCP_HDR_SIZE;
 
+	sb_tcp.ack_win = ntohs(tcp->tcp_win);
 	tcp_seq = ntohl(tcp->tcp_seq) - priv->irs;
 	tcp_ack = ntohl(tcp->tcp_ack) - priv->iss;
 	tcp_data_len = len - ETHER_HDR_SIZE - IP_HDR_SIZE - GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
@@ -166,7 +216,7 @@ static int sb_ack_handler(struct udevice *dev, void *packet,
 	}
 
 	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
-	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS / 2);
 	tcp_send->tcp_xsum = 0;
 	tcp_send->tcp_ugr = 0;
 	pkt_len = IP_TCP_HDR_SIZE + payload_len;
@@ -242,6 +292,297 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 CMD_TEST(net_test_wget, UTF_CONSOLE);
 
+static int net_test_wget_win_scale(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	u32 wnd = TCP_RCV_WND_SIZE;
+	int scale = 0;
+
+	while ((wnd >> scale) > 0xffff)
+		scale++;
+
+	sandbox_eth_set_tx_handler(0, sb_http_handler);
+	sandbox_eth_set_priv(0, uts);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("wgetaddr", "0x20000");
+
+	/* the full window is used when the server can scale it */
+	sb_tcp.win_scale = true;
+	ut_assertok(run_command("wget ${wgetaddr} 1.1.2.2:/index.html", 0));
+	ut_assert_nextline_empty();
+	ut_assert_nextline("Packets received 5, Transfer Successful");
+	ut_assert_nextline("Bytes transferred = 29 (1d hex)");
+	ut_asserteq(scale, sb_tcp.syn_scale);
+	ut_asserteq(min_t(u32, wnd, 0xffff), sb_tcp.syn_win);
+	ut_asserteq(wnd >> scale, sb_tcp.ack_win);
+
+	/* otherwise it is limited to what fits in the window field */
+	sb_tcp.win_scale = false;
+	ut_assertok(run_command("wget ${wgetaddr} 1.1.2.2:/index.html", 0));
+	ut_assert_nextline_empty();
+	ut_assert_nextline("Packets received 5, Transfer Successful");
+	ut_assert_nextline("Bytes transferred = 29 (1d hex)");
+	ut_asserteq(min_t(u32, wnd, 0xffff), sb_tcp.ack_win);
+	ut_assert_console_end();
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_win_scale, UTF_CONSOLE);
+
+/**
+ * struct sb_range_conn - A connection to the range server
+ *
+ * @port: Port of the client, 0 if the entry is free
+ * @irs: Initial sequence number of the client
+ * @iss: Initial sequence number of the server
+ */
+struct sb_range_conn {
+	u16 port;
+	u32 irs;
+	u32 iss;
+};
+
+/**
+ * struct sb_range_info - What the range server saw
+ *
+ * @conns: Open connections
+ * @heads: Number of HEAD requests
+ * @gets: Number of GET requests
+ * @start: First byte asked for by each GET request
+ * @end: Last byte asked for by each GET request
+ */
+static struct sb_range_info {
+	struct sb_range_conn conns[SB_RANGE_CONNS];
+	int heads;
+	int gets;
+	ulong start[SB_RANGE_CONNS];
+	ulong end[SB_RANGE_CONNS];
+} sb_range;
+
+static u8 sb_range_byte(ulong offset)
+{
+	return offset * 7 + (offset >> 8);
+}
+
+static struct sb_range_conn *sb_range_conn(u16 port, bool add)
+{
+	int i;
+
+	for (i = 0; i < SB_RANGE_CONNS; i++) {
+		if (sb_range.conns[i].port == port)
+			return &sb_range.conns[i];
+	}
+	if (add)
+		return sb_range_conn(0, false);
+
+	return NULL;
+}
+
+static int sb_range_send(struct udevice *dev, void *packet, u8 flags,
+			 u32 seq, u32 ack, const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_send;
+	struct ip_tcp_hdr *tcp_send;
+	int pkt_len = IP_TCP_HDR_SIZE + len;
+
+	/* Don't allow the buffer to overrun */
+	if (priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	eth_send = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	tcp_send = (void *)eth_send + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(seq);
+	tcp_send->tcp_ack = htonl(ack);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS / 2);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_ugr = 0;
+	memcpy((void *)tcp_send + IP_TCP_HDR_SIZE, data, len);
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src,
+						   tcp->ip_dst,
+						   pkt_len - IP_HDR_SIZE,
+						   pkt_len);
+	net_set_ip_header((uchar *)tcp_send,
+			  tcp->ip_src,
+			  tcp->ip_dst,
+			  pkt_len,
+			  IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+/*
+ * An HTTP server which takes range requests over several connections at once.
+ * It sends each response together with its FIN, to keep within the PKTBUFSRX
+ * packets which the sandbox Ethernet driver can queue.
+ */
+static int sb_range_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	struct sb_range_conn *conn;
+	char req[256], resp[512 + SB_RANGE_SIZE / 2];
+	ulong start, end;
+	int data_len, n;
+	char *pos;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sb_arp_handler(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return -EPROTONOSUPPORT;
+
+	if (tcp->tcp_flags == TCP_SYN) {
+		conn = sb_range_conn(ntohs(tcp->tcp_src), true);
+		if (!conn)
+			return 0;
+		conn->port = ntohs(tcp->tcp_src);
+		conn->irs = ntohl(tcp->tcp_seq);
+		conn->iss = ~conn->irs;
+
+		return sb_range_send(dev, packet, TCP_SYN | TCP_ACK, conn->iss,
+				     conn->irs + 1, NULL, 0);
+	}
+
+	conn = sb_range_conn(ntohs(tcp->tcp_src), false);
+	if (!conn)
+		return 0;
+
+	data_len = len - ETHER_HDR_SIZE - IP_HDR_SIZE -
+		GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+	if (tcp->tcp_flags & TCP_FIN) {
+		/* the client closes in turn */
+		conn->port = 0;
+		return sb_range_send(dev, packet, TCP_ACK, ntohl(tcp->tcp_ack),
+				     ntohl(tcp->tcp_seq) + data_len + 1, NULL, 0);
+	}
+	if (!data_len)
+		return 0;
+
+	n = min_t(int, data_len, sizeof(req) - 1);
+	memcpy(req, packet + len - data_len, n);
+	req[n] = '\0';
+
+	if (!strncmp(req, "HEAD ", 5)) {
+		sb_range.heads++;
+		n = snprintf(resp, sizeof(resp),
+			     "HTTP/1.1 200 OK\r\n"
+			     "Accept-Ranges: bytes\r\n"
+			     "Content-Length: %d\r\n"
+			     "Connection: close\r\n"
+			     "\r\n", SB_RANGE_SIZE);
+	} else {
+		pos = strstr(req, "Range: bytes=");
+		if (!pos || sb_range.gets == SB_RANGE_CONNS)
+			return 0;
+		start = simple_strtoul(pos + 13, &pos, 10);
+		end = simple_strtoul(pos + 1, NULL, 10);
+		if (end >= SB_RANGE_SIZE || start > end ||
+		    end - start >= SB_RANGE_SIZE / 2)
+			return 0;
+		sb_range.start[sb_range.gets] = start;
+		sb_range.end[sb_range.gets] = end;
+		sb_range.gets++;
+
+		n = snprintf(resp, sizeof(resp),
+			     "HTTP/1.1 206 Partial Content\r\n"
+			     "Content-Range: bytes %lu-%lu/%d\r\n"
+			     "Content-Length: %lu\r\n"
+			     "Connection: close\r\n"
+			     "\r\n", start, end, SB_RANGE_SIZE,
+			     end - start + 1);
+		while (start <= end)
+			resp[n++] = sb_range_byte(start++);
+	}
+
+	return sb_range_send(dev, packet, TCP_ACK | TCP_PUSH | TCP_FIN,
+			     conn->iss + 1, ntohl(tcp->tcp_seq) + data_len,
+			     resp, n);
+}
+
+static int net_test_wget_ranges(struct unit_test_state *uts)
+{
+	char *prev_ethact = env_get("ethact");
+	char *prev_ethrotate = env_get("ethrotate");
+	u8 file[SB_RANGE_SIZE], digest[HASH_MAX_DIGEST_SIZE];
+	char hex[HASH_MAX_DIGEST_SIZE * 2 + 1];
+	int i, size = sizeof(digest);
+	void *ptr;
+
+	for (i = 0; i < SB_RANGE_SIZE; i++)
+		file[i] = sb_range_byte(i);
+	ut_assertok(hash_block("sha256", file, SB_RANGE_SIZE, digest, &size));
+	*bin2hex(hex, digest, size) = '\0';
+
+	sandbox_eth_set_tx_handler(0, sb_range_handler);
+	sandbox_eth_set_priv(0, uts);
+
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("wgetaddr", "0x20000");
+	env_set("wgethash", hex);
+
+	/* the size is found first, then each half is fetched separately */
+	memset(&sb_range, '\0', sizeof(sb_range));
+	ut_assertok(run_command("wget -j 2 -c sha256:${wgethash} ${wgetaddr} 1.1.2.2:/file.bin",
+				0));
+	ut_assert_nextline("##################################################");
+	ut_assert_nextline("Packets received 9, Transfer Successful");
+	ut_assert_nextline("Bytes transferred = 1000 (3e8 hex)");
+	ut_asserteq(1, sb_range.heads);
+	ut_asserteq(2, sb_range.gets);
+	ut_asserteq(0, sb_range.start[0]);
+	ut_asserteq(499, sb_range.end[0]);
+	ut_asserteq(500, sb_range.start[1]);
+	ut_asserteq(999, sb_range.end[1]);
+	ut_asserteq(SB_RANGE_SIZE, env_get_hex("filesize", 0));
+
+	ptr = map_sysmem(0x20000, SB_RANGE_SIZE);
+	ut_asserteq_mem(file, ptr, SB_RANGE_SIZE);
+	unmap_sysmem(ptr);
+
+	/* a download which does not match the hash fails */
+	memset(&sb_range, '\0', sizeof(sb_range));
+	hex[0] = hex[0] == '0' ? '1' : '0';
+	env_set("wgethash", hex);
+	ut_asserteq(1, run_command("wget -j 2 -c sha256:${wgethash} ${wgetaddr} 1.1.2.2:/file.bin",
+				   0));
+	ut_assert_nextline("##################################################");
+	ut_assert_nextline("wget: sha256 of the download does not match");
+	ut_assert_console_end();
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	env_set("wgethash", NULL);
+	env_set("ethact", prev_ethact);
+	env_set("ethrotate", prev_ethrotate);
+
+	return 0;
+}
+CMD_TEST(net_test_wget_ranges, UTF_CONSOLE);
+
 static int net_test_wget_uri_validate(struct unit_test_state *uts)
 {
 	ut_asserteq(true, wget_validate_uri("http://foo.com/bar.html"));
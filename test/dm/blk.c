@@ -5,11 +5,14 @@
 
 #include <blk.h>
 #include <dm.h>
+#include <fs.h>
+#include <os.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -294,3 +297,285 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Check that each block in @buf holds its own block number */
+static int check_blocks(struct unit_test_state *uts, const char *buf,
+			lbaint_t start, lbaint_t blkcnt)
+{
+	lbaint_t i;
+
+	for (i = 0; i < blkcnt; i++) {
+		ut_asserteq(start + i, buf[i * 512]);
+		ut_asserteq(start + i, buf[i * 512 + 511]);
+	}
+
+	return 0;
+}
+
+/* Exercise the block cache, including read-ahead and eviction */
+static int blk_cache_run(struct unit_test_state *uts, struct udevice *dev)
+{
+	struct block_cache_dev_stats dev_stats;
+	struct block_cache_stats stats;
+	char buf[64 * 512];
+	lbaint_t i;
+
+	for (i = 0; i < 64; i++)
+		memset(buf + i * 512, i, 512);
+	ut_asserteq(64, blk_write(dev, 0, 64, buf));
+	blkcache_stats(&stats);
+
+	/* a single read misses and is cached as it is */
+	ut_asserteq(1, blk_read(dev, 4, 1, buf));
+	ut_assertok(check_blocks(uts, buf, 4, 1));
+
+	/* the next read follows on, so it reads ahead */
+	ut_asserteq(1, blk_read(dev, 5, 1, buf));
+	ut_assertok(check_blocks(uts, buf, 5, 1));
+	for (i = 6; i < 5 + CONFIG_BLOCK_CACHE_READAHEAD; i++) {
+		ut_asserteq(1, blk_read(dev, i, 1, buf));
+		ut_assertok(check_blocks(uts, buf, i, 1));
+	}
+	ut_asserteq(2, blk_read(dev, 2, 2, buf));
+	ut_assertok(check_blocks(uts, buf, 2, 2));
+
+	blkcache_stats(&stats);
+	ut_asserteq(CONFIG_BLOCK_CACHE_READAHEAD - 1, stats.hits);
+	ut_asserteq(3, stats.misses);
+	ut_asserteq(0, stats.evictions);
+	ut_asserteq(CONFIG_BLOCK_CACHE_READAHEAD + 3, stats.entries);
+
+	ut_assertok(blkcache_dev_stats(0, &dev_stats));
+	ut_asserteq(UCLASS_MMC, dev_stats.iftype);
+	ut_asserteq(0, dev_stats.devnum);
+	ut_asserteq(CONFIG_BLOCK_CACHE_READAHEAD + 3, dev_stats.blocks);
+	ut_asserteq(stats.size, dev_stats.size);
+	ut_asserteq(-ENOENT, blkcache_dev_stats(1, &dev_stats));
+
+	/* a write drops the cached blocks of the device */
+	ut_asserteq(1, blk_write(dev, 63, 1, buf + 63 * 512));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.entries);
+	ut_asserteq(0, stats.size);
+
+	/* the cache must have room for one read of the largest size cached */
+	ut_asserteq(-EINVAL, blkcache_configure(32, 32 * 512));
+
+	/* make room for eight blocks and fill it with non-sequential reads */
+	ut_assertok(blkcache_configure(1, 8 * 600));
+	for (i = 0; i < 16; i += 2)
+		ut_asserteq(1, blk_read(dev, i, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(8, stats.entries);
+	ut_asserteq(0, stats.evictions);
+
+	/* another block pushes out the least recently used one */
+	ut_asserteq(1, blk_read(dev, 16, 1, buf));
+	ut_asserteq(1, blk_read(dev, 2, 1, buf));
+	ut_asserteq(1, blk_read(dev, 0, 1, buf));
+	ut_assertok(check_blocks(uts, buf, 0, 1));
+	blkcache_stats(&stats);
+	ut_asserteq(8, stats.entries);
+	ut_asserteq(2, stats.evictions);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(2, stats.misses);
+
+	/* reads which are too large are not cached */
+	ut_asserteq(2, blk_read(dev, 20, 2, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.misses);
+
+	return 0;
+}
+
+/* Test the block cache, including read-ahead and eviction */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(BLOCK_CACHE))
+		return -EAGAIN;
+
+	ut_assertok(blk_get_device(UCLASS_MMC, 0, &dev));
+	ret = blk_cache_run(uts, dev);
+
+	/* put back the defaults, even if the test failed */
+	ut_assertok(blkcache_configure(32, CONFIG_BLOCK_CACHE_SIZE));
+	ut_assertok(ret);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/*
+ * Walk the directory tree below @path on the filesystem on @desc, adding the
+ * number of files found to @countp
+ */
+static int blk_cache_walk(struct unit_test_state *uts, struct blk_desc *desc,
+			  const char *path, int *countp)
+{
+	char subdirs[16][32], subpath[256];
+	struct fs_dir_stream *dirs;
+	struct fs_dirent *dent;
+	int count = 0, i;
+
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	dirs = fs_opendir(path);
+	ut_assertnonnull(dirs);
+	while ((dent = fs_readdir(dirs))) {
+		if (dent->type != FS_DT_DIR)
+			(*countp)++;
+		else if (strcmp(dent->name, ".") && strcmp(dent->name, "..") &&
+			 count < ARRAY_SIZE(subdirs))
+			strlcpy(subdirs[count++], dent->name,
+				sizeof(subdirs[0]));
+	}
+	fs_closedir(dirs);
+
+	/* only one directory can be open at a time, so go down afterwards */
+	for (i = 0; i < count; i++) {
+		snprintf(subpath, sizeof(subpath), "%s/%s", path, subdirs[i]);
+		ut_assertok(blk_cache_walk(uts, desc, subpath, countp));
+	}
+
+	return 0;
+}
+
+/* Walk a directory tree with the cache off, then on, counting device reads */
+static int blk_cache_fs_run(struct unit_test_state *uts, struct udevice *blk)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(blk);
+	struct host_blk_priv *priv = dev_get_priv(blk);
+	struct block_cache_stats stats;
+	uint uncached, cached;
+	int count;
+
+	/* with no cache, each block read needed by the walk goes to the device */
+	ut_assertok(blkcache_configure(0, 0));
+	count = 0;
+	priv->reads = 0;
+	ut_assertok(blk_cache_walk(uts, desc, "", &count));
+	ut_asserteq(320, count);
+	uncached = priv->reads;
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+
+	/* the metadata is read over and over, so most reads hit the cache */
+	ut_assertok(blkcache_configure(32, CONFIG_BLOCK_CACHE_SIZE));
+	count = 0;
+	priv->reads = 0;
+	ut_assertok(blk_cache_walk(uts, desc, "", &count));
+	ut_asserteq(320, count);
+	cached = priv->reads;
+	blkcache_stats(&stats);
+	ut_asserteq(cached, stats.misses);
+	ut_assert(cached * 10 < uncached);
+
+	return 0;
+}
+
+/* Test that the block cache saves device reads when walking a filesystem */
+static int dm_test_blk_cache_fs(struct unit_test_state *uts)
+{
+	struct udevice *dev, *blk;
+	char fname[256];
+	int ret;
+
+	if (!CONFIG_IS_ENABLED(BLOCK_CACHE) || !CONFIG_IS_ENABLED(FS_EXT4))
+		return -EAGAIN;
+
+	ut_assertok(host_create_device("test0", false, DEFAULT_BLKSZ, &dev));
+	ut_assertok(os_persistent_file(fname, sizeof(fname), "4MB.ext4.img"));
+	ut_assertok(host_attach_file(dev, fname));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+
+	ret = blk_cache_fs_run(uts, blk);
+
+	/* put back the defaults, even if the test failed */
+	ut_assertok(blkcache_configure(32, CONFIG_BLOCK_CACHE_SIZE));
+	ut_assertok(ret);
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache_fs, UTF_SCAN_FDT);
+
+/*
+ * Read, or write, @count requests of @blkcnt blocks each, keeping @depth of
+ * them in flight. Return the number of times the device had to be polled.
+ */
+static int blk_async_run(struct unit_test_state *uts, struct udevice *blk,
+			 enum blk_req_op op, char *buf, int count,
+			 lbaint_t blkcnt, int depth)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(blk);
+	struct host_blk_priv *priv = dev_get_priv(blk);
+	struct blk_request reqs[8], *req;
+	uint polls = priv->polls;
+	int i;
+
+	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	for (i = 0; i < count + depth; i++) {
+		req = &reqs[i % depth];
+		if (i >= depth)
+			ut_asserteq(blkcnt, blk_wait(req));
+		if (i >= count)
+			continue;
+
+		memset(req, '\0', sizeof(*req));
+		if (op == BLK_REQ_READ) {
+			ut_assertok(blk_dread_async(desc, i * blkcnt, blkcnt,
+						    buf + i * blkcnt * 512,
+						    req));
+		} else {
+			req->dev = blk;
+			req->op = op;
+			req->start = i * blkcnt;
+			req->blkcnt = blkcnt;
+			req->buffer = buf + i * blkcnt * 512;
+			ut_assertok(blk_submit(req));
+		}
+	}
+
+	return priv->polls - polls;
+}
+
+/* Test asynchronous block requests, with more than one in flight */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	static char ref[64 * 512], buf[64 * 512];
+	struct udevice *dev, *blk;
+	char fname[256];
+
+	ut_assertok(host_create_device("test0", true, DEFAULT_BLKSZ, &dev));
+	ut_assertok(os_persistent_file(fname, sizeof(fname), "2MB.ext2.img"));
+	ut_assertok(host_attach_file(dev, fname));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	ut_asserteq(64, blk_read(blk, 0, 64, ref));
+
+	/* one at a time, each read takes a poll of the device */
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(16, blk_async_run(uts, blk, BLK_REQ_READ, buf, 16, 4, 1));
+	ut_asserteq_mem(ref, buf, sizeof(buf));
+
+	/* with eight in flight, the device completes eight per poll */
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(2, blk_async_run(uts, blk, BLK_REQ_READ, buf, 16, 4, 8));
+	ut_asserteq_mem(ref, buf, sizeof(buf));
+
+	/* writing the data back leaves the device as it was */
+	ut_asserteq(4, blk_async_run(uts, blk, BLK_REQ_WRITE, buf, 16, 4, 4));
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(64, blk_read(blk, 0, 64, buf));
+	ut_asserteq_mem(ref, buf, sizeof(buf));
+
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UTF_SCAN_FDT);
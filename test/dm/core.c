@@ -12,6 +12,7 @@
 #include <malloc.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -1425,3 +1426,23 @@ static int dm_test_multimatch(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_multimatch, UTF_SCAN_FDT);
+
+/* Test that a driver asked for by name reports that it refused to bind */
+static int dm_test_multimatch_drv(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	ofnode node;
+
+	node = ofnode_path("/multimatch-test");
+	ut_assert(ofnode_valid(node));
+	dm_testdrv_op_count[DM_TEST_OP_BIND] = 0;
+	ut_asserteq(-ENODEV,
+		    lists_bind_fdt(uts->root, node, &dev,
+				   DM_DRIVER_GET(test_multimatch_first),
+				   false));
+	ut_assertnull(dev);
+	ut_asserteq(1, dm_testdrv_op_count[DM_TEST_OP_BIND]);
+
+	return 0;
+}
+DM_TEST(dm_test_multimatch_drv, 0);
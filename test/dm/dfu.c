@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for writing images over DFU
+ */
+
+#include <dfu.h>
+#include <env.h>
+#include <mapmem.h>
+#include <uthread.h>
+#include <dm/test.h>
+#include <test/ut.h>
+#include <linux/stringify.h>
+
+#define DFU_TEST_ADDR		0x20000
+#define DFU_TEST_AREA		0x4000
+#define DFU_TEST_BUF_SIZE	0x1000
+#define DFU_TEST_XFER		0x400
+/* three full buffers and a half one */
+#define DFU_TEST_SIZE		0x3800
+
+static int dm_test_dfu_write_async(struct unit_test_state *uts)
+{
+	static u8 data[DFU_TEST_SIZE];
+	struct dfu_entity *dfu;
+	u8 *mem;
+	int i;
+
+	for (i = 0; i < DFU_TEST_SIZE; i++)
+		data[i] = i * 13 + (i >> 8);
+	mem = map_sysmem(DFU_TEST_ADDR, DFU_TEST_AREA);
+	memset(mem, 0xa5, DFU_TEST_AREA);
+
+	ut_assertok(env_set("dfu_bufsiz", __stringify(DFU_TEST_BUF_SIZE)));
+	ut_assertok(env_set("dfu_alt_info",
+			    "img ram " __stringify(DFU_TEST_ADDR) " "
+			    __stringify(DFU_TEST_AREA)));
+	ut_assertok(dfu_init_env_entities("ram", "0"));
+	dfu = dfu_get_entity(0);
+	ut_assertnonnull(dfu);
+
+	/* fill the first buffer, which is then written to the medium */
+	for (i = 0; i < DFU_TEST_BUF_SIZE / DFU_TEST_XFER; i++)
+		ut_assertok(dfu_write(dfu, data + i * DFU_TEST_XFER,
+				      DFU_TEST_XFER, i));
+
+	/* the write waits for a thread to run, so more data can be taken */
+	if (IS_ENABLED(CONFIG_DFU_WRITE_ASYNC))
+		ut_asserteq(0xa5, mem[0]);
+	while (uthread_schedule())
+		;
+	ut_asserteq_mem(data, mem, DFU_TEST_BUF_SIZE);
+	ut_asserteq(0xa5, mem[DFU_TEST_BUF_SIZE]);
+
+	for (; i < DFU_TEST_SIZE / DFU_TEST_XFER; i++)
+		ut_assertok(dfu_write(dfu, data + i * DFU_TEST_XFER,
+				      DFU_TEST_XFER, i));
+	ut_assertok(dfu_flush(dfu, NULL, 0, i));
+
+	/* every buffer is on the medium, in order, and nothing more */
+	ut_asserteq_mem(data, mem, DFU_TEST_SIZE);
+	ut_asserteq(0xa5, mem[DFU_TEST_SIZE]);
+
+	dfu_free_entities();
+	env_set("dfu_alt_info", NULL);
+	env_set("dfu_bufsiz", NULL);
+	unmap_sysmem(mem);
+
+	return 0;
+}
+DM_TEST(dm_test_dfu_write_async, 0);
@@ -9,8 +9,10 @@
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <image.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <net6.h>
 #include <asm/eth.h>
@@ -537,6 +539,288 @@ static int dm_test_eth_async_arp_reply(struct unit_test_state *uts)
 DM_TEST(dm_test_eth_async_arp_reply, UTF_SCAN_FDT);
 #endif
 
+#if CONFIG_IS_ENABLED(NET)
+/* Number of ARP requests from the fake host which are answered */
+static int sb_batch_arp_replies;
+
+static int sb_with_batch_arp_handler(struct udevice *dev, void *packet,
+				     unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
+	int ret;
+	int i;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP &&
+	    ntohs(arp->ar_op) == ARPOP_REPLY)
+		sb_batch_arp_replies++;
+
+	/*
+	 * Queue requests from another host ahead of the reply to our own
+	 * request, so that they all arrive in one batch. Leave room for the
+	 * reply and for the ping reply, which is queued while the batch is
+	 * still being processed
+	 */
+	if (ntohs(eth->et_protlen) == PROT_ARP &&
+	    ntohs(arp->ar_op) == ARPOP_REQUEST) {
+		priv->fake_host_ipaddr = string_to_ip("1.1.2.4");
+		for (i = 0; i < PKTBUFSRX - 2; i++) {
+			ret = sandbox_eth_recv_arp_req(dev);
+			if (ret)
+				return ret;
+		}
+	}
+
+	sandbox_eth_arp_req_to_reply(dev, packet, len);
+	sandbox_eth_ping_req_to_reply(dev, packet, len);
+
+	return 0;
+}
+
+/*
+ * Ping the fake host through @name, with ARP requests from another host queued
+ * ahead of the ARP reply, and check that all the packets were handled
+ */
+static int eth_batch_run(struct unit_test_state *uts, const char *name,
+			 struct eth_sandbox_priv **privp)
+{
+	sandbox_eth_tx_hand_f *handler;
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	int ret;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, name, &dev));
+	priv = dev_get_priv(dev);
+	priv->recv_batches = 0;
+	priv->recv_frees = 0;
+	priv->recv_copies = 0;
+	sb_batch_arp_replies = 0;
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+	handler = priv->tx_handler;
+	priv->tx_handler = sb_with_batch_arp_handler;
+	env_set("ethact", name);
+	ret = net_loop(PING);
+	priv->tx_handler = handler;
+	ut_assertok(ret);
+
+	/* every request was answered and every buffer given back */
+	ut_asserteq(PKTBUFSRX - 2, sb_batch_arp_replies);
+	ut_asserteq(0, priv->recv_packets);
+	*privp = priv;
+
+	return 0;
+}
+
+static int dm_test_eth_batch_recv(struct unit_test_state *uts)
+{
+	struct eth_sandbox_priv *batch, *single;
+
+	/* the requests and the ARP reply came in one batch, then the ping */
+	ut_assertok(eth_batch_run(uts, "eth@10002000", &batch));
+	ut_asserteq(2, batch->recv_batches);
+	ut_asserteq(2, batch->recv_frees);
+	ut_asserteq(1, batch->recv_copies);
+
+	/*
+	 * Through recv(), each packet is given back on its own and those behind
+	 * it are moved up each time
+	 */
+	ut_assertok(eth_batch_run(uts, "eth@10004000", &single));
+	ut_asserteq(0, single->recv_batches);
+	ut_asserteq(PKTBUFSRX, single->recv_frees);
+	ut_asserteq((PKTBUFSRX - 1) * (PKTBUFSRX - 2) / 2 + 1,
+		    single->recv_copies);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_batch_recv, UTF_SCAN_FDT);
+#endif
+
+#if CONFIG_IS_ENABLED(NET) && IS_ENABLED(CONFIG_TFTP_ADAPTIVE_WINDOW)
+#define SB_TFTP_PORT		69
+#define SB_TFTP_TID		21313
+#define SB_TFTP_BLKSIZE		512
+/* eleven full blocks and a short one */
+#define SB_TFTP_BLOCKS		12
+#define SB_TFTP_SIZE		(SB_TFTP_BLKSIZE * (SB_TFTP_BLOCKS - 1) + 100)
+
+/**
+ * struct sb_tftp_server - A TFTP server on a network which loses packets
+ *
+ * @data: Contents of the file
+ * @window: Window size agreed with the client
+ * @lossy: true to lose every fourth block, starting at block 3, the first
+ *	time it is sent. This is the first block of every other window
+ *	when the window size is 2.
+ * @sent: Whether each block has been sent
+ * @packets: Number of data packets sent
+ */
+struct sb_tftp_server {
+	u8 data[SB_TFTP_SIZE];
+	int window;
+	bool lossy;
+	bool sent[SB_TFTP_BLOCKS + 1];
+	int packets;
+};
+
+static struct sb_tftp_server sb_tftp;
+
+/* Queue a UDP packet from the server in reply to a packet from the client */
+static void sb_tftp_reply(struct udevice *dev, void *packet, void *data,
+			  int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return;
+
+	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)eth_recv + ETHER_HDR_SIZE;
+	memset(ipr, '\0', IP_UDP_HDR_SIZE);
+	ipr->ip_hl_v = 0x45;
+	ipr->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	ipr->ip_off = htons(IP_FLAGS_DFRAG);
+	ipr->ip_ttl = 255;
+	ipr->ip_p = IPPROTO_UDP;
+	net_copy_ip(&ipr->ip_dst, &ip->ip_src);
+	net_copy_ip(&ipr->ip_src, &ip->ip_dst);
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = htons(SB_TFTP_TID);
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(UDP_HDR_SIZE + len);
+	memcpy((void *)ipr + IP_UDP_HDR_SIZE, data, len);
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+	++priv->recv_packets;
+}
+
+static void sb_tftp_send_block(struct udevice *dev, void *packet, int block)
+{
+	int offset = (block - 1) * SB_TFTP_BLKSIZE;
+	int size = min(SB_TFTP_SIZE - offset, SB_TFTP_BLKSIZE);
+	u8 buf[4 + SB_TFTP_BLKSIZE];
+	bool first = !sb_tftp.sent[block];
+
+	sb_tftp.sent[block] = true;
+	if (first && sb_tftp.lossy && block % 4 == 3)
+		return;
+
+	*(__be16 *)buf = htons(3);		/* DATA */
+	*(__be16 *)(buf + 2) = htons(block);
+	memcpy(buf + 4, sb_tftp.data + offset, size);
+	sb_tftp_reply(dev, packet, buf, 4 + size);
+	sb_tftp.packets++;
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *tftp = (void *)ip + IP_UDP_HDR_SIZE;
+	char *opt, *end;
+	u8 buf[64];
+	char *p;
+	int block;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	/* RRQ: agree to the window size asked for, with small blocks */
+	if (ntohs(ip->udp_dst) == SB_TFTP_PORT && ntohs(tftp[0]) == 1) {
+		end = (char *)ip + IP_UDP_HDR_SIZE + ntohs(ip->udp_len) -
+		      UDP_HDR_SIZE;
+		sb_tftp.window = 1;
+		for (opt = (char *)(tftp + 1); opt < end;
+		     opt += strlen(opt) + 1) {
+			if (!strcmp(opt, "windowsize"))
+				sb_tftp.window = dectoul(opt + 11, NULL);
+		}
+
+		*(__be16 *)buf = htons(6);	/* OACK */
+		p = (char *)buf + 2;
+		p += sprintf(p, "blksize%c%d%c", 0, SB_TFTP_BLKSIZE, 0);
+		if (sb_tftp.window > 1)
+			p += sprintf(p, "windowsize%c%d%c", 0, sb_tftp.window,
+				     0);
+		sb_tftp_reply(dev, packet, buf, p - (char *)buf);
+
+		return 0;
+	}
+
+	/* ACK: send the next window */
+	if (ntohs(ip->udp_dst) == SB_TFTP_TID && ntohs(tftp[0]) == 4) {
+		for (block = ntohs(tftp[1]) + 1;
+		     block <= ntohs(tftp[1]) + sb_tftp.window &&
+		     block <= SB_TFTP_BLOCKS; block++)
+			sb_tftp_send_block(dev, packet, block);
+	}
+
+	return 0;
+}
+
+/* Fetch the file and check that it all arrived, returning the window used */
+static int sb_tftp_get(struct unit_test_state *uts, bool lossy)
+{
+	memset(sb_tftp.sent, '\0', sizeof(sb_tftp.sent));
+	sb_tftp.lossy = lossy;
+	sb_tftp.packets = 0;
+	ut_asserteq(1, net_loop(TFTPGET));
+	ut_asserteq(SB_TFTP_SIZE, net_boot_file_size);
+	ut_asserteq_mem(sb_tftp.data, map_sysmem(image_load_addr, 0),
+			SB_TFTP_SIZE);
+
+	return sb_tftp.window;
+}
+
+static int dm_test_eth_tftp_loss(struct unit_test_state *uts)
+{
+	int i;
+
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		sb_tftp.data[i] = i * 7 + (i >> 9);
+
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.4");
+	env_set("tftpwindowsize", "2");
+	copy_filename(net_boot_file_name, "test.img",
+		      sizeof(net_boot_file_name));
+
+	/*
+	 * Blocks 3, 7 and 11 are lost. Each is sent again with the block after
+	 * it, which was kept the first time, and there are no timeouts
+	 */
+	ut_asserteq(2, sb_tftp_get(uts, true));
+	ut_asserteq(SB_TFTP_BLOCKS + 3, sb_tftp.packets);
+
+	/* a lossy transfer halves the window and a clean one restores it */
+	ut_asserteq(1, sb_tftp_get(uts, false));
+	ut_asserteq(SB_TFTP_BLOCKS, sb_tftp.packets);
+	ut_asserteq(2, sb_tftp_get(uts, false));
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("tftpwindowsize", NULL);
+	net_server_ip.s_addr = 0;
+
+	return 0;
+}
+DM_TEST(dm_test_eth_tftp_loss, UTF_SCAN_FDT);
+#endif
+
 #if CONFIG_IS_ENABLED(NET)
 static int sb_check_ping_reply(struct udevice *dev, void *packet,
 			       unsigned int len)
@@ -10,12 +10,32 @@
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
+#include <sparse_format.h>
+#include <uthread.h>
 #include <dm/test.h>
 #include <test/ut.h>
 #include <linux/stringify.h>
 
 #define FB_ALIAS_PREFIX "fastboot_partition_alias_"
 
+/* A sparse image four times the size of the download buffer */
+#define FB_STREAM_BUF_SIZE	0x4000
+#define FB_STREAM_BLK_SZ	4096
+#define FB_STREAM_RAW1_BLKS	12
+#define FB_STREAM_FILL_BLKS	2
+#define FB_STREAM_SKIP_BLKS	2
+#define FB_STREAM_RAW2_BLKS	4
+#define FB_STREAM_BLKS		(FB_STREAM_RAW1_BLKS + FB_STREAM_FILL_BLKS + \
+				 FB_STREAM_SKIP_BLKS + FB_STREAM_RAW2_BLKS)
+#define FB_STREAM_IMG_SIZE	(sizeof(sparse_header_t) + \
+				 4 * sizeof(chunk_header_t) + sizeof(u32) + \
+				 (FB_STREAM_RAW1_BLKS + FB_STREAM_RAW2_BLKS) * \
+				 FB_STREAM_BLK_SZ)
+/* how much of the image to send before checking what is on the disk */
+#define FB_STREAM_EARLY		0xa000
+/* space after the download buffer which must be left alone */
+#define FB_STREAM_GUARD		0x1000
+
 static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 {
 	char response[FASTBOOT_RESPONSE_LEN] = {0};
@@ -93,3 +113,183 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Add a chunk header to the sparse image at *@pp, followed by @len bytes */
+static void fb_stream_chunk(u8 **pp, u16 type, u32 blks, u32 len)
+{
+	chunk_header_t *chunk = (void *)*pp;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blks;
+	chunk->total_sz = sizeof(*chunk) + len;
+	*pp += sizeof(*chunk);
+}
+
+/* Send @len bytes of the image at @data as the UDP transport would */
+static int fb_stream_send(struct unit_test_state *uts, const u8 *data,
+			  uint len)
+{
+	char response[FASTBOOT_RESPONSE_LEN];
+	uint n;
+
+	for (; len; data += n, len -= n) {
+		n = min(len, 1020U);
+		fastboot_data_download(data, n, response);
+		ut_asserteq_str("", response);
+	}
+
+	return 0;
+}
+
+static int dm_test_fastboot_stream(struct unit_test_state *uts)
+{
+	static u8 buf[FB_STREAM_BUF_SIZE + FB_STREAM_GUARD];
+	static u8 img[FB_STREAM_IMG_SIZE];
+	static u8 disk[FB_STREAM_BLKS * FB_STREAM_BLK_SZ];
+	const uint img_size = FB_STREAM_IMG_SIZE;
+	const uint raw1_len = FB_STREAM_RAW1_BLKS * FB_STREAM_BLK_SZ;
+	const uint raw2_len = FB_STREAM_RAW2_BLKS * FB_STREAM_BLK_SZ;
+	const uint fill_len = FB_STREAM_FILL_BLKS * FB_STREAM_BLK_SZ;
+	const uint skip_len = FB_STREAM_SKIP_BLKS * FB_STREAM_BLK_SZ;
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char str_disk_guid[UUID_STR_LEN + 1];
+	char cmd[FASTBOOT_COMMAND_LEN];
+	struct blk_desc *mmc_dev_desc;
+	struct disk_partition parts[1] = {
+		{
+			.start = 48,
+			.size = 256,
+			.name = "stream",
+		},
+	};
+	sparse_header_t *hdr = (void *)img;
+	u8 *raw1, *raw2, *p;
+	u32 *fill;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	/* the don't-care chunk must leave this alone */
+	memset(disk, 0xa5, sizeof(disk));
+	ut_asserteq(sizeof(disk) / 512,
+		    blk_dwrite(mmc_dev_desc, 48, sizeof(disk) / 512, disk));
+
+	memset(hdr, '\0', sizeof(*hdr));
+	hdr->magic = SPARSE_HEADER_MAGIC;
+	hdr->major_version = 1;
+	hdr->file_hdr_sz = sizeof(*hdr);
+	hdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	hdr->blk_sz = FB_STREAM_BLK_SZ;
+	hdr->total_blks = FB_STREAM_BLKS;
+	hdr->total_chunks = 4;
+	p = img + sizeof(*hdr);
+	fb_stream_chunk(&p, CHUNK_TYPE_RAW, FB_STREAM_RAW1_BLKS, raw1_len);
+	raw1 = p;
+	for (i = 0; i < raw1_len; i++)
+		raw1[i] = i * 7 + (i >> 12);
+	p += raw1_len;
+	fb_stream_chunk(&p, CHUNK_TYPE_FILL, FB_STREAM_FILL_BLKS, sizeof(u32));
+	*(u32 *)p = 0xdeadbeef;
+	p += sizeof(u32);
+	fb_stream_chunk(&p, CHUNK_TYPE_DONT_CARE, FB_STREAM_SKIP_BLKS, 0);
+	fb_stream_chunk(&p, CHUNK_TYPE_RAW, FB_STREAM_RAW2_BLKS, raw2_len);
+	raw2 = p;
+	for (i = 0; i < raw2_len; i++)
+		raw2[i] = i * 13 + 1;
+	p += raw2_len;
+	ut_asserteq(img_size, p - img);
+
+	fastboot_init(buf, FB_STREAM_BUF_SIZE);
+
+	/* the image does not fit in the buffer */
+	snprintf(cmd, sizeof(cmd), "download:%08x", img_size);
+	ut_asserteq(FASTBOOT_COMMAND_DOWNLOAD,
+		    fastboot_handle_command(cmd, response));
+	snprintf(cmd, sizeof(cmd), "FAIL%08x", img_size);
+	ut_asserteq_str(cmd, response);
+
+	strcpy(cmd, "oem stream:stream");
+	ut_asserteq(FASTBOOT_COMMAND_OEM_STREAM,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+	snprintf(cmd, sizeof(cmd), "download:%08x", img_size);
+	ut_asserteq(FASTBOOT_COMMAND_DOWNLOAD,
+		    fastboot_handle_command(cmd, response));
+	snprintf(cmd, sizeof(cmd), "DATA%08x", img_size);
+	ut_asserteq_str(cmd, response);
+
+	/*
+	 * Whole halves of the buffer are written while the rest is still to
+	 * come, once the writer has had a chance to run
+	 */
+	ut_assertok(fb_stream_send(uts, img, FB_STREAM_EARLY));
+	while (uthread_schedule())
+		;
+	ut_asserteq(sizeof(disk) / 512,
+		    blk_dread(mmc_dev_desc, 48, sizeof(disk) / 512, disk));
+	ut_asserteq_mem(raw1, disk, 0x8000);
+	ut_asserteq(0xa5, disk[0x8000]);
+
+	ut_assertok(fb_stream_send(uts, img + FB_STREAM_EARLY,
+				   img_size - FB_STREAM_EARLY));
+	fastboot_data_complete(response);
+	ut_asserteq_str("OKAY", response);
+
+	/* it is already there, so flashing it is a formality */
+	strcpy(cmd, "flash:stream");
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+
+	ut_asserteq(sizeof(disk) / 512,
+		    blk_dread(mmc_dev_desc, 48, sizeof(disk) / 512, disk));
+	p = disk;
+	ut_asserteq_mem(raw1, p, raw1_len);
+	p += raw1_len;
+	for (fill = (u32 *)p; fill < (u32 *)(p + fill_len); fill++)
+		ut_asserteq(0xdeadbeef, *fill);
+	p += fill_len;
+	for (i = 0; i < skip_len; i++)
+		ut_asserteq(0xa5, p[i]);
+	p += skip_len;
+	ut_asserteq_mem(raw2, p, raw2_len);
+
+	/*
+	 * If writing fails, the rest of the download is dropped rather than
+	 * being put in the buffer, and the error is reported at the end
+	 */
+	memset(buf + FB_STREAM_BUF_SIZE, 0x5a, FB_STREAM_GUARD);
+	((chunk_header_t *)(img + sizeof(*hdr)))->chunk_type = 0xbad;
+	strcpy(cmd, "oem stream:stream");
+	ut_asserteq(FASTBOOT_COMMAND_OEM_STREAM,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("OKAY", response);
+	snprintf(cmd, sizeof(cmd), "download:%08x", img_size);
+	ut_asserteq(FASTBOOT_COMMAND_DOWNLOAD,
+		    fastboot_handle_command(cmd, response));
+	snprintf(cmd, sizeof(cmd), "DATA%08x", img_size);
+	ut_asserteq_str(cmd, response);
+	ut_assertok(fb_stream_send(uts, img, img_size));
+	fastboot_data_complete(response);
+	ut_asserteq_str("FAILUnknown chunk type", response);
+	for (i = 0; i < FB_STREAM_GUARD; i++)
+		ut_asserteq(0x5a, buf[FB_STREAM_BUF_SIZE + i]);
+
+	/* nothing was streamed, so there is nothing to flash */
+	strcpy(cmd, "flash:stream");
+	ut_asserteq(FASTBOOT_COMMAND_FLASH,
+		    fastboot_handle_command(cmd, response));
+	ut_asserteq_str("FAILimage was not downloaded", response);
+
+	fastboot_init(NULL, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_stream, UTF_SCAN_PDATA | UTF_SCAN_FDT);
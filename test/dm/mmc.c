@@ -6,6 +6,7 @@
 #include <dm.h>
 #include <mmc.h>
 #include <part.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -51,3 +52,143 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Check that transfers are split at the host limit, and how they are ended */
+static int dm_test_mmc_split(struct unit_test_state *uts)
+{
+	static char write[300 * 512], read[300 * 512];
+	struct sandbox_mmc_stats stats;
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	dev = dev_get_parent(dev_desc->bdev);
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 7 + (i >> 9);
+	sandbox_mmc_set_host(dev, 64, true);
+	sandbox_mmc_get_stats(dev, &stats);
+
+	/* each part is sized up front, so none needs stopping */
+	ut_asserteq(300, blk_dwrite(dev_desc, 16, 300, write));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(5, stats.transfers);
+	ut_asserteq(5, stats.set_counts);
+	ut_asserteq(0, stats.stops);
+	ut_asserteq(64, stats.max_blocks);
+
+	/* without SET_BLOCK_COUNT each part is stopped */
+	sandbox_mmc_set_host(dev, 64, false);
+	ut_asserteq(300, blk_dread(dev_desc, 16, 300, read));
+	ut_asserteq_mem(write, read, sizeof(read));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(5, stats.transfers);
+	ut_asserteq(0, stats.set_counts);
+	ut_asserteq(5, stats.stops);
+
+	/* with no limit the whole read is a single transfer */
+	sandbox_mmc_set_host(dev, U32_MAX, true);
+	memset(read, '\0', sizeof(read));
+	ut_asserteq(300, blk_dread(dev_desc, 16, 300, read));
+	ut_asserteq_mem(write, read, sizeof(read));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(1, stats.transfers);
+	ut_asserteq(1, stats.set_counts);
+	ut_asserteq(0, stats.stops);
+	ut_asserteq(300, stats.max_blocks);
+
+	/* a single block needs neither */
+	ut_asserteq(1, blk_dread(dev_desc, 1000, 1, read));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(0, stats.transfers);
+	ut_asserteq(0, stats.set_counts);
+	ut_asserteq(0, stats.stops);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_split, UTF_SCAN_PDATA | UTF_SCAN_FDT);
+
+/* Check that reads are queued as tasks once the card has a command queue */
+static int dm_test_mmc_cqe(struct unit_test_state *uts)
+{
+	static char write[300 * 512], read[300 * 512];
+	struct sandbox_mmc_stats stats;
+	struct blk_request reqs[16];
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(MMC_CQHCI))
+		return -EAGAIN;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	dev = dev_get_parent(dev_desc->bdev);
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 11 + (i >> 9);
+	ut_asserteq(300, blk_dwrite(dev_desc, 16, 300, write));
+	sandbox_mmc_set_cqe(dev, 8);
+	sandbox_mmc_get_stats(dev, &stats);
+
+	/* the card works on eight at a time, the rest wait for a free slot */
+	memset(read, '\0', sizeof(read));
+	memset(reqs, '\0', sizeof(reqs));
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ut_assertok(blk_dread_async(dev_desc, 16 + i * 4, 4,
+					    read + i * 4 * 512, &reqs[i]));
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ut_asserteq(4, blk_wait(&reqs[i]));
+	ut_asserteq_mem(write, read, 64 * 512);
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(16, stats.tasks);
+	ut_asserteq(8, stats.max_tasks);
+	ut_asserteq(0, stats.transfers);
+
+	/* a read longer than the host allows is split into tasks */
+	sandbox_mmc_set_host(dev, 64, true);
+	memset(read, '\0', sizeof(read));
+	memset(reqs, '\0', sizeof(reqs[0]));
+	ut_assertok(blk_dread_async(dev_desc, 16, 300, read, &reqs[0]));
+	ut_asserteq(300, blk_wait(&reqs[0]));
+	ut_asserteq_mem(write, read, sizeof(read));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(5, stats.tasks);
+	ut_asserteq(5, stats.max_tasks);
+
+	/* a task error fails the requests left, and the card's queue is reset */
+	sandbox_mmc_fail_tasks(dev, BIT(2));
+	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+	memset(read, '\0', sizeof(read));
+	memset(reqs, '\0', sizeof(reqs));
+	for (i = 0; i < 4; i++)
+		ut_assertok(blk_dread_async(dev_desc, 16 + i * 4, 4,
+					    read + i * 4 * 512, &reqs[i]));
+	ut_asserteq(4, blk_wait(&reqs[0]));
+	ut_asserteq(4, blk_wait(&reqs[1]));
+	ut_asserteq(-EIO, blk_wait(&reqs[2]));
+	ut_asserteq(-EIO, blk_wait(&reqs[3]));
+	ut_asserteq_mem(write, read, 8 * 512);
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(2, stats.tasks);
+	ut_asserteq(1, stats.discards);
+
+	/* the engine is used again by the next request */
+	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+	ut_assertok(blk_dread_async(dev_desc, 16, 4, read, &reqs[0]));
+	ut_asserteq(4, blk_wait(&reqs[0]));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(1, stats.tasks);
+
+	/* any other command takes the card out of command queue mode first */
+	sandbox_mmc_set_host(dev, U32_MAX, true);
+	memset(read, '\0', sizeof(read));
+	ut_asserteq(300, blk_dread(dev_desc, 16, 300, read));
+	ut_asserteq_mem(write, read, sizeof(read));
+	sandbox_mmc_get_stats(dev, &stats);
+	ut_asserteq(0, stats.tasks);
+	ut_asserteq(1, stats.transfers);
+
+	sandbox_mmc_set_cqe(dev, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cqe, UTF_SCAN_PDATA | UTF_SCAN_FDT);
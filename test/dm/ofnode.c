@@ -22,6 +22,7 @@
 #include <of_live.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <dm/of_access.h>
 #include <dm/of_extra.h>
 #include <dm/ofnode_graph.h>
 #include <dm/root.h>
@@ -1705,3 +1706,40 @@ static int dm_test_ofnode_graph(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_ofnode_graph, UTF_SCAN_FDT);
+
+/* check that the phandle and path index agree with the tree */
+static int dm_test_of_index(struct unit_test_state *uts)
+{
+	struct device_node *np, *child;
+	const char *opts;
+	int count = 0;
+
+	for_each_of_allnodes(np) {
+		ut_asserteq_ptr(np, of_find_node_by_path(np->full_name));
+		if (np->phandle)
+			ut_asserteq_ptr(np, of_find_node_by_phandle(NULL,
+								    np->phandle));
+		count++;
+	}
+	ut_assert(count > 100);
+
+	np = of_find_node_opts_by_path(NULL, "/phandle-node-1:opt/x", &opts);
+	ut_assertnonnull(np);
+	ut_asserteq_str("phandle-node-1", np->name);
+	ut_asserteq_str("opt/x", opts);
+	ut_assertnull(of_find_node_by_path("/phandle-node-1/"));
+	ut_assertnull(of_find_node_by_path("/no-such-node"));
+
+	/* nodes added later are not indexed, but must still be found */
+	np = of_find_node_by_path("/phandle-node-1");
+	ut_assertok(of_add_subnode(np, "index-test", -1, &child));
+	ut_asserteq_ptr(child,
+			of_find_node_by_path("/phandle-node-1/index-test"));
+
+	/* removed nodes must not be found */
+	ut_assertok(of_remove_node(child));
+	ut_assertnull(of_find_node_by_path("/phandle-node-1/index-test"));
+
+	return 0;
+}
+DM_TEST(dm_test_of_index, UTF_SCAN_FDT | UTF_LIVE_TREE);
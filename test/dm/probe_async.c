@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for probing devices in cooperative threads
+ */
+
+#include <dm.h>
+#include <uthread.h>
+#include <asm/global_data.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct probe_async_plat - Behaviour and results of a test device
+ *
+ * @steps: Number of times probe() yields before finishing
+ * @ret: Value for probe() to return
+ * @started: Sequence number when probe() started, 0 if not yet
+ * @finished: Sequence number when probe() finished, 0 if not yet
+ * @parent_done: true if the parent's probe() had finished when ours started
+ */
+struct probe_async_plat {
+	int steps;
+	int ret;
+	int started;
+	int finished;
+	bool parent_done;
+};
+
+static int probe_seq;
+
+static int probe_async_test_probe(struct udevice *dev)
+{
+	struct probe_async_plat *plat = dev_get_plat(dev);
+	struct probe_async_plat *parent_plat;
+	int i;
+
+	if (device_get_uclass_id(dev->parent) == UCLASS_NOP) {
+		parent_plat = dev_get_plat(dev->parent);
+		plat->parent_done = parent_plat->finished;
+	}
+
+	plat->started = ++probe_seq;
+	for (i = 0; i < plat->steps; i++)
+		uthread_schedule();
+	plat->finished = ++probe_seq;
+
+	return plat->ret;
+}
+
+U_BOOT_DRIVER(probe_async_test) = {
+	.name	= "probe_async_test",
+	.id	= UCLASS_NOP,
+	.probe	= probe_async_test_probe,
+};
+
+static int bind_test_dev(struct unit_test_state *uts, struct udevice *parent,
+			 const char *name, struct probe_async_plat *plat,
+			 struct udevice **devp)
+{
+	ut_assertok(device_bind(parent, DM_DRIVER_GET(probe_async_test), name,
+				plat, ofnode_null(), devp));
+
+	return 0;
+}
+
+/* Test that the probe() methods of two devices overlap */
+static int dm_test_probe_async_overlap(struct unit_test_state *uts)
+{
+	struct probe_async_plat plat_a = { .steps = 2 };
+	struct probe_async_plat plat_b = { .steps = 1 };
+	struct udevice *dev_a, *dev_b;
+
+	probe_seq = 0;
+	ut_assertok(bind_test_dev(uts, gd->dm_root, "async-a", &plat_a, &dev_a));
+	ut_assertok(bind_test_dev(uts, gd->dm_root, "async-b", &plat_b, &dev_b));
+	dev_or_flags(dev_a, DM_FLAG_PROBE_ASYNC);
+	dev_or_flags(dev_b, DM_FLAG_PROBE_ASYNC);
+
+	ut_assertok(dm_probe_async_start());
+	ut_asserteq(0, plat_a.started);
+	ut_assertok(dm_probe_async_wait());
+
+	ut_assert(device_active(dev_a));
+	ut_assert(device_active(dev_b));
+	ut_asserteq(1, plat_a.started);
+	ut_asserteq(2, plat_b.started);
+	ut_asserteq(3, plat_b.finished);
+	ut_asserteq(4, plat_a.finished);
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_overlap, 0);
+
+/* Test that probing a child waits for its parent's async probe */
+static int dm_test_probe_async_parent(struct unit_test_state *uts)
+{
+	struct probe_async_plat parent_plat = { .steps = 3 };
+	struct probe_async_plat child_plat = { };
+	struct udevice *parent, *child;
+
+	probe_seq = 0;
+	ut_assertok(bind_test_dev(uts, gd->dm_root, "async-parent",
+				  &parent_plat, &parent));
+	ut_assertok(bind_test_dev(uts, parent, "async-child", &child_plat,
+				  &child));
+
+	ut_assertok(device_probe_async(parent));
+	uthread_schedule();
+	ut_asserteq(1, parent_plat.started);
+	ut_asserteq(0, parent_plat.finished);
+
+	ut_assertok(device_probe(child));
+	ut_assert(child_plat.parent_done);
+	ut_asserteq(2, parent_plat.finished);
+	ut_asserteq(3, child_plat.started);
+	ut_assertok(dm_probe_async_wait());
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_parent, 0);
+
+/* Test that a failed async probe is reported to a device_probe() caller */
+static int dm_test_probe_async_fail(struct unit_test_state *uts)
+{
+	struct probe_async_plat plat = { .steps = 1, .ret = -EIO };
+	struct udevice *dev;
+
+	probe_seq = 0;
+	ut_assertok(bind_test_dev(uts, gd->dm_root, "async-fail", &plat, &dev));
+
+	ut_assertok(device_probe_async(dev));
+	uthread_schedule();
+	ut_asserteq(1, plat.started);
+
+	ut_asserteq(-ENODEV, device_probe(dev));
+	ut_asserteq(2, plat.finished);
+	ut_assert(!device_active(dev));
+	ut_assertok(dm_probe_async_wait());
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async_fail, 0);
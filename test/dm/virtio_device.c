@@ -130,6 +130,7 @@ static int dm_test_virtio_ring(struct unit_test_state *uts)
 	struct udevice *bus, *dev;
 	struct virtio_dev_priv *uc_priv;
 	struct virtqueue *vq;
+	struct vring_desc *desc;
 	struct virtio_sg sg[2];
 	struct virtio_sg *sgs[2];
 	unsigned int len;
@@ -192,6 +193,27 @@ static int dm_test_virtio_ring(struct unit_test_state *uts)
 	ut_asserteq(6, len);
 	ut_assertok(virtio_del_vqs(dev));
 
+	/* an indirect table takes a single descriptor for the chain */
+	uc_priv->features |= BIT_ULL(VIRTIO_RING_F_INDIRECT_DESC);
+	ut_assertok(virtio_find_vqs(dev, 1, &vq));
+	ut_assertok(virtqueue_add(vq, sgs, 1, 1));
+	ut_asserteq(vq->vring.num - 1, vq->num_free);
+	ut_asserteq(VRING_DESC_F_INDIRECT,
+		    virtio16_to_cpu(dev, vq->vring.desc[0].flags));
+	ut_asserteq(2 * sizeof(struct vring_desc),
+		    virtio32_to_cpu(dev, vq->vring.desc[0].len));
+	desc = (void *)(uintptr_t)virtio64_to_cpu(dev, vq->vring.desc[0].addr);
+	ut_asserteq_ptr(buffer[1],
+			(void *)(uintptr_t)virtio64_to_cpu(dev, desc[1].addr));
+	ut_asserteq(VRING_DESC_F_WRITE, virtio16_to_cpu(dev, desc[1].flags));
+	vq->vring.used->idx = 1;
+	vq->vring.used->ring[0].id = 0;
+	vq->vring.used->ring[0].len = 32;
+	ut_asserteq_ptr(buffer, virtqueue_get_buf(vq, &len));
+	ut_asserteq(vq->vring.num, vq->num_free);
+	ut_assertok(virtio_del_vqs(dev));
+	uc_priv->features &= ~BIT_ULL(VIRTIO_RING_F_INDIRECT_DESC);
+
 	return 0;
 }
 DM_TEST(dm_test_virtio_ring, UTF_SCAN_PDATA | UTF_SCAN_FDT);
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the virtio-net driver
+ */
+
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <virtio_types.h>
+#include <virtio.h>
+#include <virtio_ring.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../drivers/virtio/virtio_net.h"
+
+/* Hand the next @count receive buffers to the driver as packets */
+static void virtio_net_test_rx(struct udevice *dev, struct virtqueue *vq,
+			       int count)
+{
+	u16 idx = virtio16_to_cpu(dev, vq->vring.used->idx);
+	int i;
+
+	for (i = 0; i < count; i++, idx++) {
+		u16 head = virtio16_to_cpu(dev, vq->vring.avail->ring[idx %
+							vq->vring.num]);
+		u8 *buf = (void *)(uintptr_t)virtio64_to_cpu(dev,
+					vq->vring.desc[head].addr);
+
+		memset(buf, '\0', sizeof(struct virtio_net_hdr_v1));
+		memset(buf + sizeof(struct virtio_net_hdr_v1), idx, 60 + idx);
+		vq->vring.used->ring[idx % vq->vring.num].id = head;
+		vq->vring.used->ring[idx % vq->vring.num].len =
+			sizeof(struct virtio_net_hdr_v1) + 60 + idx;
+	}
+	vq->vring.used->idx = cpu_to_virtio16(dev, idx);
+}
+
+/* Test receiving a batch of packets, and stopping with some of it held */
+static int dm_test_virtio_net_batch(struct unit_test_state *uts)
+{
+	struct eth_rx_pkt pkts[ETH_PACKETS_BATCH_RECV];
+	struct virtio_dev_priv *uc_priv;
+	const struct eth_ops *ops;
+	struct udevice *bus, *dev;
+	struct virtqueue *vq;
+	char addrname[16];
+	ofnode node;
+	int i;
+
+	node = ofnode_path("/sandbox-virtio-net");
+	ut_assert(ofnode_valid(node));
+	ut_assertok(device_bind_driver_to_node(dm_root(), "virtio-sandbox1",
+					       "sandbox-virtio-net", node,
+					       &bus));
+	ut_assertok(device_probe(bus));
+	ut_assertok(device_find_first_child(bus, &dev));
+	/* the sandbox transport has no MAC address to offer */
+	if (dev_seq(dev))
+		snprintf(addrname, sizeof(addrname), "eth%daddr", dev_seq(dev));
+	else
+		strcpy(addrname, "ethaddr");
+	/* Must disable access protection to set it again */
+	env_set(".flags", addrname);
+	ut_assertok(env_set(addrname, "02:00:11:22:33:44"));
+	ut_assertok(device_probe(dev));
+	ut_asserteq(UCLASS_ETH, device_get_uclass_id(dev));
+
+	/* the device offers the event index and the driver takes it */
+	ut_assert(virtio_has_feature(dev, VIRTIO_RING_F_EVENT_IDX));
+	uc_priv = dev_get_uclass_priv(bus);
+	vq = list_first_entry(&uc_priv->vqs, struct virtqueue, list);
+	ut_asserteq(0, vq->index);
+	ut_assert(vq->event);
+
+	/* the whole receive ring is handed to the device */
+	ops = eth_get_ops(dev);
+	ut_assertok(ops->start(dev));
+	ut_asserteq(0, vq->num_free);
+	ut_asserteq(0, ops->recv_batch(dev, 0, pkts, ARRAY_SIZE(pkts)));
+
+	/* packets come back in the order they arrived */
+	virtio_net_test_rx(dev, vq, 3);
+	ut_asserteq(3, ops->recv_batch(dev, 0, pkts, ARRAY_SIZE(pkts)));
+	for (i = 0; i < 3; i++) {
+		ut_asserteq(60 + i, pkts[i].length);
+		ut_asserteq(i, pkts[i].packet[0]);
+		ut_asserteq(i, pkts[i].packet[59 + i]);
+	}
+	ut_asserteq(3, vq->num_free);
+
+	/* those not given back are handed over again */
+	ut_assertok(ops->free_batch(dev, pkts, 1));
+	ut_asserteq(2, vq->num_free);
+	ut_asserteq(2, ops->recv_batch(dev, 0, pkts, ARRAY_SIZE(pkts)));
+	ut_asserteq(61, pkts[0].length);
+	ut_asserteq(62, pkts[1].length);
+
+	/* stopping gives them back to the device, so nothing stale is left */
+	ops->stop(dev);
+	ut_asserteq(0, vq->num_free);
+	ut_assertok(ops->start(dev));
+	ut_asserteq(0, ops->recv_batch(dev, 0, pkts, ARRAY_SIZE(pkts)));
+
+	virtio_net_test_rx(dev, vq, 1);
+	ut_asserteq(1, ops->recv_batch(dev, 0, pkts, ARRAY_SIZE(pkts)));
+	ut_asserteq(63, pkts[0].length);
+	ut_assertok(ops->free_batch(dev, pkts, 1));
+	ops->stop(dev);
+	env_set(addrname, NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_virtio_net_batch, UTF_SCAN_PDATA | UTF_SCAN_FDT);
@@ -173,6 +173,37 @@ static int uncompress_using_gzip(struct unit_test_state *uts,
 	return ret;
 }
 
+/* Feed the data in small pieces to exercise the streaming decompressor */
+#define GZIP_STREAM_PIECE	7
+
+static int uncompress_using_gzip_stream(struct unit_test_state *uts,
+					void *in, unsigned long in_size,
+					void *out, unsigned long out_max,
+					unsigned long *out_size)
+{
+	struct gunzip_stream *gs;
+	unsigned long pos, len;
+	int ret;
+
+	ret = gunzip_stream_init(&gs, out, out_max);
+	if (ret)
+		return ret;
+
+	/* The first piece stops part-way through the header */
+	for (pos = 0; pos < in_size; pos += len) {
+		len = min_t(ulong, in_size - pos, pos ? GZIP_STREAM_PIECE : 3);
+		ret = gunzip_stream_feed(gs, in + pos, len);
+		if (ret)
+			break;
+	}
+	if (ret < 0) {
+		gunzip_stream_finish(gs, NULL);
+		return ret;
+	}
+
+	return gunzip_stream_finish(gs, out_size);
+}
+
 static int compress_using_bzip2(struct unit_test_state *uts,
 				void *in, unsigned long in_size,
 				void *out, unsigned long out_max,
@@ -472,6 +503,13 @@ static int compression_test_gzip(struct unit_test_state *uts)
 }
 LIB_TEST(compression_test_gzip, 0);
 
+static int compression_test_gzip_stream(struct unit_test_state *uts)
+{
+	return run_test(uts, "gzip_stream", compress_using_gzip,
+			uncompress_using_gzip_stream);
+}
+LIB_TEST(compression_test_gzip_stream, 0);
+
 static int compression_test_bzip2(struct unit_test_state *uts)
 {
 	return run_test(uts, "bzip2", compress_using_bzip2,
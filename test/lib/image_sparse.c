@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for writing Android sparse images
+ */
+
+#include <image-sparse.h>
+#include <test/lib.h>
+#include <test/ut.h>
+
+#define SPARSE_TEST_BLKSZ	512
+#define SPARSE_TEST_BLKS	2048
+/* a start which is not aligned to the erase unit */
+#define SPARSE_TEST_START	3
+#define SPARSE_TEST_ERASE_BLKS	8
+#define SPARSE_TEST_BLK_SZ	4096
+/* raw: a block, 64 blocks of zeroes and a block; fills of 64, 2 and 1 */
+#define SPARSE_TEST_RAW_BLKS	66
+#define SPARSE_TEST_IMG_SIZE	(sizeof(sparse_header_t) + \
+				 4 * sizeof(chunk_header_t) + \
+				 SPARSE_TEST_RAW_BLKS * SPARSE_TEST_BLK_SZ + \
+				 3 * sizeof(u32))
+
+/**
+ * struct sparse_test_disk - Storage which counts what is done to it
+ *
+ * @data: Contents
+ * @written: Number of blocks written
+ * @erased: Number of blocks erased
+ * @can_erase: true if erasing works
+ * @misaligned: true if an erase was not aligned to the erase unit
+ */
+struct sparse_test_disk {
+	u8 data[SPARSE_TEST_BLKS * SPARSE_TEST_BLKSZ];
+	lbaint_t written;
+	lbaint_t erased;
+	bool can_erase;
+	bool misaligned;
+};
+
+static struct sparse_test_disk sparse_disk;
+static u8 sparse_img[SPARSE_TEST_IMG_SIZE];
+
+static lbaint_t sparse_test_write(struct sparse_storage *info, lbaint_t blk,
+				  lbaint_t blkcnt, const void *buffer)
+{
+	memcpy(sparse_disk.data + blk * SPARSE_TEST_BLKSZ, buffer,
+	       blkcnt * SPARSE_TEST_BLKSZ);
+	sparse_disk.written += blkcnt;
+
+	return blkcnt;
+}
+
+static lbaint_t sparse_test_reserve(struct sparse_storage *info, lbaint_t blk,
+				    lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+static lbaint_t sparse_test_erase(struct sparse_storage *info, lbaint_t blk,
+				  lbaint_t blkcnt)
+{
+	if (!sparse_disk.can_erase)
+		return 0;
+	if (blk % SPARSE_TEST_ERASE_BLKS || blkcnt % SPARSE_TEST_ERASE_BLKS)
+		sparse_disk.misaligned = true;
+	memset(sparse_disk.data + blk * SPARSE_TEST_BLKSZ, '\0',
+	       blkcnt * SPARSE_TEST_BLKSZ);
+	sparse_disk.erased += blkcnt;
+
+	return blkcnt;
+}
+
+static void *sparse_test_chunk(void *p, u16 type, u32 blks, u32 len)
+{
+	chunk_header_t *chunk = p;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blks;
+	chunk->total_sz = sizeof(*chunk) + len;
+
+	return p + sizeof(*chunk);
+}
+
+static int sparse_test_fill(void *p, u32 fill_val)
+{
+	*(u32 *)p = fill_val;
+
+	return sizeof(u32);
+}
+
+/* Write the test image, returning the number of blocks written */
+static int sparse_test_run(struct unit_test_state *uts, bool can_erase)
+{
+	struct sparse_storage info = {
+		.blksz = SPARSE_TEST_BLKSZ,
+		.start = SPARSE_TEST_START,
+		.size = SPARSE_TEST_BLKS - SPARSE_TEST_START,
+		.write = sparse_test_write,
+		.reserve = sparse_test_reserve,
+		.erase = sparse_test_erase,
+		.erase_blks = SPARSE_TEST_ERASE_BLKS,
+	};
+	u8 *p = sparse_disk.data + SPARSE_TEST_START * SPARSE_TEST_BLKSZ;
+	u8 *raw = sparse_img + sizeof(sparse_header_t) +
+		sizeof(chunk_header_t);
+	int i;
+
+	memset(sparse_disk.data, 0xa5, sizeof(sparse_disk.data));
+	sparse_disk.written = 0;
+	sparse_disk.erased = 0;
+	sparse_disk.can_erase = can_erase;
+	sparse_disk.misaligned = false;
+	ut_assertok(write_sparse_image(&info, "test", sparse_img, NULL));
+
+	ut_asserteq_mem(raw, p, SPARSE_TEST_RAW_BLKS * SPARSE_TEST_BLK_SZ);
+	p += SPARSE_TEST_RAW_BLKS * SPARSE_TEST_BLK_SZ;
+	for (i = 0; i < 66 * SPARSE_TEST_BLK_SZ; i++)
+		ut_asserteq(0, p[i]);
+	p += 66 * SPARSE_TEST_BLK_SZ;
+	ut_asserteq(0x12345678, *(u32 *)p);
+	ut_asserteq(0x12345678, *(u32 *)(p + SPARSE_TEST_BLK_SZ - 4));
+	ut_asserteq(0xa5, p[SPARSE_TEST_BLK_SZ]);
+	ut_assert(!sparse_disk.misaligned);
+
+	return sparse_disk.written;
+}
+
+static int lib_image_sparse_erase(struct unit_test_state *uts)
+{
+	sparse_header_t *hdr = (void *)sparse_img;
+	u8 *p, *raw;
+
+	memset(sparse_img, '\0', sizeof(sparse_img));
+	hdr->magic = SPARSE_HEADER_MAGIC;
+	hdr->major_version = 1;
+	hdr->file_hdr_sz = sizeof(*hdr);
+	hdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	hdr->blk_sz = SPARSE_TEST_BLK_SZ;
+	hdr->total_blks = SPARSE_TEST_RAW_BLKS + 64 + 2 + 1;
+	hdr->total_chunks = 4;
+
+	p = sparse_test_chunk(sparse_img + sizeof(*hdr), CHUNK_TYPE_RAW,
+			      SPARSE_TEST_RAW_BLKS,
+			      SPARSE_TEST_RAW_BLKS * SPARSE_TEST_BLK_SZ);
+	raw = p;
+	memset(raw, 0x11, SPARSE_TEST_BLK_SZ);
+	memset(raw + 65 * SPARSE_TEST_BLK_SZ, 0x22, SPARSE_TEST_BLK_SZ);
+	p += SPARSE_TEST_RAW_BLKS * SPARSE_TEST_BLK_SZ;
+	p = sparse_test_chunk(p, CHUNK_TYPE_FILL, 64, sizeof(u32));
+	p += sparse_test_fill(p, 0);
+	p = sparse_test_chunk(p, CHUNK_TYPE_FILL, 2, sizeof(u32));
+	p += sparse_test_fill(p, 0);
+	p = sparse_test_chunk(p, CHUNK_TYPE_FILL, 1, sizeof(u32));
+	p += sparse_test_fill(p, 0x12345678);
+	ut_asserteq(SPARSE_TEST_IMG_SIZE, p - sparse_img);
+
+	/*
+	 * The long runs of zeroes are erased, apart from the blocks before and
+	 * after the erase units in them; the short fill is written
+	 */
+	ut_asserteq(56, sparse_test_run(uts, true));
+	ut_asserteq(1008, sparse_disk.erased);
+
+	/* everything is written if the storage cannot erase */
+	ut_asserteq(1064, sparse_test_run(uts, false));
+	ut_asserteq(0, sparse_disk.erased);
+
+	return 0;
+}
+LIB_TEST(lib_image_sparse_erase, 0);
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit test for crc32
+ */
+
+#include <test/lib.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+
+/* Bit-at-a-time CRC32, without the ones complement */
+static uint32_t crc32_ref(uint32_t crc, const uint8_t *buf, uint len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+	}
+
+	return crc;
+}
+
+static int lib_crc32(struct unit_test_state *uts)
+{
+	const char check[] = "123456789";
+	uint8_t buf[300];
+	uint len, ofs, i;
+
+	ut_asserteq(0xcbf43926, crc32(0, (const uint8_t *)check,
+				      sizeof(check) - 1));
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 97 + (i >> 3);
+
+	/* cover each alignment and the tail after eight-byte blocks */
+	for (ofs = 0; ofs < 8; ofs++) {
+		for (len = 0; len < sizeof(buf) - ofs; len++) {
+			ut_asserteq(crc32_ref(0x12345678, buf + ofs, len),
+				    crc32_no_comp(0x12345678, buf + ofs, len));
+		}
+	}
+
+	/* calculating in pieces must give the same result */
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    crc32(crc32(0, buf, 101), buf + 101, sizeof(buf) - 101));
+	ut_asserteq(crc32(0, buf, sizeof(buf)),
+		    crc32_wd(0, buf, sizeof(buf), 13));
+
+	return 0;
+}
+LIB_TEST(lib_crc32, 0);
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for sha512 and sha384 functions
+ *
+ * Test vectors are from FIPS 180-2
+ */
+
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <u-boot/sha512.h>
+
+static const char msg_abc[] = "abc";
+
+static const char msg_2blk[] =
+	"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+	"hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+static const uint8_t sha512_abc[SHA512_SUM_LEN] = {
+	0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+	0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+	0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2,
+	0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+	0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8,
+	0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+	0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e,
+	0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f
+};
+
+static const uint8_t sha512_2blk[SHA512_SUM_LEN] = {
+	0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+	0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+	0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+	0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+	0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+	0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+	0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+	0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09
+};
+
+/* one million repetitions of 'a' */
+static const uint8_t sha512_million[SHA512_SUM_LEN] = {
+	0xe7, 0x18, 0x48, 0x3d, 0x0c, 0xe7, 0x69, 0x64,
+	0x4e, 0x2e, 0x42, 0xc7, 0xbc, 0x15, 0xb4, 0x63,
+	0x8e, 0x1f, 0x98, 0xb1, 0x3b, 0x20, 0x44, 0x28,
+	0x56, 0x32, 0xa8, 0x03, 0xaf, 0xa9, 0x73, 0xeb,
+	0xde, 0x0f, 0xf2, 0x44, 0x87, 0x7e, 0xa6, 0x0a,
+	0x4c, 0xb0, 0x43, 0x2c, 0xe5, 0x77, 0xc3, 0x1b,
+	0xeb, 0x00, 0x9c, 0x5c, 0x2c, 0x49, 0xaa, 0x2e,
+	0x4e, 0xad, 0xb2, 0x17, 0xad, 0x8c, 0xc0, 0x9b
+};
+
+static const uint8_t sha384_abc[SHA384_SUM_LEN] = {
+	0xcb, 0x00, 0x75, 0x3f, 0x45, 0xa3, 0x5e, 0x8b,
+	0xb5, 0xa0, 0x3d, 0x69, 0x9a, 0xc6, 0x50, 0x07,
+	0x27, 0x2c, 0x32, 0xab, 0x0e, 0xde, 0xd1, 0x63,
+	0x1a, 0x8b, 0x60, 0x5a, 0x43, 0xff, 0x5b, 0xed,
+	0x80, 0x86, 0x07, 0x2b, 0xa1, 0xe7, 0xcc, 0x23,
+	0x58, 0xba, 0xec, 0xa1, 0x34, 0xc8, 0x25, 0xa7
+};
+
+static int lib_test_sha512(struct unit_test_state *uts)
+{
+	uint8_t digest[SHA512_SUM_LEN], buf[1000];
+	sha512_context ctx;
+	int i;
+
+	sha512_csum_wd((const uint8_t *)msg_abc, strlen(msg_abc), digest,
+		       CHUNKSZ_SHA512);
+	ut_asserteq_mem(sha512_abc, digest, SHA512_SUM_LEN);
+
+	sha512_csum_wd((const uint8_t *)msg_2blk, strlen(msg_2blk), digest,
+		       CHUNKSZ_SHA512);
+	ut_asserteq_mem(sha512_2blk, digest, SHA512_SUM_LEN);
+
+	/* odd-sized updates, so that blocks are split between them */
+	memset(buf, 'a', sizeof(buf));
+	sha512_starts(&ctx);
+	sha512_update(&ctx, buf, 7);
+	for (i = 0; i < 999; i++)
+		sha512_update(&ctx, buf, sizeof(buf));
+	sha512_update(&ctx, buf, sizeof(buf) - 7);
+	sha512_finish(&ctx, digest);
+	ut_asserteq_mem(sha512_million, digest, SHA512_SUM_LEN);
+
+	return 0;
+}
+LIB_TEST(lib_test_sha512, 0);
+
+static int lib_test_sha384(struct unit_test_state *uts)
+{
+	uint8_t digest[SHA384_SUM_LEN];
+
+	if (!IS_ENABLED(CONFIG_SHA384))
+		return -EAGAIN;
+
+	sha384_csum_wd((const uint8_t *)msg_abc, strlen(msg_abc), digest,
+		       CHUNKSZ_SHA384);
+	ut_asserteq_mem(sha384_abc, digest, SHA384_SUM_LEN);
+
+	return 0;
+}
+LIB_TEST(lib_test_sha384, 0);
@@ -2,6 +2,7 @@
 # Copyright (C) 2020 Bootlin
 # Author: Joao Marcos Costa <joaomarcos.costa@bootlin.com>
 
+import hashlib
 import os
 import subprocess
 import pytest
@@ -106,6 +107,53 @@ def sqfs_load_non_existent_file(ubman):
     out = ubman.run_command('sqfsload host 0 {} {}'.format(address, file))
     assert 'Failed to load' in out
 
+def sqfs_load_files_at_offset(ubman):
+    """ Loads parts of files, starting part-way through them.
+
+    This checks that the data before the offset is skipped correctly, in data
+    blocks as well as in fragments, and that the load stops after the number
+    of bytes asked for.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    address = '$kernel_addr_r'
+    # file, file size, bytes to load (0 for the rest of the file), offset
+    cases = [('f4096', 4096, 0, 100), ('f5096', 5096, 0, 4500),
+             ('f5096', 5096, 100, 4000), ('f1000', 1000, 0, 999)]
+    for (file, size, count, pos) in cases:
+        out = ubman.run_command('sqfsload host 0 {} {} {:x} {:x}'.format(
+            address, file, count, pos))
+        length = count if count else size - pos
+        assert '{} bytes read'.format(length) in out
+
+        # the test files are filled with 'x'
+        checksum = hashlib.md5(b'x' * length).hexdigest()
+        assert uboot_md5sum(ubman, address, hex(length)) == checksum
+
+def sqfs_load_files_cached(ubman):
+    """ Loads files through a symlink and loads them more than once.
+
+    The decompressed tables and fragment blocks are kept between commands, so
+    the second load of each file, and the symlink which is followed again,
+    come from the cache. Listing a directory in between checks that the
+    directory stream, which outlives the command that opened it, keeps the
+    tables it uses.
+
+    Args:
+        ubman: provides the means to interact with U-Boot's console.
+    """
+    files = ['sym/subdir-file', 'f1000']
+    sizes = ['100', '1000']
+    address = '$kernel_addr_r'
+    sqfs_load_files(ubman, files, sizes, address)
+
+    output = ubman.run_command('ls host 0 sym')
+    assert 'subdir-file' in output
+    assert '1 file(s), 0 dir(s)' in output
+
+    sqfs_load_files(ubman, files, sizes, address)
+
 def sqfs_run_all_load_tests(ubman):
     """ Runs all the previously defined test cases.
 
@@ -115,6 +163,8 @@ def sqfs_run_all_load_tests(ubman):
     sqfs_load_files_at_root(ubman)
     sqfs_load_files_at_subdir(ubman)
     sqfs_load_non_existent_file(ubman)
+    sqfs_load_files_at_offset(ubman)
+    sqfs_load_files_cached(ubman)
 
 @pytest.mark.boardspec('sandbox')
 @pytest.mark.buildconfigspec('cmd_fs_generic')
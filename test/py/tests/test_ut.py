@@ -516,6 +516,20 @@ def test_ut_dm_init(ubman):
     fs_helper.mk_fs(ubman.config, 'ext2', 0x200000, '2MB', None)
     fs_helper.mk_fs(ubman.config, 'fat32', 0x100000, '1MB', None)
 
+    # Create a directory tree for the block-cache test
+    tree = os.path.join(ubman.config.persistent_data_dir, 'blkcache-tree')
+    utils.run_and_log(ubman, f'rm -rf {tree}')
+    for dirnum in range(8):
+        dirname = os.path.join(tree, f'dir{dirnum}')
+        os.makedirs(os.path.join(dirname, 'sub'))
+        for filenum in range(40):
+            fn = os.path.join(dirname, 'sub' if filenum >= 32 else '',
+                              f'file{filenum}')
+            with open(fn, 'w', encoding='ascii') as fh:
+                fh.write(f'{dirnum} {filenum}\n')
+    fs_helper.mk_fs(ubman.config, 'ext4', 0x400000, '4MB', tree)
+    utils.run_and_log(ubman, f'rm -rf {tree}')
+
     mmc_dev = 6
     fn = os.path.join(ubman.config.source_dir, f'mmc{mmc_dev}.img')
     data = b'\x00' * (12 * 1024 * 1024)